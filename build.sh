@@ -56,7 +56,7 @@ check_dependencies() {
 # 清理旧文件
 clean() {
     print_info "清理旧的编译文件..."
-    rm -f *.o websocket_server
+    make clean
     print_success "清理完成"
 }
 
@@ -64,28 +64,14 @@ clean() {
 build() {
     print_info "开始编译WebSocket服务器..."
     
-    # 编译参数
-    CXX="g++"
-    CXXFLAGS="-std=c++11 -Wall -Wextra -O2 -pthread"
-    LDFLAGS="-lssl -lcrypto -lpthread"
-    
     # 如果是调试模式
     if [ "$1" = "debug" ]; then
-        CXXFLAGS="$CXXFLAGS -g -DDEBUG"
         print_info "编译调试版本..."
+        make debug
+    else
+        make
     fi
     
-    # 编译源文件
-    print_info "编译 websocket_server.cpp..."
-    $CXX $CXXFLAGS -c websocket_server.cpp -o websocket_server.o
-    
-    print_info "编译 main.cpp..."
-    $CXX $CXXFLAGS -c main.cpp -o main.o
-    
-    # 链接
-    print_info "链接可执行文件..."
-    $CXX websocket_server.o main.o -o websocket_server $LDFLAGS
-    
     print_success "编译完成！可执行文件: websocket_server"
 }
 
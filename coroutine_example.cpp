@@ -0,0 +1,44 @@
+// 协程接口示例（需要 C++20）：make coroutine
+#include "websocket_coroutine.h"
+#include <iostream>
+#include <string>
+
+// 每个连接一个协程：普通消息直接回显，"slow" 在等待1秒后回复，等待期间不占用任何线程
+static CoTask handleConnection(CoConnection conn)
+{
+    co_await conn.send("Welcome! Your client ID is " + std::to_string(conn.id()));
+
+    while (auto message = co_await conn.recv())
+    {
+        if (*message == "slow")
+        {
+            co_await conn.sleep(std::chrono::milliseconds(1000));
+            co_await conn.send("Slow reply after 1s");
+        }
+        else
+        {
+            co_await conn.send("Echo: " + *message);
+        }
+    }
+
+    std::cout << "Client " << conn.id() << " coroutine finished" << std::endl;
+}
+
+int main()
+{
+    WebSocketServer server(8080, 4);
+    setCoroutineHandler(server, handleConnection);
+
+    if (!server.start())
+    {
+        std::cerr << "Failed to start server" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Coroutine WebSocket server running, press Enter to stop" << std::endl;
+    std::string line;
+    std::getline(std::cin, line);
+
+    server.stop();
+    return 0;
+}
@@ -1,10 +1,13 @@
 #include "websocket_server.h"
+#include "websocket_log.h"
 #include <iostream>
 #include <string>
 #include <chrono>
 #include <thread>
 #include <signal.h>
 #include <sstream>
+#include <cstdio>
+#include <cstdlib>
 
 // 全局服务器实例，用于信号处理
 WebSocketServer *g_server = nullptr;
@@ -19,8 +22,69 @@ void signalHandler(int signal)
     exit(0);
 }
 
-int main()
+int main(int argc, char *argv[])
 {
+    // 可选的TLS参数：--cert <file> --key <file> [--ticket-keys <file>] [--ktls]
+    // 热升级：--upgrade-socket <path>，新进程以同样参数启动即可接管旧进程的连接
+    // 限速：--client-rate <消息数/秒>[:<字节数/秒>]，--ip-rate <消息数/秒>[:<字节数/秒>]
+    // 消息大小上限：--max-message-size <字节>（默认16MB，0 表示不限）
+    // 监听地址：--listen <地址>，可重复，如 --listen :: --listen unix:/run/websocket.sock（默认 0.0.0.0:8080）
+    // 同机多进程广播：--bus <目录>，使用同一目录的进程之间互相转发 broadcast
+    // 外部进程注入：--ingest-socket <path>，生产者进程用 IngestProducer 连接后经共享内存写入消息
+    // 流量录制：--capture <file>，之后可用 websocket_bench replay <file> 重放
+    // 会话恢复：--session-grace <秒>，客户端断开后在这段时间内可带令牌重连并补收错过的消息
+    // 日志：--log-level <debug|info|warn|error>（默认info，编译期级别见 Makefile 的 LOG_LEVEL）
+    std::string cert_file, key_file, ticket_key_file, upgrade_socket, bus_directory, ingest_socket, capture_file;
+    std::vector<std::string> listen_addresses;
+    bool ktls = false;
+    int session_grace = 0;
+    double client_rate[2] = {0, 0};
+    double ip_rate[2] = {0, 0};
+    long long max_message_size = -1;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--cert" && i + 1 < argc)
+            cert_file = argv[++i];
+        else if (arg == "--key" && i + 1 < argc)
+            key_file = argv[++i];
+        else if (arg == "--ticket-keys" && i + 1 < argc)
+            ticket_key_file = argv[++i];
+        else if (arg == "--ktls")
+            ktls = true;
+        else if (arg == "--upgrade-socket" && i + 1 < argc)
+            upgrade_socket = argv[++i];
+        else if (arg == "--listen" && i + 1 < argc)
+            listen_addresses.push_back(argv[++i]);
+        else if (arg == "--bus" && i + 1 < argc)
+            bus_directory = argv[++i];
+        else if (arg == "--ingest-socket" && i + 1 < argc)
+            ingest_socket = argv[++i];
+        else if (arg == "--capture" && i + 1 < argc)
+            capture_file = argv[++i];
+        else if (arg == "--session-grace" && i + 1 < argc)
+            session_grace = atoi(argv[++i]);
+        else if (arg == "--max-message-size" && i + 1 < argc)
+            max_message_size = atoll(argv[++i]);
+        else if (arg == "--log-level" && i + 1 < argc)
+        {
+            std::string level = argv[++i];
+            if (level == "debug")
+                AsyncLogger::setLevel(LogLevel::Debug);
+            else if (level == "warn")
+                AsyncLogger::setLevel(LogLevel::Warn);
+            else if (level == "error")
+                AsyncLogger::setLevel(LogLevel::Error);
+            else
+                AsyncLogger::setLevel(LogLevel::Info);
+        }
+        else if ((arg == "--client-rate" || arg == "--ip-rate") && i + 1 < argc)
+        {
+            double *rate = arg == "--client-rate" ? client_rate : ip_rate;
+            sscanf(argv[++i], "%lf:%lf", &rate[0], &rate[1]);
+        }
+    }
+
     // 设置信号处理
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
@@ -60,6 +124,67 @@ int main()
     // 设置断开连接处理回调
     server.setDisconnectionHandler([](int client_id)
                                    { std::cout << "Client " << client_id << " disconnected" << std::endl; });
+    server.setResumeHandler([](int client_id, size_t replayed)
+                            { std::cout << "Client " << client_id << " resumed, replayed " << replayed << " messages" << std::endl; });
+
+    // 提供证书时以 wss:// 提供服务
+    if (!cert_file.empty())
+    {
+        server.setKtlsEnabled(ktls);
+        if (!server.enableTls(cert_file, key_file.empty() ? cert_file : key_file))
+        {
+            std::cerr << "Failed to enable TLS" << std::endl;
+            return 1;
+        }
+        if (!ticket_key_file.empty() && !server.setTlsTicketKeyFile(ticket_key_file))
+        {
+            std::cerr << "Failed to load TLS ticket keys" << std::endl;
+            return 1;
+        }
+    }
+
+    for (const std::string &address : listen_addresses)
+    {
+        if (!server.addListenAddress(address))
+        {
+            std::cerr << "Invalid listen address: " << address << std::endl;
+            return 1;
+        }
+    }
+
+    if (!bus_directory.empty())
+    {
+        server.setBroadcastBus(bus_directory);
+    }
+    if (!ingest_socket.empty())
+    {
+        server.setIngestSocket(ingest_socket);
+    }
+    if (!capture_file.empty())
+    {
+        server.setCaptureFile(capture_file);
+    }
+    if (session_grace > 0)
+    {
+        server.setSessionResumption(session_grace);
+    }
+
+    server.setClientRateLimit(client_rate[0], client_rate[1]);
+    server.setIpRateLimit(ip_rate[0], ip_rate[1]);
+    if (max_message_size >= 0)
+    {
+        server.setMaxMessageSize(static_cast<size_t>(max_message_size));
+    }
+
+    // 热升级：连接交给新进程后退出
+    if (!upgrade_socket.empty())
+    {
+        server.setUpgradeSocket(upgrade_socket);
+        server.setUpgradeHandler([]
+                                 {
+            std::cout << "Handed over to new process, exiting" << std::endl;
+            exit(0); });
+    }
 
     // 启动服务器
     if (!server.start())
@@ -86,6 +211,69 @@ int main()
             std::cout << "Connected clients: " << server.getClientCount() << std::endl;
             std::cout << "Thread pool size: " << server.getThreadPoolSize() << std::endl;
             std::cout << "Available threads: " << server.getAvailableThreads() << std::endl;
+            auto overload = server.getOverloadStats();
+            std::cout << "Overloaded: " << (overload.overloaded ? "Yes" : "No") << std::endl;
+            std::cout << "Dispatch queue size: " << overload.queue_size << std::endl;
+            std::cout << "Paused connections: " << overload.paused_connections << std::endl;
+            std::cout << "Shed reads: " << overload.shed_reads << std::endl;
+            std::cout << "Deferred reads: " << overload.deferred_reads << std::endl;
+            std::cout << "Rejected handshakes: " << overload.rejected_handshakes << std::endl;
+            std::cout << "Rate-limited connections: " << overload.throttled_connections
+                      << " (throttled reads: " << overload.throttled_reads << ")" << std::endl;
+            auto accept = server.getAcceptStats();
+            std::cout << "Accepted connections: " << accept.accepted << " (errors: " << accept.accept_errors << ")"
+                      << std::endl;
+            std::cout << "Accept queue: " << accept.backlog_queued << "/" << accept.backlog_limit
+                      << " (overflows: " << accept.listen_overflows << ", drops: " << accept.listen_drops << ")"
+                      << std::endl;
+            auto numa = server.getNumaStats();
+            std::cout << "NUMA nodes: " << numa.numa_nodes << std::endl;
+            std::cout << "Cross-node dispatches: " << numa.cross_node_dispatches
+                      << " (local: " << numa.local_dispatches << ")" << std::endl;
+            std::cout << "Cross-node accepts: " << numa.cross_node_accepts << std::endl;
+            auto inline_stats = server.getInlineStats();
+            std::cout << "Inline messages: " << inline_stats.inline_messages
+                      << " (over budget: " << inline_stats.budget_overruns
+                      << ", max: " << inline_stats.max_handler_us << "us)" << std::endl;
+            if (server.isTlsEnabled())
+            {
+                auto tls = server.getTlsStats();
+                std::cout << "TLS handshakes: " << tls.full_handshakes << " full, " << tls.resumed_handshakes
+                          << " resumed, " << tls.failed_handshakes << " failed (kTLS: " << tls.ktls_connections
+                          << ")" << std::endl;
+            }
+            if (server.isBroadcastBusEnabled())
+            {
+                auto bus = server.getBusStats();
+                std::cout << "Broadcast bus: " << bus.peers << " peers, " << bus.published << " published, "
+                          << bus.received << " received (dropped: " << bus.dropped << ", oversized: " << bus.oversized
+                          << ")" << std::endl;
+            }
+            auto ingest = server.getIngestStats();
+            if (!ingest_socket.empty())
+            {
+                std::cout << "Ingest: producer " << (ingest.producer_connected ? "connected" : "not connected")
+                          << ", " << ingest.published << " records (rejected: " << ingest.rejected
+                          << ", backlog: " << ingest.backlog_bytes << " bytes)" << std::endl;
+            }
+            if (!capture_file.empty())
+            {
+                auto capture = server.getCaptureStats();
+                std::cout << "Capture: " << capture.records << " records, " << capture.bytes
+                          << " bytes (dropped: " << capture.dropped << ")" << std::endl;
+            }
+            if (session_grace > 0)
+            {
+                auto sessions = server.getSessionStats();
+                std::cout << "Sessions: " << sessions.sessions << " (detached: " << sessions.detached << ", "
+                          << sessions.retained_bytes << " bytes retained)" << std::endl;
+                std::cout << "Resumed sessions: " << sessions.resumed << " (replayed: " << sessions.replayed_frames
+                          << ", failed: " << sessions.resume_failures << ", evicted: " << sessions.evicted << ")"
+                          << std::endl;
+            }
+            auto log = AsyncLogger::getStats();
+            std::cout << "Log lines: " << log.lines << " (dropped: " << log.dropped << ", suppressed: " << log.suppressed
+                      << ")" << std::endl;
             std::cout << "Server running: " << (server.isRunning() ? "Yes" : "No") << std::endl;
             std::cout << "====================" << std::endl;
         }
@@ -172,7 +360,7 @@ int main()
         else if (input == "list")
         {
             std::cout << "Connected clients: " << server.getClientCount() << std::endl;
-            auto clients = server.getConnectedClients();
+            auto clients = server.getClientInfo();
             if (clients.empty())
             {
                 std::cout << "  No clients connected" << std::endl;
@@ -181,7 +369,9 @@ int main()
             {
                 for (const auto &client : clients)
                 {
-                    std::cout << "  Client " << client.first << " (" << client.second << ")" << std::endl;
+                    std::cout << "  Client " << client.client_id << " (" << client.client_ip << ") "
+                              << static_cast<uint64_t>(client.messages_per_sec) << " msg/s, "
+                              << static_cast<uint64_t>(client.bytes_per_sec) << " B/s" << std::endl;
                 }
             }
         }
@@ -6,13 +6,22 @@ echo "编译简化版WebSocket服务器..."
 
 # 编译参数
 CXX="g++"
-CXXFLAGS="-std=c++11 -Wall -Wextra -O2 -pthread"
+CXXFLAGS="-std=c++11 -Wall -Wextra -O2 -pthread -DWEBSOCKET_NO_TLS -I.."
 LDFLAGS="-lpthread"
 
 # 清理旧文件
 echo "清理旧文件..."
 rm -f simple_main.o simple_websocket_server.o simple_websocket_server
 
+# 编译核心库（不带TLS）
+echo "编译核心库..."
+make -C .. libwebsocket_core_notls.a
+
+if [ $? -ne 0 ]; then
+    echo "编译核心库失败"
+    exit 1
+fi
+
 # 编译源文件
 echo "编译 simple_websocket_server.cpp..."
 $CXX $CXXFLAGS -c simple_websocket_server.cpp -o simple_websocket_server.o
@@ -32,7 +41,7 @@ fi
 
 # 链接
 echo "链接可执行文件..."
-$CXX simple_websocket_server.o simple_main.o -o simple_websocket_server $LDFLAGS
+$CXX simple_websocket_server.o simple_main.o ../libwebsocket_core_notls.a -o simple_websocket_server $LDFLAGS
 
 if [ $? -ne 0 ]; then
     echo "链接失败"
@@ -90,6 +90,7 @@ int main() {
             break;
         } else if (input == "status") {
             std::cout << "Server is running on port 8080" << std::endl;
+            std::cout << "Connected clients: " << server.getClientCount() << std::endl;
         } else if (input.substr(0, 9) == "broadcast") {
             std::string message = input.length() > 10 ? input.substr(10) : "Server broadcast message";
             server.broadcastMessage(message);
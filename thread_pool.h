@@ -2,7 +2,6 @@
 #define THREAD_POOL_H
 
 #include <vector>
-#include <queue>
 #include <memory>
 #include <thread>
 #include <mutex>
@@ -10,16 +9,241 @@
 #include <future>
 #include <functional>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+#include <new>
+#include <chrono>
+#include <cmath>
+#include <atomic>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// 只能移动的任务类型，小对象直接存放在内联缓冲区中，
+// 派发时不需要像 std::function 那样为捕获列表分配堆内存
+class Task
+{
+public:
+    // 内联缓冲区大小，足以容纳 epoll 派发时的捕获列表
+    static const size_t kInlineSize = 64;
+
+    Task() noexcept : ops(nullptr) {}
+
+    template <class F, class Fn = typename std::decay<F>::type,
+              class = typename std::enable_if<!std::is_same<Fn, Task>::value>::type>
+    Task(F &&f) : ops(nullptr)
+    {
+        construct<Fn>(std::forward<F>(f), std::integral_constant<bool, fitsInline<Fn>()>());
+    }
+
+    Task(Task &&other) noexcept : ops(nullptr)
+    {
+        moveFrom(other);
+    }
+
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task() { reset(); }
+
+    explicit operator bool() const { return ops != nullptr; }
+
+    void operator()() { ops->invoke(&storage); }
+
+    void reset()
+    {
+        if (ops)
+        {
+            ops->destroy(&storage);
+            ops = nullptr;
+        }
+    }
+
+private:
+    typedef typename std::aligned_storage<kInlineSize, alignof(std::max_align_t)>::type Storage;
+
+    struct Ops
+    {
+        void (*invoke)(void *);
+        void (*move)(void *dst, void *src);
+        void (*destroy)(void *);
+    };
+
+    template <class Fn>
+    static constexpr bool fitsInline()
+    {
+        return sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(Storage) &&
+               std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+    // 内联存储：可调用对象直接构造在 storage 中
+    template <class Fn>
+    struct InlineOps
+    {
+        static void invoke(void *p) { (*static_cast<Fn *>(p))(); }
+        static void move(void *dst, void *src)
+        {
+            new (dst) Fn(std::move(*static_cast<Fn *>(src)));
+            static_cast<Fn *>(src)->~Fn();
+        }
+        static void destroy(void *p) { static_cast<Fn *>(p)->~Fn(); }
+        static const Ops table;
+    };
+
+    // 超出内联容量时退化为堆存储，storage 中只保存指针
+    template <class Fn>
+    struct HeapOps
+    {
+        static void invoke(void *p) { (**static_cast<Fn **>(p))(); }
+        static void move(void *dst, void *src)
+        {
+            *static_cast<Fn **>(dst) = *static_cast<Fn **>(src);
+        }
+        static void destroy(void *p) { delete *static_cast<Fn **>(p); }
+        static const Ops table;
+    };
+
+    template <class Fn, class F>
+    void construct(F &&f, std::true_type)
+    {
+        new (&storage) Fn(std::forward<F>(f));
+        ops = &InlineOps<Fn>::table;
+    }
+
+    template <class Fn, class F>
+    void construct(F &&f, std::false_type)
+    {
+        *reinterpret_cast<Fn **>(&storage) = new Fn(std::forward<F>(f));
+        ops = &HeapOps<Fn>::table;
+    }
+
+    void moveFrom(Task &other) noexcept
+    {
+        if (other.ops)
+        {
+            other.ops->move(&storage, &other.storage);
+            ops = other.ops;
+            other.ops = nullptr;
+        }
+    }
+
+    Storage storage;
+    const Ops *ops;
+};
+
+template <class Fn>
+const typename Task::Ops Task::InlineOps<Fn>::table = {&Task::InlineOps<Fn>::invoke, &Task::InlineOps<Fn>::move,
+                                                       &Task::InlineOps<Fn>::destroy};
+
+template <class Fn>
+const typename Task::Ops Task::HeapOps<Fn>::table = {&Task::HeapOps<Fn>::invoke, &Task::HeapOps<Fn>::move,
+                                                     &Task::HeapOps<Fn>::destroy};
+
+// 环形任务队列，容量只增不减，稳定运行后入队出队不再分配内存
+// 每个任务记录入队时间，用于计算排队延迟
+class TaskQueue
+{
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    TaskQueue() : head(0), count(0) {}
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+
+    void push(Task &&task, TimePoint enqueue_time)
+    {
+        if (count == slots.size())
+            grow();
+        Slot &slot = slots[(head + count) % slots.size()];
+        slot.task = std::move(task);
+        slot.enqueue_time = enqueue_time;
+        count++;
+    }
+
+    Task pop(TimePoint &enqueue_time)
+    {
+        Slot &slot = slots[head];
+        Task task(std::move(slot.task));
+        enqueue_time = slot.enqueue_time;
+        head = (head + 1) % slots.size();
+        count--;
+        return task;
+    }
+
+private:
+    struct Slot
+    {
+        Task task;
+        TimePoint enqueue_time;
+    };
+
+    void grow()
+    {
+        std::vector<Slot> bigger(slots.empty() ? 64 : slots.size() * 2);
+        for (size_t i = 0; i < count; ++i)
+        {
+            Slot &slot = slots[(head + i) % slots.size()];
+            bigger[i].task = std::move(slot.task);
+            bigger[i].enqueue_time = slot.enqueue_time;
+        }
+        slots.swap(bigger);
+        head = 0;
+    }
+
+    std::vector<Slot> slots;
+    size_t head;
+    size_t count;
+};
 
 class ThreadPool
 {
 public:
-    ThreadPool(size_t threads);
+    // max_queue_size 为 0 表示任务队列不设上限
+    ThreadPool(size_t threads, size_t max_queue_size = 0);
 
     template <class F, class... Args>
     auto enqueue(F &&f, Args &&...args)
         -> std::future<decltype(f(args...))>;
 
+    // 不关心返回值的快速提交路径，任务内联存储，不产生堆分配
+    template <class F>
+    void post(F &&f);
+
+    // 有界提交：队列已满时返回 false，由调用者决定推迟或丢弃
+    template <class F>
+    bool tryPost(F &&f);
+
+    // 设置任务队列上限（仅对 tryPost 生效），0 表示不设上限
+    void setMaxQueueSize(size_t size);
+
+    // 设置 CoDel 排队延迟目标值和观察窗口
+    void setQueueDelayTarget(std::chrono::microseconds target, std::chrono::microseconds interval);
+
+    // 排队延迟持续超过目标值时进入过载状态
+    bool isOverloaded() const { return overloaded.load(std::memory_order_relaxed); }
+
+    // 过载状态下按 CoDel 控制律（间隔 interval/sqrt(n)）返回是否应该削减一次负载
+    bool shouldShed();
+
+    // 获取当前排队任务数量
+    size_t getQueueSize() const;
+
+    // 将第 i 个工作线程绑定到 cpus[i % cpus.size()]（仅Linux）
+    bool setAffinity(const std::vector<int> &cpus);
+
     // 等待直到有空闲线程可用
     void waitForAvailableThread();
 
@@ -32,7 +256,7 @@ private:
     // 工作线程
     std::vector<std::thread> workers;
     // 任务队列
-    std::queue<std::function<void()>> tasks;
+    TaskQueue tasks;
 
     // 同步
     mutable std::mutex queue_mutex;
@@ -43,18 +267,32 @@ private:
     // 线程状态跟踪
     size_t total_threads;
     size_t busy_threads;
+
+    // 队列容量和 CoDel 状态（均由 queue_mutex 保护）
+    size_t max_queue_size;
+    std::chrono::steady_clock::duration codel_target;
+    std::chrono::steady_clock::duration codel_interval;
+    TaskQueue::TimePoint first_above_time;
+    TaskQueue::TimePoint drop_next;
+    size_t drop_count;
+    std::atomic<bool> overloaded;
+
+    bool push(Task &&task, bool bounded);
+    void updateQueueDelay(TaskQueue::TimePoint enqueue_time, TaskQueue::TimePoint now);
 };
 
 // 构造函数启动一定数量的工作线程
-inline ThreadPool::ThreadPool(size_t threads)
-    : stop(false), total_threads(threads), busy_threads(0)
+inline ThreadPool::ThreadPool(size_t threads, size_t max_queue_size)
+    : stop(false), total_threads(threads), busy_threads(0), max_queue_size(max_queue_size),
+      codel_target(std::chrono::milliseconds(5)), codel_interval(std::chrono::milliseconds(100)),
+      drop_count(0), overloaded(false)
 {
     for (size_t i = 0; i < threads; ++i)
     {
         workers.emplace_back([this]
                              {
             for(;;) {
-                std::function<void()> task;
+                Task task;
 
                 {
                     std::unique_lock<std::mutex> lock(this->queue_mutex);
@@ -63,15 +301,21 @@ inline ThreadPool::ThreadPool(size_t threads)
                     if(this->stop && this->tasks.empty())
                         return;
 
-                    task = std::move(this->tasks.front());
-                    this->tasks.pop();
+                    TaskQueue::TimePoint enqueue_time;
+                    task = this->tasks.pop(enqueue_time);
+                    this->updateQueueDelay(enqueue_time, std::chrono::steady_clock::now());
 
                     // 标记线程为忙碌状态
                     this->busy_threads++;
                 }
 
-                // 执行任务
-                task();
+                // 执行任务：任务抛出的异常不能离开工作线程（否则整个进程 terminate），在这里吞掉
+                try {
+                    task();
+                } catch (...) {
+                }
+                // 在锁外释放捕获的资源
+                task.reset();
 
                 {
                     std::unique_lock<std::mutex> lock(this->queue_mutex);
@@ -99,17 +343,91 @@ inline size_t ThreadPool::getAvailableThreads() const
     return total_threads - busy_threads;
 }
 
-// 添加新任务到线程池
-template <class F, class... Args>
-auto ThreadPool::enqueue(F &&f, Args &&...args)
-    -> std::future<decltype(f(args...))>
+inline void ThreadPool::setMaxQueueSize(size_t size)
 {
-    using return_type = decltype(f(args...));
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    max_queue_size = size;
+}
 
-    auto task = std::make_shared<std::packaged_task<return_type()>>(
-        std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+// 设置 CoDel 参数
+inline void ThreadPool::setQueueDelayTarget(std::chrono::microseconds target, std::chrono::microseconds interval)
+{
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    codel_target = target;
+    codel_interval = interval;
+}
 
-    std::future<return_type> res = task->get_future();
+// 获取当前排队任务数量
+inline size_t ThreadPool::getQueueSize() const
+{
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return tasks.size();
+}
+
+inline bool ThreadPool::setAffinity(const std::vector<int> &cpus)
+{
+#ifdef __linux__
+    if (cpus.empty())
+        return false;
+
+    bool ok = true;
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[i % cpus.size()], &set);
+        if (pthread_setaffinity_np(workers[i].native_handle(), sizeof(set), &set) != 0)
+            ok = false;
+    }
+    return ok;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+// 工作线程取出任务时更新 CoDel 状态，调用时已持有 queue_mutex
+inline void ThreadPool::updateQueueDelay(TaskQueue::TimePoint enqueue_time, TaskQueue::TimePoint now)
+{
+    // 排队延迟低于目标值或队列已清空，说明积压已经消化
+    if (now - enqueue_time < codel_target || tasks.empty())
+    {
+        first_above_time = TaskQueue::TimePoint();
+        overloaded.store(false, std::memory_order_relaxed);
+        return;
+    }
+
+    if (first_above_time == TaskQueue::TimePoint())
+    {
+        first_above_time = now + codel_interval;
+    }
+    else if (now >= first_above_time && !overloaded.load(std::memory_order_relaxed))
+    {
+        // 延迟持续一个观察窗口都高于目标值，进入过载状态
+        overloaded.store(true, std::memory_order_relaxed);
+        drop_next = now;
+        drop_count = 0;
+    }
+}
+
+inline bool ThreadPool::shouldShed()
+{
+    if (!isOverloaded())
+        return false;
+
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    TaskQueue::TimePoint now = std::chrono::steady_clock::now();
+    if (!overloaded.load(std::memory_order_relaxed) || now < drop_next)
+        return false;
+
+    drop_count++;
+    drop_next = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                          codel_interval / std::sqrt(static_cast<double>(drop_count)));
+    return true;
+}
+
+inline bool ThreadPool::push(Task &&task, bool bounded)
+{
     {
         std::unique_lock<std::mutex> lock(queue_mutex);
 
@@ -117,13 +435,46 @@ auto ThreadPool::enqueue(F &&f, Args &&...args)
         if (stop)
             throw std::runtime_error("enqueue on stopped ThreadPool");
 
-        tasks.emplace([task]()
-                      { (*task)(); });
+        if (bounded && max_queue_size > 0 && tasks.size() >= max_queue_size)
+            return false;
+
+        tasks.push(std::move(task), std::chrono::steady_clock::now());
     }
     condition.notify_one();
+    return true;
+}
+
+// 添加新任务到线程池
+template <class F, class... Args>
+auto ThreadPool::enqueue(F &&f, Args &&...args)
+    -> std::future<decltype(f(args...))>
+{
+    using return_type = decltype(f(args...));
+
+    auto task = std::make_shared<std::packaged_task<return_type()>>(
+        std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+
+    std::future<return_type> res = task->get_future();
+    push(Task([task]()
+              { (*task)(); }),
+         false);
     return res;
 }
 
+// 添加无返回值的任务到线程池
+template <class F>
+void ThreadPool::post(F &&f)
+{
+    push(Task(std::forward<F>(f)), false);
+}
+
+// 添加无返回值的任务到有界队列
+template <class F>
+bool ThreadPool::tryPost(F &&f)
+{
+    return push(Task(std::forward<F>(f)), true);
+}
+
 // 析构函数等待所有线程完成
 inline ThreadPool::~ThreadPool()
 {
@@ -0,0 +1,2715 @@
+// WebSocket服务器基准测试工具
+//
+// 用法: ./websocket_bench <mode> [options]
+//   alloc [messages]          - 统计每条消息派发到线程池时的堆分配次数
+//   latency [messages] [port] - 回显往返延迟：线程池派发 vs 内联处理
+//   tls-handshake [count] [port] - wss:// 握手速率：完整握手 vs 会话恢复
+//   tls-bulk [megabytes] [port]  - 大消息回显吞吐：明文 vs TLS vs kTLS
+//   utf8 [megabytes]          - 文本帧去掩码+UTF-8校验吞吐：ASCII为主 vs 中文为主
+//   sendfile [megabytes] [port]  - 大文件下发吞吐：读入内存后发送 vs sendFile（明文与TLS）
+//   fanout [rounds] [port]    - 向10/1k/50k个接收者发送同一条消息：逐个发送 vs sendToClients
+//   accept [connections] [port] - 重连风暴下的accept速率：backlog 10 vs 大backlog+TCP_DEFER_ACCEPT
+//   idle [connections] [port] - 保持大量空闲连接时活跃连接的回显延迟（4个工作线程）
+//   memory [connections] [port] - 每个空闲连接占用的常驻内存（客户端在子进程中，只统计服务器进程）
+//   uds [messages] [port]     - 回显往返延迟与CPU开销：loopback TCP vs Unix域socket
+//   bus [processes] [messages] [port] - 经广播总线向同机其他服务器进程的客户端广播
+//   ingest [messages] [port]  - 外部进程经共享内存环注入消息的吞吐
+//   replay <capture-file> [speed] [port] - 按录制文件重放客户端流量到运行中的服务器（speed 0 为不等待）
+//   resume [clients] [port]   - 客户端断线重连后追上状态：重新下发全量状态 vs 会话恢复只重放错过的消息
+//   log [lines]               - 4个线程同时写日志的每条耗时：std::cout+std::endl vs 异步日志
+//   disconnect [clients] [port] - 客户端断开到服务器触发断开回调的延迟：服务器空闲 vs 持续有回显流量
+//   burst [megabytes] [port]  - 4个客户端各自一次性发出数MB消息：吞吐、乱序和同一连接并发处理的次数
+//   handoff [clients] [port]  - 持续推送和回显的负载下热升级到新进程：每个客户端收到的编号是否连续、无丢失
+//   frames [port]             - 协议错误处理：超大帧、累计超限的分片消息、分片中的非法UTF-8、分片顺序错误是否以正确的状态码关闭
+
+#include "thread_pool.h"
+#include "websocket_server.h"
+#include "websocket_utf8.h"
+#include "websocket_log.h"
+#include <netinet/tcp.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <iomanip>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <sys/un.h>
+#include <fstream>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <openssl/pem.h>
+
+// 全局分配计数，覆盖 operator new 以统计堆分配次数
+static std::atomic<size_t> g_allocations(0);
+
+void *operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = std::malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+// 客户端帧必须掩码
+static const uint8_t frame_mask[4] = {0x12, 0x34, 0x56, 0x78};
+
+// 最小化的WebSocket客户端，用于驱动基准测试
+class BenchClient
+{
+public:
+    BenchClient() : fd(-1), ssl(nullptr), frame_opcode(0) {}
+    ~BenchClient() { close(); }
+
+    // tls_ctx 非空时走 wss://，session 非空时尝试恢复该会话
+    bool connect(const std::string &host, int port, const std::string &path = "/",
+                 SSL_CTX *tls_ctx = nullptr, SSL_SESSION *session = nullptr)
+    {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            return false;
+
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+        if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            close();
+            return false;
+        }
+
+        if (tls_ctx)
+        {
+            ssl = SSL_new(tls_ctx);
+            SSL_set_fd(ssl, fd);
+            if (session)
+                SSL_set_session(ssl, session);
+            if (SSL_connect(ssl) != 1)
+            {
+                close();
+                return false;
+            }
+        }
+
+        return upgrade(host, path);
+    }
+
+    // 经Unix域socket连接（不支持TLS）
+    bool connectUnix(const std::string &socket_path, const std::string &path = "/")
+    {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return false;
+
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+        if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            close();
+            return false;
+        }
+        return upgrade("localhost", path);
+    }
+
+    bool sendText(const std::string &payload) { return sendFrame(0x1, payload); }
+    bool sendBinary(const std::string &payload) { return sendFrame(0x2, payload); }
+
+    // fin 为 false 时发出分片消息的一个分片（后续分片的 opcode 为 0）
+    bool sendFrame(uint8_t opcode, const std::string &payload, bool fin = true)
+    {
+        std::string frame = frameHeader(opcode, payload.size(), fin);
+        size_t offset = frame.size();
+        frame.append(payload);
+        for (size_t i = 0; i < payload.size(); i++)
+            frame[offset + i] ^= frame_mask[i % 4];
+
+        return writeAll(frame.data(), frame.size());
+    }
+
+    // 只发出帧头（声明的负载长度为 length，负载不发送），用于检查服务器是否在负载到达前就处理帧头
+    bool sendFrameHeader(uint8_t opcode, uint64_t length)
+    {
+        std::string header = frameHeader(opcode, length, true);
+        return writeAll(header.data(), header.size());
+    }
+
+    // 读取下一帧的负载
+    bool receiveFrame(std::string &payload)
+    {
+        while (!takeFrame(payload))
+        {
+            if (!fill())
+                return false;
+        }
+        return true;
+    }
+
+    // 跳过数据帧，读到服务器的 close 帧后取出状态码；连接断开或超时前没有收到 close 帧时返回 false
+    bool receiveClose(uint16_t &status)
+    {
+        std::string payload;
+        while (receiveFrame(payload))
+        {
+            if (frame_opcode != 0x8)
+                continue;
+            status = payload.size() >= 2 ? (static_cast<uint8_t>(payload[0]) << 8) | static_cast<uint8_t>(payload[1]) : 1005;
+            return true;
+        }
+        return false;
+    }
+
+    // 最近一次取出的帧的 opcode
+    uint8_t lastOpcode() const { return frame_opcode; }
+
+    // 非阻塞地取出下一帧（不支持TLS），没有完整的帧时返回 false；连接已断开时 closed 置为 true
+    bool pollFrame(std::string &payload, bool &closed)
+    {
+        if (takeFrame(payload))
+            return true;
+        char buffer[65536];
+        ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n > 0)
+            pending.append(buffer, n);
+        else if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            closed = true;
+        return takeFrame(payload);
+    }
+
+    int getFd() const { return fd; }
+
+    // 握手响应中的会话令牌（服务器开启会话恢复时）
+    const std::string &getSessionToken() const { return session_token; }
+
+    // 当前会话（TLS 1.3 的票据在握手后才到达，需在收到101响应之后获取）
+    SSL_SESSION *session() const { return ssl ? SSL_get1_session(ssl) : nullptr; }
+    bool isResumed() const { return ssl && SSL_session_reused(ssl); }
+
+    // 之后的 receiveFrame 最多等待 ms 毫秒
+    void setReceiveTimeout(int ms)
+    {
+        struct timeval timeout;
+        timeout.tv_sec = ms / 1000;
+        timeout.tv_usec = (ms % 1000) * 1000;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+
+    void close()
+    {
+        if (ssl)
+        {
+            // 正常关闭，否则OpenSSL会把会话标记为不可恢复
+            SSL_shutdown(ssl);
+            SSL_free(ssl);
+            ssl = nullptr;
+        }
+        if (fd >= 0)
+        {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+private:
+    int fd;
+    SSL *ssl;
+    std::string pending;
+    std::string session_token;
+    uint8_t frame_opcode;
+
+    // 帧头（含掩码键）
+    static std::string frameHeader(uint8_t opcode, uint64_t length, bool fin)
+    {
+        std::string header;
+        header.push_back(static_cast<char>((fin ? 0x80 : 0) | opcode));
+        if (length < 126)
+        {
+            header.push_back(static_cast<char>(0x80 | length));
+        }
+        else if (length < 65536)
+        {
+            header.push_back(static_cast<char>(0x80 | 126));
+            header.push_back(static_cast<char>((length >> 8) & 0xFF));
+            header.push_back(static_cast<char>(length & 0xFF));
+        }
+        else
+        {
+            header.push_back(static_cast<char>(0x80 | 127));
+            for (int i = 7; i >= 0; i--)
+                header.push_back(static_cast<char>((length >> (i * 8)) & 0xFF));
+        }
+        header.append(reinterpret_cast<const char *>(frame_mask), 4);
+        return header;
+    }
+
+    // 发送升级请求并读取101响应
+    bool upgrade(const std::string &host, const std::string &path)
+    {
+        std::string request = "GET " + path + " HTTP/1.1\r\n";
+        request += "Host: " + host + "\r\n";
+        request += "Upgrade: websocket\r\n";
+        request += "Connection: Upgrade\r\n";
+        request += "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n";
+        request += "Sec-WebSocket-Version: 13\r\n\r\n";
+        if (!writeAll(request.data(), request.size()))
+            return false;
+
+        // 读取握手响应，多读到的字节留给后续的帧解析
+        size_t header_end;
+        while ((header_end = pending.find("\r\n\r\n")) == std::string::npos)
+        {
+            if (!fill())
+                return false;
+        }
+        bool upgraded = pending.compare(0, 12, "HTTP/1.1 101") == 0;
+        size_t token = pending.find("X-Session-Token: ");
+        if (token != std::string::npos && token < header_end)
+        {
+            token += 17;
+            session_token = pending.substr(token, pending.find("\r\n", token) - token);
+        }
+        pending.erase(0, header_end + 4);
+        return upgraded;
+    }
+
+    // 从已读到的字节中取出一个完整的帧
+    bool takeFrame(std::string &payload)
+    {
+        if (pending.size() < 2)
+            return false;
+        uint64_t length = static_cast<uint8_t>(pending[1]) & 0x7F;
+        size_t header = 2;
+        if (length == 126)
+        {
+            if (pending.size() < 4)
+                return false;
+            length = (static_cast<uint8_t>(pending[2]) << 8) | static_cast<uint8_t>(pending[3]);
+            header = 4;
+        }
+        else if (length == 127)
+        {
+            if (pending.size() < 10)
+                return false;
+            length = 0;
+            for (int i = 0; i < 8; i++)
+                length = (length << 8) | static_cast<uint8_t>(pending[2 + i]);
+            header = 10;
+        }
+        if (pending.size() < header + length)
+            return false;
+        frame_opcode = static_cast<uint8_t>(pending[0]) & 0x0F;
+        payload.assign(pending, header, length);
+        pending.erase(0, header + length);
+        return true;
+    }
+
+    bool fill()
+    {
+        char buffer[65536];
+        ssize_t n = ssl ? SSL_read(ssl, buffer, sizeof(buffer)) : recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0)
+            return false;
+        pending.append(buffer, n);
+        return true;
+    }
+
+    bool writeAll(const char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t n = ssl ? SSL_write(ssl, data, static_cast<int>(size)) : send(fd, data, size, MSG_NOSIGNAL);
+            if (n <= 0)
+                return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+};
+
+// 按 "名称 指标=值" 的统一格式输出延迟分布
+static void printLatency(const std::string &name, std::vector<double> &latencies_us, double seconds)
+{
+    std::sort(latencies_us.begin(), latencies_us.end());
+    double sum = 0;
+    for (double v : latencies_us)
+        sum += v;
+    size_t n = latencies_us.size();
+
+    std::cout << std::left << std::setw(10) << name
+              << " messages=" << n
+              << std::fixed << std::setprecision(1)
+              << " p50=" << latencies_us[n / 2] << "us"
+              << " p99=" << latencies_us[std::min(n - 1, n * 99 / 100)] << "us"
+              << " avg=" << sum / n << "us"
+              << std::setprecision(0)
+              << " msgs/sec=" << n / seconds
+              << std::endl;
+}
+
+// 模拟 epoll 线程派发消息时的捕获列表
+struct FakeConnection
+{
+    std::atomic<size_t> handled{0};
+};
+
+static void printResult(const std::string &name, size_t messages, size_t allocations, double seconds)
+{
+    std::cout << std::left << std::setw(10) << name
+              << " messages=" << messages
+              << " allocs=" << allocations
+              << " allocs/msg=" << std::fixed << std::setprecision(3)
+              << static_cast<double>(allocations) / messages
+              << " msgs/sec=" << std::setprecision(0) << messages / seconds
+              << std::endl;
+}
+
+template <class Submit>
+static void runAllocBench(const std::string &name, size_t messages, Submit submit)
+{
+    ThreadPool pool(4);
+    auto connection = std::make_shared<FakeConnection>();
+    std::map<int, int> socket_to_client_id;
+
+    // 预热，让任务队列扩容到稳定大小
+    for (size_t i = 0; i < 1024; ++i)
+        submit(pool, connection, socket_to_client_id);
+    while (connection->handled < 1024)
+        std::this_thread::yield();
+
+    size_t before = g_allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < messages; ++i)
+        submit(pool, connection, socket_to_client_id);
+    while (connection->handled < 1024 + messages)
+        std::this_thread::yield();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t allocations = g_allocations.load() - before;
+
+    printResult(name, messages, allocations, seconds);
+}
+
+static int allocBench(size_t messages)
+{
+    std::cout << "=== Allocations per dispatched message ===" << std::endl;
+
+    runAllocBench("enqueue", messages, [](ThreadPool &pool, std::shared_ptr<FakeConnection> connection, std::map<int, int> &socket_to_client_id)
+                  {
+        int client_id = 1, client_socket = 5, epoll_fd = 3;
+        ThreadPool *self = &pool;
+        pool.enqueue([self, connection, client_id, client_socket, &socket_to_client_id, epoll_fd] {
+            (void)self; (void)client_id; (void)client_socket; (void)socket_to_client_id; (void)epoll_fd;
+            connection->handled++;
+        }); });
+
+    runAllocBench("post", messages, [](ThreadPool &pool, std::shared_ptr<FakeConnection> connection, std::map<int, int> &socket_to_client_id)
+                  {
+        int client_id = 1, client_socket = 5, epoll_fd = 3;
+        ThreadPool *self = &pool;
+        pool.post([self, connection, client_id, client_socket, &socket_to_client_id, epoll_fd] {
+            (void)self; (void)client_id; (void)client_socket; (void)socket_to_client_id; (void)epoll_fd;
+            connection->handled++;
+        }); });
+
+    return 0;
+}
+
+static bool runLatencyBench(const std::string &name, WebSocketServer::DispatchMode mode, int port, size_t messages)
+{
+    WebSocketServer server(port, 4);
+    server.setDispatchMode(mode);
+    server.setMessageHandler([&server](int client_id, const std::string &message)
+                             { server.sendMessageToClient(client_id, message); });
+    if (!server.start())
+        return false;
+
+    BenchClient client;
+    if (!client.connect("127.0.0.1", port))
+    {
+        std::cerr << "Failed to connect to benchmark server" << std::endl;
+        server.stop();
+        return false;
+    }
+
+    std::string payload(64, 'x');
+    std::string reply;
+
+    // 预热
+    for (size_t i = 0; i < 1000; i++)
+    {
+        client.sendText(payload);
+        client.receiveFrame(reply);
+    }
+
+    std::vector<double> latencies;
+    latencies.reserve(messages);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < messages; i++)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        if (!client.sendText(payload) || !client.receiveFrame(reply))
+        {
+            std::cerr << "Connection lost during benchmark" << std::endl;
+            break;
+        }
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    client.close();
+    server.stop();
+
+    if (latencies.empty())
+        return false;
+    printLatency(name, latencies, seconds);
+    return true;
+}
+
+static int latencyBench(size_t messages, int port)
+{
+    std::cout << "=== Echo round-trip latency ===" << std::endl;
+    bool ok = runLatencyBench("pool", WebSocketServer::DispatchMode::Pool, port, messages);
+    ok = runLatencyBench("inline", WebSocketServer::DispatchMode::Inline, port + 1, messages) && ok;
+    return ok ? 0 : 1;
+}
+
+// 生成自签名的 P-256 证书，写入临时文件供服务器加载
+static bool writeSelfSignedCertificate(const std::string &cert_file, const std::string &key_file)
+{
+    EVP_PKEY *key = EVP_EC_gen("P-256");
+    X509 *cert = X509_new();
+    if (!key || !cert)
+        return false;
+
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+    X509_set_pubkey(cert, key);
+    X509_NAME *name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    bool ok = X509_sign(cert, key, EVP_sha256()) > 0;
+
+    FILE *file = fopen(cert_file.c_str(), "w");
+    ok = ok && file && PEM_write_X509(file, cert);
+    if (file)
+        fclose(file);
+    file = fopen(key_file.c_str(), "w");
+    ok = ok && file && PEM_write_PrivateKey(file, key, nullptr, nullptr, 0, nullptr, nullptr);
+    if (file)
+        fclose(file);
+
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return ok;
+}
+
+static const char *bench_cert_file = "/tmp/websocket_bench_cert.pem";
+static const char *bench_key_file = "/tmp/websocket_bench_key.pem";
+
+static void printRate(const std::string &name, size_t count, double seconds, const std::string &unit, double amount)
+{
+    std::cout << std::left << std::setw(10) << name
+              << " count=" << count
+              << std::fixed << std::setprecision(1)
+              << " " << unit << "=" << amount / seconds
+              << " seconds=" << std::setprecision(3) << seconds
+              << std::endl;
+}
+
+static int tlsHandshakeBench(size_t count, int port)
+{
+    if (!writeSelfSignedCertificate(bench_cert_file, bench_key_file))
+    {
+        std::cerr << "Failed to create self-signed certificate" << std::endl;
+        return 1;
+    }
+
+    WebSocketServer server(port, 4);
+    if (!server.enableTls(bench_cert_file, bench_key_file) || !server.start())
+        return 1;
+
+    SSL_CTX *client_ctx = SSL_CTX_new(TLS_client_method());
+    std::cout << "=== wss:// handshakes (TLS + WebSocket upgrade) ===" << std::endl;
+
+    // 完整握手：每次都是新会话
+    auto start = std::chrono::steady_clock::now();
+    size_t full = 0;
+    SSL_SESSION *session = nullptr;
+    for (size_t i = 0; i < count; i++)
+    {
+        BenchClient client;
+        if (!client.connect("127.0.0.1", port, "/", client_ctx))
+            break;
+        if (!session)
+            session = client.session();
+        full++;
+    }
+    printRate("full", full, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+              "handshakes/sec", full);
+
+    // 会话恢复：复用第一次握手得到的票据
+    start = std::chrono::steady_clock::now();
+    size_t resumed = 0;
+    for (size_t i = 0; session && i < count; i++)
+    {
+        BenchClient client;
+        if (!client.connect("127.0.0.1", port, "/", client_ctx, session))
+            break;
+        if (client.isResumed())
+            resumed++;
+        SSL_SESSION *next = client.session();
+        if (next)
+        {
+            SSL_SESSION_free(session);
+            session = next;
+        }
+    }
+    printRate("resumed", resumed, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+              "handshakes/sec", resumed);
+
+    WebSocketServer::TlsStats stats = server.getTlsStats();
+    std::cout << "server: full=" << stats.full_handshakes << " resumed=" << stats.resumed_handshakes
+              << " failed=" << stats.failed_handshakes << std::endl;
+
+    if (session)
+        SSL_SESSION_free(session);
+    SSL_CTX_free(client_ctx);
+    server.stop();
+    return full == count && resumed == count ? 0 : 1;
+}
+
+static bool runBulkBench(const std::string &name, int port, bool tls, bool ktls, size_t megabytes)
+{
+    WebSocketServer server(port, 4);
+    server.setKtlsEnabled(ktls);
+    if (tls && !server.enableTls(bench_cert_file, bench_key_file))
+        return false;
+    server.setMessageHandler([&server](int client_id, const std::string &message)
+                             { server.sendMessageToClient(client_id, message); });
+    if (!server.start())
+        return false;
+
+    SSL_CTX *client_ctx = tls ? SSL_CTX_new(TLS_client_method()) : nullptr;
+    BenchClient client;
+    bool ok = client.connect("127.0.0.1", port, "/", client_ctx);
+
+    // 64KB 消息回显，统计单向负载吞吐
+    std::string payload(65536, 'x');
+    std::string reply;
+    size_t messages = megabytes * 16;
+    size_t done = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (; ok && done < messages; done++)
+    {
+        if (!client.sendText(payload) || !client.receiveFrame(reply) || reply.size() != payload.size())
+            ok = false;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    client.close();
+    if (client_ctx)
+        SSL_CTX_free(client_ctx);
+    WebSocketServer::TlsStats stats = server.getTlsStats();
+    server.stop();
+
+    if (!ok)
+    {
+        std::cerr << name << ": connection lost during benchmark" << std::endl;
+        return false;
+    }
+    printRate(name, done, seconds, "MB/sec", done * payload.size() / (1024.0 * 1024.0));
+    if (ktls && stats.ktls_connections == 0)
+        std::cout << "           (kernel TLS offload unavailable, fell back to userspace records)" << std::endl;
+    return true;
+}
+
+static int tlsBulkBench(size_t megabytes, int port)
+{
+    if (!writeSelfSignedCertificate(bench_cert_file, bench_key_file))
+    {
+        std::cerr << "Failed to create self-signed certificate" << std::endl;
+        return 1;
+    }
+
+    std::cout << "=== Bulk echo throughput (64KB messages) ===" << std::endl;
+    bool ok = runBulkBench("plain", port, false, false, megabytes);
+    ok = runBulkBench("tls", port + 1, true, false, megabytes) && ok;
+    ok = runBulkBench("ktls", port + 2, true, true, megabytes) && ok;
+    return ok ? 0 : 1;
+}
+
+static const char *bench_blob_file = "/tmp/websocket_bench_blob.bin";
+static const size_t bench_blob_size = 4 * 1024 * 1024;
+
+// 客户端每发一条请求，服务器回一个完整的文件
+// call_us 为回调中发送调用（含读文件）的最长耗时，期间该连接的发送锁被占用
+static bool runSendFileBench(const std::string &name, int port, bool zero_copy, bool tls, size_t megabytes)
+{
+    int blob_fd = open(bench_blob_file, O_RDONLY);
+    if (blob_fd < 0)
+        return false;
+
+    WebSocketServer server(port, 4);
+    if (tls && !server.enableTls(bench_cert_file, bench_key_file))
+    {
+        ::close(blob_fd);
+        return false;
+    }
+    std::atomic<int64_t> max_call_us(0);
+    server.setMessageHandler([&server, &max_call_us, blob_fd, zero_copy](int client_id, const std::string &)
+                             {
+        auto start = std::chrono::steady_clock::now();
+        if (zero_copy)
+        {
+            server.sendFile(client_id, blob_fd, 0, bench_blob_size);
+        }
+        else
+        {
+            std::string blob(bench_blob_size, '\0');
+            if (pread(blob_fd, &blob[0], blob.size(), 0) == static_cast<ssize_t>(blob.size()))
+                server.sendMessageToClient(client_id, blob);
+        }
+        int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        if (us > max_call_us.load())
+            max_call_us = us; });
+    if (!server.start())
+    {
+        ::close(blob_fd);
+        return false;
+    }
+
+    SSL_CTX *client_ctx = tls ? SSL_CTX_new(TLS_client_method()) : nullptr;
+    BenchClient client;
+    bool ok = client.connect("127.0.0.1", port, "/", client_ctx);
+
+    std::string reply;
+    size_t requests = std::max<size_t>(1, megabytes * 1024 * 1024 / bench_blob_size);
+    size_t done = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (; ok && done < requests; done++)
+    {
+        if (!client.sendText("get") || !client.receiveFrame(reply) || reply.size() != bench_blob_size)
+            ok = false;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    client.close();
+    server.stop();
+    ::close(blob_fd);
+    if (client_ctx)
+        SSL_CTX_free(client_ctx);
+
+    if (!ok)
+    {
+        std::cerr << name << ": connection lost during benchmark" << std::endl;
+        return false;
+    }
+    std::cout << std::left << std::setw(12) << name << " count=" << done << std::fixed << std::setprecision(1)
+              << " MB/sec=" << done * bench_blob_size / (1024.0 * 1024.0) / seconds
+              << " seconds=" << std::setprecision(3) << seconds
+              << " call_us=" << max_call_us.load() << std::endl;
+    return true;
+}
+
+static int sendFileBench(size_t megabytes, int port)
+{
+    FILE *file = fopen(bench_blob_file, "wb");
+    if (!file)
+    {
+        std::cerr << "Failed to create " << bench_blob_file << std::endl;
+        return 1;
+    }
+    std::string chunk(65536, 'b');
+    for (size_t written = 0; written < bench_blob_size; written += chunk.size())
+        fwrite(chunk.data(), 1, chunk.size(), file);
+    fclose(file);
+
+    std::cout << "=== Blob download throughput (4MB files) ===" << std::endl;
+    bool ok = runSendFileBench("copy", port, false, false, megabytes);
+    ok = runSendFileBench("sendfile", port + 1, true, false, megabytes) && ok;
+
+    // 内存BIO模式的TLS：文件按区间排队，socket可写时才读出并加密
+    if (!writeSelfSignedCertificate(bench_cert_file, bench_key_file))
+    {
+        std::cerr << "Failed to create test certificate" << std::endl;
+        return 1;
+    }
+    ok = runSendFileBench("tls-copy", port + 2, false, true, megabytes) && ok;
+    ok = runSendFileBench("tls-sendfile", port + 3, true, true, megabytes) && ok;
+    return ok ? 0 : 1;
+}
+
+// 同一进程内每个连接占两个fd
+static bool ensureFdLimit(size_t connections)
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) < 0)
+        return false;
+    rlim_t needed = connections * 2 + 64;
+    if (limit.rlim_cur < needed && limit.rlim_max >= needed)
+    {
+        limit.rlim_cur = needed;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        getrlimit(RLIMIT_NOFILE, &limit);
+    }
+    return limit.rlim_cur >= needed;
+}
+
+static bool runFanoutBench(size_t recipients, int port, size_t rounds)
+{
+    WebSocketServer server(port, 4);
+    server.setReactorCount(4);
+    std::vector<int> client_ids;
+    std::mutex ids_mutex;
+    server.setConnectionHandler([&](int client_id, const std::string &)
+                                {
+        std::lock_guard<std::mutex> lock(ids_mutex);
+        client_ids.push_back(client_id); });
+    if (!server.start())
+        return false;
+
+    // 本地端口有限，按目的地址分散到 127.0.0.x 上
+    std::vector<std::unique_ptr<BenchClient>> clients;
+    for (size_t i = 0; i < recipients; i++)
+    {
+        std::unique_ptr<BenchClient> client(new BenchClient());
+        std::string host = "127.0.0." + std::to_string(1 + i / 20000);
+        if (!client->connect(host, port))
+        {
+            std::cerr << "Failed to connect client " << i << std::endl;
+            server.stop();
+            return false;
+        }
+        clients.push_back(std::move(client));
+    }
+    while (server.getClientCount() < recipients)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    std::vector<int> ids;
+    {
+        std::lock_guard<std::mutex> lock(ids_mutex);
+        ids = client_ids;
+    }
+
+    std::string payload(256, 'r');
+    std::string reply;
+    bool ok = true;
+    for (int pass = 0; pass < 2 && ok; pass++)
+    {
+        bool fanout = pass == 1;
+        double send_seconds = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t round = 0; round < rounds && ok; round++)
+        {
+            auto t0 = std::chrono::steady_clock::now();
+            if (fanout)
+            {
+                server.sendToClients(ids, payload);
+            }
+            else
+            {
+                for (int id : ids)
+                    server.sendMessageToClient(id, payload);
+            }
+            send_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+            for (auto &client : clients)
+            {
+                if (!client->receiveFrame(reply) || reply.size() != payload.size())
+                {
+                    ok = false;
+                    break;
+                }
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << std::left << std::setw(10) << (fanout ? "fanout" : "loop")
+                  << " recipients=" << recipients
+                  << std::fixed << std::setprecision(1)
+                  << " call_us=" << send_seconds * 1e6 / rounds
+                  << " ns/recipient=" << send_seconds * 1e9 / (rounds * recipients)
+                  << std::setprecision(0)
+                  << " deliveries/sec=" << rounds * recipients / seconds
+                  << std::endl;
+    }
+
+    clients.clear();
+    server.stop();
+    if (!ok)
+        std::cerr << "Connection lost during benchmark" << std::endl;
+    return ok;
+}
+
+static int fanoutBench(size_t rounds, int port)
+{
+    std::cout << "=== Multicast to a client list (256-byte message) ===" << std::endl;
+    const size_t sizes[] = {10, 1000, 50000};
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        if (!ensureFdLimit(sizes[i]))
+        {
+            std::cout << "recipients=" << sizes[i] << " skipped (raise the open file limit to "
+                      << sizes[i] * 2 + 64 << ")" << std::endl;
+            continue;
+        }
+        ok = runFanoutBench(sizes[i], port + static_cast<int>(i), rounds) && ok;
+    }
+    return ok ? 0 : 1;
+}
+
+// 所有客户端同时发起连接和升级请求，模拟部署后的重连风暴
+static bool runAcceptStorm(const std::string &name, int port, int backlog, int defer_seconds, size_t connections)
+{
+    // 风暴期间屏蔽服务器逐连接的日志输出（服务器线程都已停止后再恢复）
+    std::ofstream null_stream;
+    std::streambuf *saved = std::cout.rdbuf(null_stream.rdbuf());
+
+    WebSocketServer server(port, 4);
+    server.setListenBacklog(backlog);
+    server.setDeferAccept(defer_seconds);
+    if (!server.start())
+    {
+        std::cout.rdbuf(saved);
+        return false;
+    }
+
+    static const char request[] = "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\n"
+                                  "Connection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                                  "Sec-WebSocket-Version: 13\r\n\r\n";
+
+    int epoll_fd = epoll_create1(0);
+    std::vector<int> fds(connections, -1);
+    std::vector<std::string> responses(connections);
+    std::vector<double> latencies_ms;
+    latencies_ms.reserve(connections);
+    size_t failed = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < connections; i++)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        std::string host = "127.0.0." + std::to_string(1 + i / 20000);
+        inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+        if (fd < 0 || (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS))
+        {
+            if (fd >= 0)
+                ::close(fd);
+            failed++;
+            continue;
+        }
+
+        struct epoll_event ev;
+        ev.events = EPOLLOUT;
+        ev.data.u64 = i;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+        fds[i] = fd;
+    }
+
+    // 连接建立后发送升级请求，收到完整的101响应即完成
+    size_t done = 0;
+    struct epoll_event events[256];
+    auto deadline = start + std::chrono::seconds(30);
+    while (done + failed < connections && std::chrono::steady_clock::now() < deadline)
+    {
+        int n = epoll_wait(epoll_fd, events, 256, 100);
+        for (int k = 0; k < n; k++)
+        {
+            size_t i = events[k].data.u64;
+            int fd = fds[i];
+            if (events[k].events & EPOLLOUT)
+            {
+                int error = 0;
+                socklen_t length = sizeof(error);
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+                if (error != 0 || send(fd, request, sizeof(request) - 1, MSG_NOSIGNAL) != sizeof(request) - 1)
+                {
+                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+                    ::close(fd);
+                    fds[i] = -1;
+                    failed++;
+                    continue;
+                }
+                struct epoll_event ev;
+                ev.events = EPOLLIN;
+                ev.data.u64 = i;
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+                continue;
+            }
+
+            char buffer[1024];
+            ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+            if (received > 0)
+                responses[i].append(buffer, received);
+            bool complete = responses[i].find("\r\n\r\n") != std::string::npos;
+            if (received > 0 && !complete)
+                continue;
+
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+            ::close(fd);
+            fds[i] = -1;
+            if (complete && responses[i].compare(0, 12, "HTTP/1.1 101") == 0)
+            {
+                done++;
+                latencies_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            }
+            else
+            {
+                failed++;
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (int fd : fds)
+    {
+        if (fd >= 0)
+            ::close(fd);
+    }
+    ::close(epoll_fd);
+    WebSocketServer::AcceptStats stats = server.getAcceptStats();
+    server.stop();
+    std::cout.rdbuf(saved);
+
+    std::sort(latencies_ms.begin(), latencies_ms.end());
+    size_t count = latencies_ms.size();
+    std::cout << std::left << std::setw(10) << name
+              << " backlog=" << backlog
+              << " upgraded=" << done << "/" << connections
+              << std::fixed << std::setprecision(0)
+              << " accepts/sec=" << (seconds > 0 ? done / seconds : 0)
+              << std::setprecision(1)
+              << " p50=" << (count ? latencies_ms[count / 2] : 0) << "ms"
+              << " p99=" << (count ? latencies_ms[std::min(count - 1, count * 99 / 100)] : 0) << "ms"
+              << " max=" << (count ? latencies_ms[count - 1] : 0) << "ms"
+              << " listen_overflows=" << stats.listen_overflows
+              << " listen_drops=" << stats.listen_drops
+              << std::endl;
+    return done == connections;
+}
+
+static int acceptBench(size_t connections, int port)
+{
+    if (!ensureFdLimit(connections))
+    {
+        std::cerr << "Open file limit too low for " << connections << " connections" << std::endl;
+        return 1;
+    }
+
+    std::cout << "=== Reconnect storm (" << connections << " simultaneous clients) ===" << std::endl;
+    // 旧配置下出现超时是预期结果，只以调优后的配置判定成败
+    runAcceptStorm("backlog10", port, 10, 0, connections);
+    return runAcceptStorm("tuned", port + 1, 4096, 5, connections) ? 0 : 1;
+}
+
+// 先建立 idle 个不发消息的连接，再让若干活跃连接并发回显，线程池固定为4个线程
+static bool runIdleBench(size_t idle, int port, size_t messages)
+{
+    static const size_t active = 8;
+
+    std::ofstream null_stream;
+    std::streambuf *saved = std::cout.rdbuf(null_stream.rdbuf());
+
+    WebSocketServer server(port, 4);
+    server.setMessageHandler([&server](int client_id, const std::string &message)
+                             { server.sendMessageToClient(client_id, message); });
+    if (!server.start())
+    {
+        std::cout.rdbuf(saved);
+        return false;
+    }
+
+    std::vector<std::unique_ptr<BenchClient>> idle_clients;
+    bool ok = true;
+    for (size_t i = 0; i < idle && ok; i++)
+    {
+        std::unique_ptr<BenchClient> client(new BenchClient());
+        std::string host = "127.0.0." + std::to_string(1 + i / 20000);
+        ok = client->connect(host, port);
+        idle_clients.push_back(std::move(client));
+    }
+
+    std::vector<std::vector<double>> latencies(active);
+    std::atomic<bool> failed(false);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < active && ok; t++)
+    {
+        threads.emplace_back([&, t]
+                             {
+            BenchClient client;
+            if (!client.connect("127.0.0.1", port))
+            {
+                failed = true;
+                return;
+            }
+            std::string payload(64, 'a'), reply;
+            latencies[t].reserve(messages);
+            for (size_t i = 0; i < messages; i++)
+            {
+                auto t0 = std::chrono::steady_clock::now();
+                if (!client.sendText(payload) || !client.receiveFrame(reply))
+                {
+                    failed = true;
+                    return;
+                }
+                latencies[t].push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+            } });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t connected = server.getClientCount();
+
+    idle_clients.clear();
+    server.stop();
+    std::cout.rdbuf(saved);
+
+    if (!ok || failed)
+    {
+        std::cerr << "idle=" << idle << ": connection failed" << std::endl;
+        return false;
+    }
+
+    std::vector<double> all;
+    for (auto &v : latencies)
+        all.insert(all.end(), v.begin(), v.end());
+    std::cout << "idle=" << idle << " active=" << active << " connected=" << connected << std::endl;
+    printLatency("echo", all, seconds);
+    return true;
+}
+
+// 当前进程的常驻内存（字节）
+static size_t residentBytes()
+{
+    size_t pages = 0, resident = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (file)
+    {
+        if (fscanf(file, "%zu %zu", &pages, &resident) != 2)
+            resident = 0;
+        fclose(file);
+    }
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// 子进程：收到开始信号后建立 connections 个连接并完成升级，报告成功数后保持连接直到父进程关闭管道
+static void holdIdleConnections(int port, size_t first, size_t connections, int go_fd, int done_fd)
+{
+    static const char request[] = "GET / HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\n"
+                                  "Connection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                                  "Sec-WebSocket-Version: 13\r\n\r\n";
+    char byte;
+    if (read(go_fd, &byte, 1) != 1)
+        _exit(1);
+
+    std::vector<int> fds;
+    fds.reserve(connections);
+    uint32_t upgraded = 0;
+    for (size_t i = first; i < first + connections; i++)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        std::string host = "127.0.0." + std::to_string(1 + i / 20000);
+        inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+        if (fd < 0 || ::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+            send(fd, request, sizeof(request) - 1, MSG_NOSIGNAL) != sizeof(request) - 1)
+        {
+            if (fd >= 0)
+                ::close(fd);
+            break;
+        }
+        fds.push_back(fd);
+    }
+    for (int fd : fds)
+    {
+        char buffer[256];
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n >= 12 && memcmp(buffer, "HTTP/1.1 101", 12) == 0)
+            upgraded++;
+    }
+    if (write(done_fd, &upgraded, sizeof(upgraded)) != sizeof(upgraded))
+        _exit(1);
+    while (read(go_fd, &byte, 1) > 0)
+    {
+    }
+    _exit(0);
+}
+
+static int memoryBench(size_t connections, int port)
+{
+    // 每个子进程最多持有这么多连接，服务器进程每个连接只占一个fd
+    static const size_t per_child = 15000;
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    rlim_t needed = connections + 64;
+    if (limit.rlim_cur < needed && limit.rlim_max >= needed)
+    {
+        limit.rlim_cur = needed;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    if (limit.rlim_cur < needed)
+    {
+        std::cerr << "Open file limit too low for " << connections << " connections (max "
+                  << limit.rlim_cur - 64 << ")" << std::endl;
+        return 1;
+    }
+
+    // 服务器线程启动前先创建子进程
+    int go_pipe[2], done_pipe[2];
+    if (pipe(go_pipe) < 0 || pipe(done_pipe) < 0)
+        return 1;
+    std::vector<pid_t> children;
+    for (size_t first = 0; first < connections; first += per_child)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            ::close(go_pipe[1]);
+            ::close(done_pipe[0]);
+            holdIdleConnections(port, first, std::min(per_child, connections - first), go_pipe[0], done_pipe[1]);
+        }
+        if (pid > 0)
+            children.push_back(pid);
+    }
+    ::close(go_pipe[0]);
+    ::close(done_pipe[1]);
+
+    std::ofstream null_stream;
+    std::streambuf *saved = std::cout.rdbuf(null_stream.rdbuf());
+
+    WebSocketServer server(port, 4);
+    server.setListenBacklog(4096);
+    bool ok = server.start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    size_t before = residentBytes();
+
+    uint32_t upgraded = 0;
+    for (size_t i = 0; ok && i < children.size(); i++)
+    {
+        char go[1] = {1};
+        ok = write(go_pipe[1], go, 1) == 1;
+    }
+    for (size_t i = 0; ok && i < children.size(); i++)
+    {
+        uint32_t count = 0;
+        ok = read(done_pipe[0], &count, sizeof(count)) == sizeof(count);
+        upgraded += count;
+    }
+    while (ok && server.getClientCount() < upgraded)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    size_t after = residentBytes();
+    size_t connected = server.getClientCount();
+
+    ::close(go_pipe[1]);
+    ::close(done_pipe[0]);
+    for (pid_t pid : children)
+        waitpid(pid, nullptr, 0);
+    server.stop();
+    std::cout.rdbuf(saved);
+
+    std::cout << "=== Server RSS per idle connection ===" << std::endl;
+    if (!ok || connected == 0)
+    {
+        std::cerr << "Failed to establish connections" << std::endl;
+        return 1;
+    }
+    std::cout << "connections=" << connected
+              << " rss_before=" << before / 1024 << "KB"
+              << " rss_after=" << after / 1024 << "KB"
+              << " bytes/conn=" << (after > before ? (after - before) / connected : 0)
+              << std::endl;
+    return connected == connections ? 0 : 1;
+}
+
+// 本进程（客户端与服务器合计）消耗的CPU时间（秒）
+static double processCpuSeconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// 同一台机器上的回显往返：loopback TCP 与 Unix域socket 对比，内联处理以突出传输本身的开销
+static bool runTransportBench(const std::string &name, bool unix_socket, int port, size_t messages)
+{
+    static const char socket_path[] = "/tmp/websocket_bench.sock";
+
+    WebSocketServer server(port, 4);
+    server.setDispatchMode(WebSocketServer::DispatchMode::Inline);
+    server.addListenAddress("127.0.0.1");
+    server.addListenAddress(std::string("unix:") + socket_path);
+    server.setMessageHandler([&server](int client_id, const std::string &message)
+                             { server.sendMessageToClient(client_id, message); });
+    if (!server.start())
+        return false;
+
+    BenchClient client;
+    if (!(unix_socket ? client.connectUnix(socket_path) : client.connect("127.0.0.1", port)))
+    {
+        std::cerr << "Failed to connect to benchmark server" << std::endl;
+        server.stop();
+        return false;
+    }
+
+    std::string payload(64, 'x');
+    std::string reply;
+    for (size_t i = 0; i < 1000; i++)
+    {
+        client.sendText(payload);
+        client.receiveFrame(reply);
+    }
+
+    std::vector<double> latencies;
+    latencies.reserve(messages);
+    double cpu_start = processCpuSeconds();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < messages; i++)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        if (!client.sendText(payload) || !client.receiveFrame(reply))
+        {
+            std::cerr << "Connection lost during benchmark" << std::endl;
+            break;
+        }
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double cpu_seconds = processCpuSeconds() - cpu_start;
+
+    client.close();
+    server.stop();
+
+    if (latencies.empty())
+        return false;
+    printLatency(name, latencies, seconds);
+    std::cout << std::left << std::setw(10) << name
+              << std::fixed << std::setprecision(2)
+              << " cpu_us/msg=" << cpu_seconds * 1e6 / latencies.size()
+              << std::endl;
+    return true;
+}
+
+static int transportBench(size_t messages, int port)
+{
+    std::cout << "=== Echo round-trip latency, loopback TCP vs Unix domain socket (inline dispatch) ===" << std::endl;
+    bool ok = runTransportBench("tcp", false, port, messages);
+    ok = runTransportBench("unix", true, port + 1, messages) && ok;
+    return ok ? 0 : 1;
+}
+
+static const char *bench_bus_directory = "/tmp/websocket_bench_bus";
+
+// 广播总线上的一个订阅进程：自己的服务器加一个本地客户端，收齐（或超时）后报告收到的数量和最后到达时间
+static void runBusSubscriber(int port, size_t messages, int ready_fd, int done_fd)
+{
+    std::ofstream null_stream;
+    std::cout.rdbuf(null_stream.rdbuf());
+
+    WebSocketServer server(port, 2);
+    server.setBroadcastBus(bench_bus_directory);
+    BenchClient client;
+    if (!server.start() || !client.connect("127.0.0.1", port))
+        _exit(1);
+    while (server.getClientCount() < 1)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    char ready = 1;
+    if (write(ready_fd, &ready, 1) != 1)
+        _exit(1);
+
+    client.setReceiveTimeout(2000);
+    uint64_t result[2] = {0, 0}; // 收到的消息数，最后一条到达的时间（steady_clock，纳秒）
+    std::string payload;
+    while (result[0] < messages && client.receiveFrame(payload))
+    {
+        result[0]++;
+        result[1] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch())
+                        .count();
+    }
+    if (write(done_fd, result, sizeof(result)) != sizeof(result))
+        _exit(1);
+    client.close();
+    server.stop();
+    _exit(0);
+}
+
+static int busBench(size_t processes, size_t messages, int port)
+{
+    // 服务器线程启动前先创建订阅进程
+    int ready_pipe[2], done_pipe[2];
+    if (pipe(ready_pipe) < 0 || pipe(done_pipe) < 0)
+        return 1;
+    std::vector<pid_t> children;
+    for (size_t i = 0; i < processes; i++)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            ::close(ready_pipe[0]);
+            ::close(done_pipe[0]);
+            runBusSubscriber(port + 1 + static_cast<int>(i), messages, ready_pipe[1], done_pipe[1]);
+        }
+        if (pid > 0)
+            children.push_back(pid);
+    }
+    ::close(ready_pipe[1]);
+    ::close(done_pipe[1]);
+
+    std::ofstream null_stream;
+    std::streambuf *saved = std::cout.rdbuf(null_stream.rdbuf());
+
+    WebSocketServer server(port, 2);
+    server.setBroadcastBus(bench_bus_directory);
+    bool ok = server.start();
+    for (size_t i = 0; ok && i < children.size(); i++)
+    {
+        char ready;
+        ok = read(ready_pipe[0], &ready, 1) == 1;
+    }
+    while (ok && server.getBusStats().peers < children.size())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    std::string payload(64, 'x');
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; ok && i < messages; i++)
+        server.broadcastMessage(payload);
+    double publish_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t received = 0;
+    uint64_t last_arrival = 0;
+    for (size_t i = 0; ok && i < children.size(); i++)
+    {
+        uint64_t result[2];
+        ok = read(done_pipe[0], result, sizeof(result)) == sizeof(result);
+        received += result[0];
+        last_arrival = std::max(last_arrival, result[1]);
+    }
+    WebSocketServer::BusStats stats = server.getBusStats();
+
+    ::close(ready_pipe[0]);
+    ::close(done_pipe[0]);
+    for (pid_t pid : children)
+        waitpid(pid, nullptr, 0);
+    server.stop();
+    std::cout.rdbuf(saved);
+
+    std::cout << "=== Cross-process broadcast over the local bus ===" << std::endl;
+    if (!ok)
+    {
+        std::cerr << "Broadcast bus benchmark failed" << std::endl;
+        return 1;
+    }
+    uint64_t start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count();
+    double total_seconds = last_arrival > start_ns ? (last_arrival - start_ns) / 1e9 : publish_seconds;
+    std::cout << std::fixed << std::setprecision(0)
+              << "processes=" << processes << " messages=" << messages
+              << " publish/sec=" << messages / publish_seconds
+              << " delivered=" << received << "/" << processes * messages
+              << " end-to-end msgs/sec=" << messages / total_seconds
+              << " dropped=" << stats.dropped
+              << std::endl;
+    return received == processes * messages ? 0 : 1;
+}
+
+static const char *bench_ingest_socket = "/tmp/websocket_bench_ingest.sock";
+
+// 注入环的生产者进程：收到开始信号后连接服务器，向 topic 写入 messages 条64字节的记录（环满时重试），
+// 报告写入耗时（秒）和因环满重试的次数
+static void runIngestProducer(const std::string &topic, size_t messages, int go_fd, int done_fd)
+{
+    char go;
+    if (read(go_fd, &go, 1) != 1)
+        _exit(1);
+
+    IngestProducer producer;
+    if (!producer.connect(bench_ingest_socket))
+        _exit(1);
+
+    std::string payload(64, 'x');
+    double result[2] = {0, 0};
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < messages; i++)
+    {
+        while (!producer.sendToTopic(topic, payload.data(), payload.size()))
+            result[1]++;
+    }
+    result[0] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (write(done_fd, result, sizeof(result)) != sizeof(result))
+        _exit(1);
+    _exit(0);
+}
+
+// subscribe 为 true 时有一个客户端订阅 topic 并收齐全部消息，否则只测环本身（记录被epoll线程读出后丢弃）
+static bool runIngestBench(const std::string &name, bool subscribe, size_t messages, int port)
+{
+    int go_pipe[2], done_pipe[2];
+    if (pipe(go_pipe) < 0 || pipe(done_pipe) < 0)
+        return false;
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        ::close(go_pipe[1]);
+        ::close(done_pipe[0]);
+        runIngestProducer("/feed", messages, go_pipe[0], done_pipe[1]);
+    }
+    ::close(go_pipe[0]);
+    ::close(done_pipe[1]);
+
+    std::ofstream null_stream;
+    std::streambuf *saved = std::cout.rdbuf(null_stream.rdbuf());
+
+    WebSocketServer server(port, 2);
+    server.setReactorCount(2);
+    server.setIngestSocket(bench_ingest_socket);
+    bool ok = server.start();
+
+    BenchClient client;
+    if (ok && subscribe)
+    {
+        ok = client.connect("127.0.0.1", port, "/feed");
+        while (ok && server.getClientCount() < 1)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        client.setReceiveTimeout(2000);
+    }
+
+    char go = 1;
+    ok = ok && write(go_pipe[1], &go, 1) == 1;
+    auto start = std::chrono::steady_clock::now();
+
+    size_t received = 0;
+    std::string payload;
+    if (ok && subscribe)
+    {
+        while (received < messages && client.receiveFrame(payload))
+            received++;
+    }
+    else
+    {
+        while (ok && (server.getIngestStats().published < messages || server.getIngestStats().backlog_bytes > 0))
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        received = ok ? messages : 0;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double result[2] = {0, 0};
+    ok = ok && read(done_pipe[0], result, sizeof(result)) == sizeof(result);
+    ::close(go_pipe[1]);
+    ::close(done_pipe[0]);
+    waitpid(pid, nullptr, 0);
+    client.close();
+    server.stop();
+    std::cout.rdbuf(saved);
+
+    if (!ok || received != messages)
+    {
+        std::cerr << name << ": received " << received << "/" << messages << std::endl;
+        return false;
+    }
+    std::cout << std::left << std::setw(10) << name
+              << std::fixed << std::setprecision(0)
+              << " messages=" << messages
+              << " producer msgs/sec=" << messages / result[0]
+              << " delivered msgs/sec=" << messages / seconds
+              << " ring-full retries=" << result[1]
+              << std::endl;
+    return true;
+}
+
+static int ingestBench(size_t messages, int port)
+{
+    std::cout << "=== Shared-memory ingest from an external producer process (2 reactors) ===" << std::endl;
+    bool ok = runIngestBench("ring", false, messages, port);
+    ok = runIngestBench("client", true, messages, port + 1) && ok;
+    return ok ? 0 : 1;
+}
+
+// 重放中的一个连接；对象保留到重放结束，断开时只 shutdown 不 close，避免fd被新连接复用
+struct ReplayConnection
+{
+    BenchClient client;
+    std::mutex mutex;
+    std::deque<std::chrono::steady_clock::time_point> sent; // 等待回应的消息的发送时间
+};
+
+// 按录制文件的时间戳重放客户端行为（连接、发送、断开）：speed 为 1 按原始节奏，N 为加速N倍，0 为不等待。
+// 延迟为发出一条消息到该连接收到下一帧的时间，只统计录制时服务器回应过的消息
+static int replayBench(const std::string &file, double speed, int port)
+{
+    TrafficCaptureReader reader;
+    if (!reader.open(file))
+        return 1;
+
+    std::vector<TrafficCaptureReader::Record> records;
+    TrafficCaptureReader::Record record;
+    while (reader.next(record))
+        records.push_back(record);
+    // 各线程写入的记录按预留顺序排列，时间戳可能略有交错
+    std::stable_sort(records.begin(), records.end(),
+                     [](const TrafficCaptureReader::Record &a, const TrafficCaptureReader::Record &b)
+                     { return a.timestamp_ns < b.timestamp_ns; });
+
+    // 录制时在下一条入站消息之前收到过回应的入站消息才计入延迟
+    std::vector<bool> answered(records.size(), false);
+    std::map<int, size_t> last_inbound;
+    size_t connections = 0;
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const TrafficCaptureReader::Record &r = records[i];
+        if (r.event == CaptureEvent::Connect)
+        {
+            connections++;
+        }
+        else if (r.event == CaptureEvent::Inbound)
+        {
+            last_inbound[r.client_id] = i;
+        }
+        else if (r.event == CaptureEvent::Outbound && r.client_id >= 0)
+        {
+            auto it = last_inbound.find(r.client_id);
+            if (it != last_inbound.end())
+            {
+                answered[it->second] = true;
+                last_inbound.erase(it);
+            }
+        }
+    }
+    if (!ensureFdLimit(connections))
+    {
+        std::cerr << "Open file limit too low for " << connections << " connections" << std::endl;
+        return 1;
+    }
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+        return 1;
+
+    std::atomic<bool> running(true);
+    std::atomic<size_t> received(0);
+    std::atomic<size_t> matched(0);
+    std::vector<double> latencies;
+    std::thread receiver([&]()
+                         {
+        struct epoll_event events[256];
+        std::string payload;
+        while (running)
+        {
+            int n = epoll_wait(epfd, events, 256, 10);
+            for (int i = 0; i < n; i++)
+            {
+                ReplayConnection *connection = static_cast<ReplayConnection *>(events[i].data.ptr);
+                bool closed = false;
+                while (connection->client.pollFrame(payload, closed))
+                {
+                    auto now = std::chrono::steady_clock::now();
+                    received++;
+                    std::lock_guard<std::mutex> lock(connection->mutex);
+                    if (!connection->sent.empty())
+                    {
+                        latencies.push_back(std::chrono::duration<double, std::micro>(now - connection->sent.front()).count());
+                        connection->sent.pop_front();
+                        matched++;
+                    }
+                }
+                if (closed)
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, connection->client.getFd(), nullptr);
+            }
+        } });
+
+    std::deque<ReplayConnection> clients; // deque 追加时不移动已有元素
+    std::map<int, ReplayConnection *> open_clients; // 录制中的客户端ID -> 当前连接
+    size_t sent = 0, failed_connects = 0, expected = 0;
+    // 从第一条记录开始计时，跳过录制开始后的空闲时间
+    uint64_t first_ns = records.empty() ? 0 : records.front().timestamp_ns;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const TrafficCaptureReader::Record &r = records[i];
+        if (r.event == CaptureEvent::Outbound)
+            continue;
+        if (speed > 0)
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds(static_cast<uint64_t>((r.timestamp_ns - first_ns) / speed)));
+
+        if (r.event == CaptureEvent::Connect)
+        {
+            clients.emplace_back();
+            ReplayConnection *connection = &clients.back();
+            if (!connection->client.connect("127.0.0.1", port, r.payload.empty() ? "/" : r.payload))
+            {
+                failed_connects++;
+                continue;
+            }
+            struct epoll_event event;
+            event.events = EPOLLIN;
+            event.data.ptr = connection;
+            epoll_ctl(epfd, EPOLL_CTL_ADD, connection->client.getFd(), &event);
+            open_clients[r.client_id] = connection;
+            continue;
+        }
+
+        auto it = open_clients.find(r.client_id);
+        if (it == open_clients.end())
+            continue;
+        ReplayConnection *connection = it->second;
+        if (r.event == CaptureEvent::Disconnect)
+        {
+            // 只关闭写方向，已在途的回应仍可读到
+            shutdown(connection->client.getFd(), SHUT_WR);
+            open_clients.erase(it);
+            continue;
+        }
+
+        // 入站消息：先登记发送时间，回应可能在 sendText 返回前到达
+        if (answered[i])
+        {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            connection->sent.push_back(std::chrono::steady_clock::now());
+            expected++;
+        }
+        bool ok = r.opcode == 0x2 ? connection->client.sendBinary(r.payload) : connection->client.sendText(r.payload);
+        if (ok)
+            sent++;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // 等待在途的回应：全部收到，或2秒内没有新帧到达即结束
+    size_t last = received.load();
+    for (int idle = 0; idle < 200 && matched < expected; idle++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        size_t now = received.load();
+        if (now != last)
+        {
+            last = now;
+            idle = 0;
+        }
+    }
+    running = false;
+    receiver.join();
+    ::close(epfd);
+    for (ReplayConnection &connection : clients)
+        connection.client.close();
+
+    std::cout << "=== Replay of " << file << " (" << connections << " connections, ";
+    if (speed > 0)
+        std::cout << speed << "x speed) ===" << std::endl;
+    else
+        std::cout << "max speed) ===" << std::endl;
+    std::cout << std::left << std::setw(10) << "replay"
+              << std::fixed << std::setprecision(0)
+              << " sent=" << sent
+              << " received=" << received.load()
+              << " failed-connects=" << failed_connects
+              << " seconds=" << std::setprecision(2) << seconds
+              << std::setprecision(0)
+              << " sent msgs/sec=" << sent / seconds
+              << std::endl;
+    if (latencies.empty())
+    {
+        std::cerr << "replay: no answered messages (expected " << expected << ")" << std::endl;
+        return expected == 0 ? 0 : 1;
+    }
+    printLatency("replay", latencies, seconds);
+    return 0;
+}
+
+// 每个客户端连接时下发的全量状态，以及断线期间错过的更新
+static const size_t resume_state_messages = 500;
+static const size_t resume_missed_messages = 20;
+
+// 所有客户端同时断线（不发 close 帧），期间服务器广播若干更新，之后全部重连，统计到每个客户端
+// 追上最新状态为止的时间和收到的字节数。不开启会话恢复时应用只能在连接回调中重新下发全量状态
+static bool runResumeBench(const std::string &name, bool resume, size_t clients, int port)
+{
+    std::ofstream null_stream;
+    std::streambuf *saved = std::cout.rdbuf(null_stream.rdbuf());
+
+    const std::string update(256, 'u');
+    WebSocketServer server(port, 4);
+    server.setReactorCount(2);
+    if (resume)
+        server.setSessionResumption(30);
+    server.setConnectionHandler([&server, &update](int client_id, const std::string &)
+                                {
+        for (size_t i = 0; i < resume_state_messages; i++)
+            server.sendMessageToClient(client_id, update); });
+    bool ok = server.start();
+
+    std::vector<BenchClient> connections(clients);
+    std::vector<uint64_t> received(clients, 0);
+    std::string payload;
+    for (size_t i = 0; ok && i < clients; i++)
+    {
+        ok = connections[i].connect("127.0.0.1", port, "/state");
+        connections[i].setReceiveTimeout(5000);
+        while (ok && received[i] < resume_state_messages)
+        {
+            ok = connections[i].receiveFrame(payload);
+            received[i]++;
+        }
+    }
+
+    // 断线，等服务器发现后广播错过的更新
+    for (auto &connection : connections)
+        connection.close();
+    while (ok && (server.getClientCount() > 0 || (resume && server.getSessionStats().detached < clients)))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    for (size_t i = 0; ok && i < resume_missed_messages; i++)
+        server.broadcastMessage(update);
+
+    auto start = std::chrono::steady_clock::now();
+    size_t expected = resume ? resume_missed_messages : resume_state_messages;
+    size_t bytes = 0;
+    for (size_t i = 0; ok && i < clients; i++)
+    {
+        std::string path = "/state";
+        if (resume)
+            path += "?session=" + connections[i].getSessionToken() + "&last_seq=" + std::to_string(received[i]);
+        ok = connections[i].connect("127.0.0.1", port, path);
+        connections[i].setReceiveTimeout(5000);
+    }
+    for (size_t i = 0; ok && i < clients; i++)
+    {
+        for (size_t n = 0; ok && n < expected; n++)
+        {
+            ok = connections[i].receiveFrame(payload);
+            bytes += payload.size();
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    WebSocketServer::SessionStats stats = server.getSessionStats();
+
+    for (auto &connection : connections)
+        connection.close();
+    server.stop();
+    std::cout.rdbuf(saved);
+
+    if (!ok)
+    {
+        std::cerr << name << ": reconnect failed" << std::endl;
+        return false;
+    }
+    std::cout << std::left << std::setw(10) << name
+              << std::fixed << std::setprecision(1)
+              << " clients=" << clients
+              << " catch-up ms=" << seconds * 1000
+              << " KB/client=" << bytes / 1024.0 / clients
+              << " resumed=" << stats.resumed
+              << std::endl;
+    return true;
+}
+
+static int resumeBench(size_t clients, int port)
+{
+    std::cout << "=== Reconnect after a network blip: " << resume_state_messages << " state messages, "
+              << resume_missed_messages << " missed updates per client ===" << std::endl;
+    bool ok = runResumeBench("resend", false, clients, port);
+    ok = runResumeBench("resume", true, clients, port + 1) && ok;
+    return ok ? 0 : 1;
+}
+
+// 客户端逐个断开（不发 close 帧），统计从关闭socket到服务器触发断开回调的时间。
+// busy 时另有一个客户端不停收发回显消息，epoll线程一直有事件要处理
+static bool runDisconnectBench(const std::string &name, bool busy, size_t clients, int port)
+{
+    std::atomic<size_t> disconnected(0);
+    WebSocketServer server(port, 4);
+    server.setMessageHandler([&server](int client_id, const std::string &message)
+                             { server.sendMessageToClient(client_id, message); });
+    server.setDisconnectionHandler([&disconnected](int)
+                                   { disconnected.fetch_add(1); });
+    if (!server.start())
+        return false;
+
+    std::atomic<bool> stopping(false);
+    std::atomic<bool> failed(false);
+    std::thread traffic;
+    if (busy)
+    {
+        traffic = std::thread([&]
+                              {
+            BenchClient client;
+            if (!client.connect("127.0.0.1", port))
+            {
+                failed = true;
+                return;
+            }
+            std::string payload(64, 'a'), reply;
+            while (!stopping)
+            {
+                if (!client.sendText(payload) || !client.receiveFrame(reply))
+                {
+                    failed = true;
+                    return;
+                }
+            } });
+    }
+
+    static const std::chrono::seconds timeout(3);
+    std::vector<double> latencies_us;
+    size_t timeouts = 0;
+    for (size_t i = 0; i < clients && !failed; i++)
+    {
+        BenchClient client;
+        if (!client.connect("127.0.0.1", port))
+        {
+            failed = true;
+            break;
+        }
+        size_t before = disconnected.load();
+        auto start = std::chrono::steady_clock::now();
+        client.close();
+        while (disconnected.load() == before && std::chrono::steady_clock::now() - start < timeout)
+            std::this_thread::yield();
+        if (disconnected.load() == before)
+        {
+            // 超时的连接之后再被清理时会计到下一个客户端上，这一轮到此为止
+            timeouts++;
+            break;
+        }
+        latencies_us.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    stopping = true;
+    if (traffic.joinable())
+        traffic.join();
+    server.stop();
+
+    if (failed)
+    {
+        std::cerr << name << ": connection failed" << std::endl;
+        return false;
+    }
+    std::cout << std::left << std::setw(10) << name << " clients=" << latencies_us.size();
+    if (!latencies_us.empty())
+    {
+        std::sort(latencies_us.begin(), latencies_us.end());
+        size_t n = latencies_us.size();
+        std::cout << std::fixed << std::setprecision(1)
+                  << " p50=" << latencies_us[n / 2] << "us"
+                  << " p99=" << latencies_us[std::min(n - 1, n * 99 / 100)] << "us"
+                  << " max=" << latencies_us.back() << "us";
+    }
+    std::cout << " timeouts=" << timeouts << std::endl;
+    return true;
+}
+
+static int disconnectBench(size_t clients, int port)
+{
+    std::cout << "=== Client close to disconnection handler ===" << std::endl;
+    bool ok = runDisconnectBench("idle", false, clients, port);
+    ok = runDisconnectBench("busy", true, clients, port + 1) && ok;
+    return ok ? 0 : 1;
+}
+
+// 每条突发消息的大小；消息开头8字节为发送序号
+static const size_t burst_message_size = 64 * 1024;
+
+// 4个客户端同时把 megabytes MB 的消息一次性写进socket，服务器只做校验：每个客户端的消息应按序号
+// 到达、同一连接的处理回调不应并发执行；2秒内没有新消息到达视为读取停滞
+static bool runBurstBench(const std::string &name, WebSocketServer::DispatchMode mode, size_t megabytes, int port)
+{
+    static const size_t clients = 4;
+    size_t messages = megabytes * 1024 * 1024 / burst_message_size;
+
+    struct ClientState
+    {
+        uint64_t next_seq = 0;
+        std::atomic<int> in_handler{0};
+    };
+    std::mutex state_mutex;
+    std::map<int, std::unique_ptr<ClientState>> states;
+    std::atomic<size_t> received(0), out_of_order(0), concurrent(0);
+
+    WebSocketServer server(port, 4);
+    server.setDispatchMode(mode);
+    server.setConnectionHandler([&](int client_id, const std::string &)
+                                {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        states[client_id].reset(new ClientState()); });
+    server.setMessageHandler([&](int client_id, const std::string &message)
+                             {
+        ClientState *state;
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            state = states[client_id].get();
+        }
+        if (!state || message.size() < sizeof(uint64_t))
+            return;
+        if (state->in_handler.fetch_add(1) > 0)
+            concurrent++;
+        uint64_t seq;
+        memcpy(&seq, message.data(), sizeof(seq));
+        if (seq != state->next_seq)
+            out_of_order++;
+        state->next_seq = seq + 1;
+        state->in_handler.fetch_sub(1);
+        received++; });
+    if (!server.start())
+        return false;
+
+    std::atomic<bool> failed(false);
+    std::vector<std::thread> senders;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t c = 0; c < clients; c++)
+    {
+        senders.emplace_back([&]
+                             {
+            BenchClient client;
+            if (!client.connect("127.0.0.1", port))
+            {
+                failed = true;
+                return;
+            }
+            std::string payload(burst_message_size, 'b');
+            for (uint64_t seq = 0; seq < messages; seq++)
+            {
+                memcpy(&payload[0], &seq, sizeof(seq));
+                if (!client.sendBinary(payload))
+                {
+                    failed = true;
+                    return;
+                }
+            }
+            // 等服务器读完再关闭，避免未读数据让连接被重置
+            while (!failed && received.load() < clients * messages)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            client.close(); });
+    }
+
+    size_t last = 0;
+    auto last_progress = std::chrono::steady_clock::now();
+    bool stalled = false;
+    while (!failed && received.load() < clients * messages)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        size_t now_received = received.load();
+        if (now_received != last)
+        {
+            last = now_received;
+            last_progress = std::chrono::steady_clock::now();
+        }
+        else if (std::chrono::steady_clock::now() - last_progress > std::chrono::seconds(2))
+        {
+            stalled = true;
+            failed = true;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (auto &sender : senders)
+        sender.join();
+    server.stop();
+
+    if (failed && !stalled)
+    {
+        std::cerr << name << ": connection failed" << std::endl;
+        return false;
+    }
+    std::cout << std::left << std::setw(10) << name
+              << " clients=" << clients
+              << " MB/client=" << megabytes
+              << std::fixed << std::setprecision(1)
+              << " MB/sec=" << (stalled ? 0.0 : clients * megabytes / seconds)
+              << " received=" << received.load() << "/" << clients * messages
+              << " out-of-order=" << out_of_order.load()
+              << " concurrent=" << concurrent.load()
+              << (stalled ? " STALLED" : "")
+              << std::endl;
+    return !stalled && out_of_order == 0 && concurrent == 0;
+}
+
+static int burstBench(size_t megabytes, int port)
+{
+    std::cout << "=== Multi-megabyte bursts from 4 clients (" << burst_message_size / 1024 << "KB messages) ===" << std::endl;
+    bool ok = runBurstBench("pool", WebSocketServer::DispatchMode::Pool, megabytes, port);
+    ok = runBurstBench("inline", WebSocketServer::DispatchMode::Inline, megabytes, port + 1) && ok;
+    return ok ? 0 : 1;
+}
+
+// 协议错误处理：每种情况用一条新连接发出帧，检查服务器以哪个状态码关闭（0 表示连接应保持正常，
+// 发完后追加的 "done" 能收到回显）
+static const size_t frames_max_message_size = 1024 * 1024;
+
+struct FrameCase
+{
+    const char *name;
+    uint16_t expected;
+    void (*send)(BenchClient &client);
+};
+
+static const FrameCase frame_cases[] = {
+    // 只发帧头：服务器应在负载到达前就按声明的长度拒绝
+    {"oversized-header", 1009, [](BenchClient &client)
+     { client.sendFrameHeader(0x2, 1ULL << 30); }},
+    // 每个分片都不超限，但累计超出上限
+    {"oversized-fragments", 1009, [](BenchClient &client)
+     {
+         std::string fragment(frames_max_message_size / 2 + 1, 'f');
+         client.sendFrame(0x2, fragment, false);
+         client.sendFrame(0x0, fragment, true);
+     }},
+    {"fragments-in-limit", 0, [](BenchClient &client)
+     {
+         std::string fragment(frames_max_message_size / 4, 'f');
+         client.sendFrame(0x2, fragment, false);
+         client.sendFrame(0x9, "ping", true); // 控制帧可以插在分片之间
+         client.sendFrame(0x0, fragment, false);
+         client.sendFrame(0x0, fragment, true);
+     }},
+    // 多字节序列跨越分片边界："中"（E4 B8 AD）拆成三片，4字节的 U+1F600 拆成两片
+    {"utf8-split-valid", 0, [](BenchClient &client)
+     {
+         client.sendFrame(0x1, "a\xE4", false);
+         client.sendFrame(0x0, "\xB8", false);
+         client.sendFrame(0x0, "\xAD\xF0\x9F", false);
+         client.sendFrame(0x0, "\x98\x80", true);
+     }},
+    // 中间的分片本身非法，不等消息结束就关闭
+    {"utf8-invalid-fragment", 1007, [](BenchClient &client)
+     {
+         client.sendFrame(0x1, "abc", false);
+         client.sendFrame(0x0, "d\xFF", false);
+     }},
+    // 上一个分片末尾的序列被下一个分片的非延续字节打断
+    {"utf8-broken-across", 1007, [](BenchClient &client)
+     {
+         client.sendFrame(0x1, "ab\xE4", false);
+         client.sendFrame(0x0, "A", false);
+     }},
+    // 分片末尾的前缀已经不可能合法（ED A0 属于UTF-16代理区）
+    {"utf8-bad-prefix", 1007, [](BenchClient &client)
+     { client.sendFrame(0x1, "ab\xED\xA0", false); }},
+    // 最后一个分片停在序列中间
+    {"utf8-truncated-final", 1007, [](BenchClient &client)
+     {
+         client.sendFrame(0x1, "ab", false);
+         client.sendFrame(0x0, "\xE4\xB8", true);
+     }},
+    {"orphan-continuation", 1002, [](BenchClient &client)
+     { client.sendFrame(0x0, "x", true); }},
+    {"interleaved-message", 1002, [](BenchClient &client)
+     {
+         client.sendFrame(0x1, "a", false);
+         client.sendFrame(0x1, "b", true);
+     }},
+};
+
+static bool runFrameCase(const FrameCase &frame_case, int port)
+{
+    BenchClient client;
+    if (!client.connect("127.0.0.1", port))
+    {
+        std::cerr << frame_case.name << ": connection failed" << std::endl;
+        return false;
+    }
+    client.setReceiveTimeout(2000);
+
+    // 服务器可能在发送途中就关闭连接，发送失败不算错误，以收到的结果为准
+    auto start = std::chrono::steady_clock::now();
+    frame_case.send(client);
+    uint16_t status = 0;
+    bool closed;
+    if (frame_case.expected == 0)
+    {
+        client.sendText("done");
+        std::string reply;
+        while (client.receiveFrame(reply) && client.lastOpcode() != 0x8 && reply != "done")
+            ;
+        closed = reply != "done";
+    }
+    else
+    {
+        closed = client.receiveClose(status);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    bool ok = frame_case.expected == 0 ? !closed : closed && status == frame_case.expected;
+    std::cout << std::left << std::setw(22) << frame_case.name << " expected=" << frame_case.expected << " got=";
+    if (frame_case.expected == 0)
+        std::cout << (closed ? "closed" : "open");
+    else if (closed)
+        std::cout << status;
+    else
+        std::cout << "no-close";
+    std::cout << std::fixed << std::setprecision(1) << " time=" << ms << "ms " << (ok ? "ok" : "FAIL") << std::endl;
+    return ok;
+}
+
+static int framesBench(int port)
+{
+    WebSocketServer server(port, 4);
+    server.setMaxMessageSize(frames_max_message_size);
+    server.setMessageHandler([&server](int client_id, const std::string &message)
+                             { server.sendMessageToClient(client_id, message); });
+    if (!server.start())
+        return 1;
+
+    std::cout << "=== Protocol error handling (max message size " << frames_max_message_size / 1024 << "KB) ===" << std::endl;
+    bool ok = true;
+    for (const FrameCase &frame_case : frame_cases)
+        ok = runFrameCase(frame_case, port) && ok;
+    server.stop();
+    return ok ? 0 : 1;
+}
+
+static const char *bench_handoff_socket = "/tmp/websocket_bench_handoff.sock";
+static const size_t handoff_max_clients = 256;
+
+// 新旧服务器进程共享的推送状态：编号和发送在进程间共享的锁内完成，交接前后两个进程的推送接续编号，
+// 只有发送返回成功时编号才前进，因此客户端收到的编号有缺口就说明有被接受的消息丢失了
+struct HandoffShared
+{
+    pthread_mutex_t lock;
+    std::atomic<bool> stop;
+    uint64_t refused;                              // 发送返回失败（交接期间被拒绝）的次数
+    uint64_t next_push[handoff_max_clients + 1];   // 按客户端ID
+};
+
+// 服务器进程：回显客户端消息，同时持续向每个客户端推送编号消息；go_fd >= 0 时等待信号后再启动（接管旧进程）
+static void runHandoffServer(int port, HandoffShared *shared, int go_fd, int ready_fd)
+{
+    std::ofstream null_stream;
+    std::cout.rdbuf(null_stream.rdbuf());
+    char signal_byte = 1;
+    if (go_fd >= 0 && read(go_fd, &signal_byte, 1) != 1)
+        _exit(1);
+
+    WebSocketServer server(port, 2);
+    std::atomic<bool> upgraded(false);
+    std::mutex ids_mutex;
+    std::vector<int> ids;
+    server.setUpgradeSocket(bench_handoff_socket);
+    server.setUpgradeHandler([&upgraded]
+                             { upgraded = true; });
+    server.setConnectionHandler([&ids_mutex, &ids](int client_id, const std::string &)
+                                {
+        std::lock_guard<std::mutex> lock(ids_mutex);
+        ids.push_back(client_id); });
+    server.setMessageHandler([&server](int client_id, const std::string &message)
+                             { server.sendMessageToClient(client_id, message); });
+    if (!server.start() || write(ready_fd, &signal_byte, 1) != 1)
+        _exit(1);
+
+    // 推送用 sendToClients（在客户端表的锁外写入），交接开始后的发送返回 0，留给新进程接着推送
+    while (!upgraded && !shared->stop)
+    {
+        std::vector<int> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(ids_mutex);
+            snapshot = ids;
+        }
+        for (int id : snapshot)
+        {
+            if (id <= 0 || id > static_cast<int>(handoff_max_clients))
+                continue;
+            pthread_mutex_lock(&shared->lock);
+            uint64_t seq = shared->next_push[id];
+            if (server.sendToClients(&id, 1, "p:" + std::to_string(seq)) == 1)
+                shared->next_push[id] = seq + 1;
+            else
+                shared->refused++;
+            pthread_mutex_unlock(&shared->lock);
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    if (!upgraded)
+        server.stop();
+    _exit(0);
+}
+
+// 读到负载为 expected 的回显为止（跳过推送），期间收到 close 帧或超时返回 false
+static bool receiveHandoffEcho(BenchClient &client, const std::string &expected)
+{
+    std::string payload;
+    while (client.receiveFrame(payload))
+    {
+        if (client.lastOpcode() == 0x8)
+            return false;
+        if (payload == expected)
+            return true;
+    }
+    return false;
+}
+
+// 每个客户端收到的推送与回显各自的编号必须连续
+struct HandoffReceiver
+{
+    uint64_t pushes = 0;
+    uint64_t next_echo = 0;
+    uint64_t gaps = 0;
+};
+
+static int handoffBench(size_t clients, int port)
+{
+    clients = std::min(clients, handoff_max_clients);
+    void *memory = mmap(nullptr, sizeof(HandoffShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return 1;
+    HandoffShared *shared = new (memory) HandoffShared();
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&shared->lock, &attr);
+    unlink(bench_handoff_socket);
+
+    // 两个服务器进程都在创建任何线程之前fork；新进程等到负载稳定后才启动
+    int ready_pipe[2], go_pipe[2];
+    if (pipe(ready_pipe) < 0 || pipe(go_pipe) < 0)
+        return 1;
+    pid_t old_pid = fork();
+    if (old_pid == 0)
+        runHandoffServer(port, shared, -1, ready_pipe[1]);
+    pid_t new_pid = fork();
+    if (new_pid == 0)
+        runHandoffServer(port, shared, go_pipe[0], ready_pipe[1]);
+    char signal_byte = 1;
+    bool ok = old_pid > 0 && new_pid > 0 && read(ready_pipe[0], &signal_byte, 1) == 1;
+
+    std::vector<std::unique_ptr<BenchClient>> connections;
+    for (size_t i = 0; ok && i < clients; i++)
+    {
+        connections.emplace_back(new BenchClient());
+        ok = connections.back()->connect("127.0.0.1", port);
+        connections.back()->setReceiveTimeout(500);
+    }
+
+    // 另一个客户端在交接时正处于一条分片文本消息中间：第一个分片由旧进程收下，后续分片发给新进程，
+    // 且一个三字节的UTF-8字符跨在两个分片之间。回显服务器逐个分片回显，新进程必须接着这条消息解析
+    BenchClient fragmented;
+    const std::string first_fragment = "f:\xE4\xB8";
+    const std::string last_fragment = "\xAD!";
+    ok = ok && fragmented.connect("127.0.0.1", port);
+    fragmented.setReceiveTimeout(500);
+
+    // 每个客户端一个接收线程；发送线程以固定节奏向各客户端轮流发出编号的回显请求
+    std::atomic<bool> sending(ok);
+    std::vector<HandoffReceiver> receivers(connections.size());
+    std::vector<uint64_t> echoes_sent(connections.size(), 0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; ok && i < connections.size(); i++)
+    {
+        threads.emplace_back([&, i]
+                             {
+            std::string payload;
+            HandoffReceiver &receiver = receivers[i];
+            while (connections[i]->receiveFrame(payload))
+            {
+                uint64_t seq = std::strtoull(payload.c_str() + 2, nullptr, 10);
+                uint64_t &expected = payload[0] == 'p' ? receiver.pushes : receiver.next_echo;
+                if (seq != expected)
+                    receiver.gaps++;
+                expected = seq + 1;
+            } });
+    }
+    std::thread sender([&]
+                       {
+        while (sending)
+        {
+            for (size_t i = 0; i < connections.size(); i++)
+            {
+                if (connections[i]->sendText("e:" + std::to_string(echoes_sent[i])))
+                    echoes_sent[i]++;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        } });
+
+    // 负载稳定后启动新进程（start() 返回时已接管全部连接），旧进程交接完成后退出
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    ok = ok && fragmented.sendFrame(0x1, first_fragment, false) && receiveHandoffEcho(fragmented, first_fragment);
+    auto start = std::chrono::steady_clock::now();
+    ok = ok && write(go_pipe[1], &signal_byte, 1) == 1 && read(ready_pipe[0], &signal_byte, 1) == 1;
+    double takeover_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    int status = 0;
+    ok = ok && waitpid(old_pid, &status, 0) == old_pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    bool fragment_resumed = ok && fragmented.sendFrame(0x0, last_fragment, true) &&
+                            receiveHandoffEcho(fragmented, last_fragment) && fragmented.sendText("f:after") &&
+                            receiveHandoffEcho(fragmented, "f:after");
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    // 停止发送后等待收完在途的消息（接收超时即结束）
+    sending = false;
+    sender.join();
+    shared->stop = true;
+    for (auto &thread : threads)
+        thread.join();
+    if (new_pid > 0)
+        waitpid(new_pid, nullptr, 0);
+    if (old_pid > 0 && !ok)
+        kill(old_pid, SIGKILL);
+
+    uint64_t accepted = 0, delivered = 0, gaps = 0, echoes = 0, echoes_received = 0;
+    for (size_t i = 0; i < receivers.size(); i++)
+    {
+        accepted += shared->next_push[i + 1];
+        delivered += receivers[i].pushes;
+        gaps += receivers[i].gaps;
+        echoes += echoes_sent[i];
+        echoes_received += receivers[i].next_echo;
+    }
+    std::cout << "=== Hot upgrade under steady send load ===" << std::endl;
+    std::cout << std::fixed << std::setprecision(1) << "clients=" << connections.size()
+              << " takeover_ms=" << takeover_ms
+              << " pushes accepted=" << accepted << " delivered=" << delivered << " refused=" << shared->refused
+              << " echoes sent=" << echoes << " received=" << echoes_received
+              << " gaps=" << gaps << " mid-fragment=" << (fragment_resumed ? "resumed" : "closed") << std::endl;
+    bool passed = ok && gaps == 0 && delivered == accepted && echoes_received == echoes && fragment_resumed;
+    if (!passed)
+        std::cerr << "handoff: " << (ok ? "messages lost or out of order" : "handoff failed") << std::endl;
+    unlink(bench_handoff_socket);
+    return passed ? 0 : 1;
+}
+
+static int idleBench(size_t connections, size_t messages, int port)
+{
+    if (!ensureFdLimit(connections))
+    {
+        std::cerr << "Open file limit too low for " << connections << " connections" << std::endl;
+        return 1;
+    }
+
+    std::cout << "=== Echo latency with idle connections held open (4 worker threads) ===" << std::endl;
+    bool ok = runIdleBench(0, port, messages);
+    ok = runIdleBench(connections, port + 1, messages) && ok;
+    return ok ? 0 : 1;
+}
+
+// 旧的去掩码循环之后再做一遍逐字节校验，作为对照
+static bool unmaskThenValidate(const uint8_t *src, size_t length, const uint8_t *mask, uint8_t *dst)
+{
+    for (size_t i = 0; i < length; i++)
+        dst[i] = src[i] ^ mask[i % 4];
+    static const uint8_t no_mask[4] = {0, 0, 0, 0};
+    return unmaskAndValidateUtf8(Utf8Impl::Scalar, dst, length, no_mask, dst);
+}
+
+static void runUtf8Bench(const std::string &payload_name, const std::string &text, size_t megabytes)
+{
+    // 按4KB一帧切分（切在字符边界上），模拟聊天类文本消息
+    std::vector<std::pair<size_t, size_t>> frames;
+    for (size_t offset = 0; offset < text.size();)
+    {
+        size_t end = std::min(offset + 4096, text.size());
+        while (end < text.size() && (static_cast<uint8_t>(text[end]) & 0xC0) == 0x80)
+            end--;
+        frames.push_back(std::make_pair(offset, end - offset));
+        offset = end;
+    }
+
+    const uint8_t mask[4] = {0x12, 0x34, 0x56, 0x78};
+    std::vector<uint8_t> masked(text.size());
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        for (size_t k = 0; k < frames[i].second; k++)
+            masked[frames[i].first + k] = static_cast<uint8_t>(text[frames[i].first + k]) ^ mask[k % 4];
+    }
+    std::vector<uint8_t> output(text.size());
+
+    struct Variant
+    {
+        const char *name;
+        std::function<bool(const uint8_t *, size_t, const uint8_t *, uint8_t *)> run;
+    };
+    std::vector<Variant> variants;
+    variants.push_back({"two-pass", unmaskThenValidate});
+    variants.push_back({"scalar", [](const uint8_t *src, size_t n, const uint8_t *m, uint8_t *dst)
+                        { return unmaskAndValidateUtf8(Utf8Impl::Scalar, src, n, m, dst); }});
+    if (bestUtf8Impl() != Utf8Impl::Scalar)
+        variants.push_back({"sse4", [](const uint8_t *src, size_t n, const uint8_t *m, uint8_t *dst)
+                            { return unmaskAndValidateUtf8(Utf8Impl::Sse4, src, n, m, dst); }});
+    if (bestUtf8Impl() == Utf8Impl::Avx2)
+        variants.push_back({"avx2", [](const uint8_t *src, size_t n, const uint8_t *m, uint8_t *dst)
+                            { return unmaskAndValidateUtf8(Utf8Impl::Avx2, src, n, m, dst); }});
+
+    size_t rounds = std::max<size_t>(1, megabytes * 1024 * 1024 / text.size());
+    for (const Variant &variant : variants)
+    {
+        bool valid = true;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t r = 0; r < rounds; r++)
+        {
+            for (const auto &frame : frames)
+                valid = variant.run(&masked[frame.first], frame.second, mask, &output[frame.first]) && valid;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double gigabytes = static_cast<double>(rounds) * text.size() / (1024.0 * 1024.0 * 1024.0);
+        std::cout << std::left << std::setw(6) << payload_name << " " << std::setw(9) << variant.name
+                  << std::fixed << std::setprecision(2) << " GB/sec=" << gigabytes / seconds
+                  << " valid=" << (valid && std::equal(output.begin(), output.end(), text.begin(),
+                                                       [](uint8_t a, char b)
+                                                       { return a == static_cast<uint8_t>(b); }))
+                  << std::endl;
+    }
+}
+
+// 每个线程写 lines 条日志，标准输出在测量期间指向 /dev/null
+static double runLogBench(bool async, size_t lines, size_t threads)
+{
+    std::vector<std::thread> writers;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threads; t++)
+    {
+        writers.emplace_back([async, lines, t]
+                             {
+            for (size_t i = 0; i < lines; i++)
+            {
+                if (async)
+                    WEBSOCKET_LOG_INFO("WebSocket handshake successful with 127.0.0." << t << " #" << i);
+                else
+                    std::cout << "WebSocket handshake successful with 127.0.0." << t << " #" << i << std::endl;
+            } });
+    }
+    for (auto &writer : writers)
+        writer.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (async)
+        AsyncLogger::flush();
+    return seconds;
+}
+
+static int logBench(size_t lines)
+{
+    const size_t threads = 4;
+    std::cout << "=== " << threads << " threads logging " << lines << " lines each to /dev/null ===" << std::endl;
+
+    int saved = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (saved < 0 || null_fd < 0)
+        return 1;
+    AsyncLogger::setLevel(LogLevel::Info);
+    AsyncLogger::setRateLimit(0);
+
+    dup2(null_fd, STDOUT_FILENO);
+    double iostream_seconds = runLogBench(false, lines, threads);
+    AsyncLogger::Stats before = AsyncLogger::getStats();
+    double async_seconds = runLogBench(true, lines, threads);
+    AsyncLogger::Stats after = AsyncLogger::getStats();
+    dup2(saved, STDOUT_FILENO);
+    ::close(saved);
+    ::close(null_fd);
+
+    size_t total = lines * threads;
+    std::cout << std::left << std::setw(10) << "iostream" << std::fixed << std::setprecision(1)
+              << " ns/line=" << iostream_seconds * 1e9 / lines << std::endl;
+    std::cout << std::left << std::setw(10) << "async" << std::fixed << std::setprecision(1)
+              << " ns/line=" << async_seconds * 1e9 / lines
+              << " written=" << after.lines - before.lines << "/" << total
+              << " dropped=" << after.dropped - before.dropped << std::endl;
+    return 0;
+}
+
+static int utf8Bench(size_t megabytes)
+{
+    std::cout << "=== Text frame unmask + UTF-8 validation (4KB frames, best: "
+              << utf8ImplName(bestUtf8Impl()) << ") ===" << std::endl;
+
+    std::string ascii, cjk;
+    while (ascii.size() < 1024 * 1024)
+        ascii += "{\"type\":\"chat\",\"room\":42,\"text\":\"hello world, see you at 10:30 \u00e9\"} ";
+    while (cjk.size() < 1024 * 1024)
+        cjk += "你好，世界！今天的行情：上证指数上涨1.2%，成交量放大。WebSocket 消息推送测试。";
+
+    runUtf8Bench("ascii", ascii, megabytes);
+    runUtf8Bench("cjk", cjk, megabytes);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    std::cout << "Usage: " << prog << " <mode> [options]" << std::endl;
+    std::cout << "Modes:" << std::endl;
+    std::cout << "  alloc [messages]          - Count heap allocations per dispatched message" << std::endl;
+    std::cout << "  latency [messages] [port] - Echo round-trip latency, pool vs inline dispatch" << std::endl;
+    std::cout << "  tls-handshake [count] [port] - wss:// handshakes/sec, full vs resumed" << std::endl;
+    std::cout << "  tls-bulk [megabytes] [port]  - Bulk echo throughput, plain vs TLS vs kTLS" << std::endl;
+    std::cout << "  utf8 [megabytes]          - Text frame unmask + UTF-8 validation throughput" << std::endl;
+    std::cout << "  sendfile [megabytes] [port]  - Blob download throughput, copy vs sendFile (plain and TLS)" << std::endl;
+    std::cout << "  fanout [rounds] [port]    - Same message to 10/1k/50k clients, loop vs sendToClients" << std::endl;
+    std::cout << "  accept [connections] [port] - Reconnect storm accepts/sec, backlog 10 vs tuned listener" << std::endl;
+    std::cout << "  idle [connections] [port]   - Echo latency with 0 vs N idle connections, 4 worker threads" << std::endl;
+    std::cout << "  memory [connections] [port] - Server RSS per idle connection" << std::endl;
+    std::cout << "  uds [messages] [port]     - Echo round-trip latency, loopback TCP vs Unix domain socket" << std::endl;
+    std::cout << "  bus [processes] [messages] [port] - Broadcast to clients of sibling processes over the local bus" << std::endl;
+    std::cout << "  ingest [messages] [port]  - Messages/sec injected by an external process through the shared-memory ring" << std::endl;
+    std::cout << "  replay <capture-file> [speed] [port] - Replay captured client traffic against a running server (speed 0 = no pacing)" << std::endl;
+    std::cout << "  resume [clients] [port]   - Catch-up after reconnect, full state resend vs session resumption" << std::endl;
+    std::cout << "  log [lines]               - Per-line cost with 4 logging threads, std::cout+std::endl vs async logger" << std::endl;
+    std::cout << "  disconnect [clients] [port] - Client close to disconnection handler latency, idle vs busy server" << std::endl;
+    std::cout << "  burst [megabytes] [port]  - 4 clients each send a multi-MB burst: throughput, ordering, concurrent handlers" << std::endl;
+    std::cout << "  handoff [clients] [port]  - Hot upgrade to a second process under steady push/echo load, per-client sequence check" << std::endl;
+    std::cout << "  frames [port]             - Close codes for oversized frames/messages, invalid UTF-8 in fragments, bad fragment order" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // 服务器的信息日志（握手、断开等）不输出，警告和错误照常输出
+    AsyncLogger::setLevel(LogLevel::Warn);
+
+    std::string mode = argv[1];
+    if (mode == "alloc")
+    {
+        size_t messages = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+        return allocBench(messages);
+    }
+    if (mode == "latency")
+    {
+        size_t messages = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000;
+        int port = argc > 3 ? std::atoi(argv[3]) : 9100;
+        return latencyBench(messages, port);
+    }
+    if (mode == "tls-handshake")
+    {
+        size_t count = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000;
+        int port = argc > 3 ? std::atoi(argv[3]) : 9110;
+        return tlsHandshakeBench(count, port);
+    }
+    if (mode == "utf8")
+    {
+        size_t megabytes = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1024;
+        return utf8Bench(megabytes);
+    }
+    if (mode == "tls-bulk")
+    {
+        size_t megabytes = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 256;
+        int port = argc > 3 ? std::atoi(argv[3]) : 9120;
+        return tlsBulkBench(megabytes, port);
+    }
+    if (mode == "sendfile")
+    {
+        size_t megabytes = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1024;
+        int port = argc > 3 ? std::atoi(argv[3]) : 9130;
+        return sendFileBench(megabytes, port);
+    }
+    if (mode == "fanout")
+    {
+        size_t rounds = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 20;
+        int port = argc > 3 ? std::atoi(argv[3]) : 9140;
+        return fanoutBench(rounds, port);
+    }
+    if (mode == "accept")
+    {
+        size_t connections = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 5000;
+        int port = argc > 3 ? std::atoi(argv[3]) : 9150;
+        return acceptBench(connections, port);
+    }
+    if (mode == "idle")
+    {
+        size_t connections = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10000;
+        int port = argc > 3 ? std::atoi(argv[3]) : 9160;
+        return idleBench(connections, 10000, port);
+    }
+    if (mode == "memory")
+    {
+        size_t connections = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000;
+        int port = argc > 3 ? std::atoi(argv[3]) : 9170;
+        return memoryBench(connections, port);
+    }
+    if (mode == "uds")
+    {
+        size_t messages = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000;
+        int port = argc > 3 ? std::atoi(argv[3]) : 9180;
+        return transportBench(messages, port);
+    }
+    if (mode == "bus")
+    {
+        size_t processes = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4;
+        size_t messages = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 100000;
+        int port = argc > 4 ? std::atoi(argv[4]) : 9190;
+        return busBench(processes, messages, port);
+    }
+    if (mode == "ingest")
+    {
+        size_t messages = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+        int port = argc > 3 ? std::atoi(argv[3]) : 9200;
+        return ingestBench(messages, port);
+    }
+    if (mode == "replay" && argc > 2)
+    {
+        double speed = argc > 3 ? std::atof(argv[3]) : 1.0;
+        int port = argc > 4 ? std::atoi(argv[4]) : 8080;
+        return replayBench(argv[2], speed, port);
+    }
+
+    if (mode == "log")
+    {
+        size_t lines = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+        return logBench(lines);
+    }
+    if (mode == "resume")
+    {
+        size_t clients = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 500;
+        int port = argc > 3 ? std::atoi(argv[3]) : 9210;
+        return resumeBench(clients, port);
+    }
+    if (mode == "disconnect")
+    {
+        size_t clients = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000;
+        int port = argc > 3 ? std::atoi(argv[3]) : 9220;
+        return disconnectBench(clients, port);
+    }
+    if (mode == "burst")
+    {
+        size_t megabytes = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 16;
+        int port = argc > 3 ? std::atoi(argv[3]) : 9230;
+        return burstBench(megabytes, port);
+    }
+    if (mode == "handoff")
+    {
+        size_t clients = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 8;
+        int port = argc > 3 ? std::atoi(argv[3]) : 9250;
+        return handoffBench(clients, port);
+    }
+    if (mode == "frames")
+    {
+        int port = argc > 2 ? std::atoi(argv[2]) : 9240;
+        return framesBench(port);
+    }
+
+    usage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,355 @@
+#include "websocket_bus.h"
+#include "websocket_log.h"
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <sys/un.h>
+#include <dirent.h>
+#include <unistd.h>
+
+const size_t BroadcastBus::max_frame_size;
+const size_t BroadcastBus::max_backlog_bytes;
+
+static bool makeBusAddress(const std::string &path, struct sockaddr_un &addr)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        return false;
+    memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+BroadcastBus::BroadcastBus()
+    : fd(-1), watch_fd(-1), published(0), delivered(0), received(0), dropped(0), oversized(0)
+{
+}
+
+BroadcastBus::~BroadcastBus()
+{
+    close();
+}
+
+bool BroadcastBus::open(const std::string &dir)
+{
+    if (fd >= 0)
+        return false;
+
+    if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST)
+    {
+        WEBSOCKET_LOG_ERROR("Failed to create broadcast bus directory " << dir << ": " << strerror(errno));
+        return false;
+    }
+
+    // 同一进程中可以有多个服务器实例，文件名带上实例序号
+    static std::atomic<int> instance(0);
+    directory = dir;
+    path = dir + "/" + std::to_string(getpid()) + "-" + std::to_string(instance++) + ".sock";
+
+    struct sockaddr_un addr;
+    if (!makeBusAddress(path, addr))
+    {
+        WEBSOCKET_LOG_ERROR("Broadcast bus path too long: " << path);
+        return false;
+    }
+
+    // 先开始监视目录再扫描，扫描期间加入的进程不会漏掉
+    watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd < 0 || inotify_add_watch(watch_fd, dir.c_str(), IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO) < 0)
+    {
+        WEBSOCKET_LOG_ERROR("Failed to watch broadcast bus directory " << dir << ": " << strerror(errno));
+        close();
+        return false;
+    }
+
+    fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        close();
+        return false;
+    }
+
+    // 发送和接收都用 MSG_DONTWAIT；发送缓冲区要能容纳一个最大的帧
+    int sndbuf = static_cast<int>(max_frame_size * 2);
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    unlink(path.c_str());
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        WEBSOCKET_LOG_ERROR("Failed to bind broadcast bus socket " << path << ": " << strerror(errno));
+        close();
+        return false;
+    }
+
+    receive_buffer.resize(max_frame_size);
+    refreshPeers();
+    return true;
+}
+
+void BroadcastBus::close()
+{
+    if (watch_fd >= 0)
+    {
+        ::close(watch_fd);
+        watch_fd = -1;
+    }
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+        unlink(path.c_str());
+    }
+
+    std::lock_guard<std::mutex> lock(peers_mutex);
+    for (auto &pair : peers)
+    {
+        if (pair.second.wait_fd >= 0)
+            ::close(pair.second.wait_fd);
+    }
+    for (int retired : retired_fds)
+        ::close(retired);
+    peers.clear();
+    retired_fds.clear();
+}
+
+void BroadcastBus::refreshPeers()
+{
+    // 取空 inotify 事件，具体是哪个文件变化不重要，重新扫描一遍目录
+    char events[4096];
+    while (watch_fd >= 0 && read(watch_fd, events, sizeof(events)) > 0)
+    {
+    }
+
+    DIR *dir = opendir(directory.c_str());
+    if (!dir)
+        return;
+    std::vector<std::string> found;
+    while (struct dirent *entry = readdir(dir))
+    {
+        std::string name = entry->d_name;
+        if (name.size() <= 5 || name.compare(name.size() - 5, 5, ".sock") != 0)
+            continue;
+        std::string peer = directory + "/" + name;
+        if (peer != path)
+            found.push_back(peer);
+    }
+    closedir(dir);
+    std::sort(found.begin(), found.end());
+
+    std::lock_guard<std::mutex> lock(peers_mutex);
+    for (auto it = peers.begin(); it != peers.end();)
+    {
+        if (std::binary_search(found.begin(), found.end(), it->first))
+        {
+            ++it;
+            continue;
+        }
+        // 进程已退出：积压的帧不再发送，等待中的fd交给 flushPeer 关闭（它仍登记在epoll线程上）
+        dropped += it->second.backlog.size();
+        if (it->second.wait_fd >= 0)
+            retired_fds.push_back(it->second.wait_fd);
+        it = peers.erase(it);
+    }
+    for (const std::string &peer : found)
+    {
+        if (peers.count(peer))
+            continue;
+        Peer entry;
+        if (!makeBusAddress(peer, entry.addr))
+            continue;
+        entry.backlog_bytes = 0;
+        entry.wait_fd = -1;
+        peers.insert(std::make_pair(peer, std::move(entry)));
+    }
+}
+
+void BroadcastBus::enqueueLocked(Peer &peer, const std::string &frame)
+{
+    if (peer.backlog_bytes + frame.size() > max_backlog_bytes)
+    {
+        dropped++;
+        return;
+    }
+
+    // 第一个积压的帧：建一个连接到对端的socket，对端队列有空位时它变为可写
+    if (peer.wait_fd < 0)
+    {
+        peer.wait_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (peer.wait_fd >= 0 && connect(peer.wait_fd, (struct sockaddr *)&peer.addr, sizeof(peer.addr)) < 0)
+        {
+            ::close(peer.wait_fd);
+            peer.wait_fd = -1;
+        }
+        if (peer.wait_fd < 0 || !backlog_handler)
+        {
+            if (peer.wait_fd >= 0)
+                ::close(peer.wait_fd);
+            peer.wait_fd = -1;
+            dropped++;
+            return;
+        }
+        int sndbuf = static_cast<int>(max_frame_size * 2);
+        setsockopt(peer.wait_fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+        backlog_handler(peer.wait_fd);
+    }
+    peer.backlog.push_back(frame);
+    peer.backlog_bytes += frame.size();
+}
+
+bool BroadcastBus::flushPeer(int wait_fd)
+{
+    std::lock_guard<std::mutex> lock(peers_mutex);
+    auto retired = std::find(retired_fds.begin(), retired_fds.end(), wait_fd);
+    if (retired != retired_fds.end())
+    {
+        ::close(wait_fd);
+        retired_fds.erase(retired);
+        return false;
+    }
+
+    Peer *peer = nullptr;
+    for (auto &pair : peers)
+    {
+        if (pair.second.wait_fd == wait_fd)
+            peer = &pair.second;
+    }
+    if (!peer)
+        return false;
+
+    while (!peer->backlog.empty())
+    {
+        const std::string &frame = peer->backlog.front();
+        ssize_t n = send(wait_fd, frame.data(), frame.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+        if (n < 0)
+        {
+            // 对端已退出，剩下的帧不再发送；socket文件由扫描目录时清理
+            dropped += peer->backlog.size();
+            peer->backlog.clear();
+            break;
+        }
+        delivered++;
+        peer->backlog_bytes -= frame.size();
+        peer->backlog.pop_front();
+    }
+
+    // 积压发完，回到直接发送
+    ::close(wait_fd);
+    peer->wait_fd = -1;
+    peer->backlog_bytes = 0;
+    return false;
+}
+
+size_t BroadcastBus::publish(const std::string &frame)
+{
+    if (fd < 0)
+        return 0;
+
+    published++;
+    if (frame.size() > max_frame_size)
+    {
+        oversized++;
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(peers_mutex);
+    if (msgs.size() < peers.size())
+    {
+        msgs.resize(peers.size());
+        targets.resize(peers.size());
+    }
+
+    // 一次 sendmmsg 发给所有没有积压的对端，每个消息带各自的目标地址；有积压的对端排在积压之后，保持顺序
+    struct iovec iov;
+    iov.iov_base = const_cast<char *>(frame.data());
+    iov.iov_len = frame.size();
+    size_t count = 0;
+    for (auto &pair : peers)
+    {
+        Peer &peer = pair.second;
+        if (!peer.backlog.empty())
+        {
+            enqueueLocked(peer, frame);
+            continue;
+        }
+        memset(&msgs[count], 0, sizeof(msgs[count]));
+        msgs[count].msg_hdr.msg_name = &peer.addr;
+        msgs[count].msg_hdr.msg_namelen = sizeof(peer.addr);
+        msgs[count].msg_hdr.msg_iov = &iov;
+        msgs[count].msg_hdr.msg_iovlen = 1;
+        targets[count] = &peer;
+        count++;
+    }
+
+    size_t sent = 0;
+    for (size_t i = 0; i < count;)
+    {
+        int n = sendmmsg(fd, &msgs[i], static_cast<unsigned int>(count - i), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0)
+        {
+            sent += n;
+            i += n;
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+
+        // msgs[i] 发送失败，跳过它继续发给其余的对端
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            // 对端接收队列已满：不等待，转入它的积压
+            enqueueLocked(*targets[i], frame);
+        }
+        else if (errno == ECONNREFUSED)
+        {
+            // socket文件还在但进程已经退出（崩溃时来不及删除），删除后由目录监视把它移出对端列表
+            unlink(targets[i]->addr.sun_path);
+        }
+        else if (errno != ENOENT)
+        {
+            dropped++;
+        }
+        i++;
+    }
+    delivered += sent;
+    return sent;
+}
+
+bool BroadcastBus::receive(std::string &frame)
+{
+    if (fd < 0)
+        return false;
+
+    ssize_t n;
+    do
+    {
+        n = recv(fd, receive_buffer.data(), receive_buffer.size(), MSG_DONTWAIT);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+        return false;
+
+    frame.assign(receive_buffer.data(), static_cast<size_t>(n));
+    received++;
+    return true;
+}
+
+BroadcastBus::Stats BroadcastBus::getStats()
+{
+    Stats stats;
+    {
+        std::lock_guard<std::mutex> lock(peers_mutex);
+        stats.peers = peers.size();
+    }
+    stats.published = published.load();
+    stats.delivered = delivered.load();
+    stats.received = received.load();
+    stats.dropped = dropped.load();
+    stats.oversized = oversized.load();
+    return stats;
+}
@@ -0,0 +1,100 @@
+#ifndef WEBSOCKET_BUS_H
+#define WEBSOCKET_BUS_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// 同机多进程的广播总线：每个进程在同一目录下绑定一个Unix域数据报socket，
+// 广播时把已编码好的帧原样发给目录中的其他进程，接收方不再重新编码，直接写给本地客户端。
+//
+// 一个数据报就是一个完整的帧，进程间按发送顺序到达。发送从不阻塞：对端接收队列已满时帧暂存在
+// 该对端的积压队列里，等它的队列有空位后按顺序补发，积压超过 max_backlog_bytes 时丢弃新帧并计数，
+// 一个停滞的对端不会拖慢发往其他对端的广播；队列长度由 net.unix.max_dgram_qlen 决定。
+// 对端列表用 inotify 监视目录，只在有进程加入或退出时重新扫描
+class BroadcastBus
+{
+public:
+    struct Stats
+    {
+        size_t peers;         // 目录中的其他进程数
+        uint64_t published;   // 本进程发布的帧数
+        uint64_t delivered;   // 成功发给其他进程的帧数（每个接收进程计一次）
+        uint64_t received;    // 从其他进程收到的帧数
+        uint64_t dropped;     // 因对端积压超出上限（或对端退出）而未送达的帧数
+        uint64_t oversized;   // 超过单个数据报上限、只在本进程投递的帧数
+    };
+
+    // 单个帧的上限，受发送缓冲区大小限制
+    static const size_t max_frame_size = 192 * 1024;
+    // 每个对端积压的帧字节数上限
+    static const size_t max_backlog_bytes = 16 * 1024 * 1024;
+
+    BroadcastBus();
+    ~BroadcastBus();
+
+    // 在 directory 下创建本进程的socket（目录不存在时创建），失败返回 false
+    bool open(const std::string &directory);
+    void close();
+    bool isOpen() const { return fd >= 0; }
+    // 可读时调用 receive 取出到达的帧
+    int getFd() const { return fd; }
+    // 目录有变化（进程加入或退出）时可读，此时调用 refreshPeers
+    int getWatchFd() const { return watch_fd; }
+    void refreshPeers();
+
+    // 某个对端开始积压时以一个连接到该对端的fd调用（在发布线程中、持有内部锁，只应登记等待）；
+    // 该fd可写时调用 flushPeer 补发，返回 true 表示仍有积压、需要继续等待可写。需在 open 之前设置
+    void setBacklogHandler(std::function<void(int)> handler) { backlog_handler = handler; }
+    bool flushPeer(int wait_fd);
+
+    // 把帧发给目录中除自己以外的所有进程（线程安全，不阻塞），返回立即发出的进程数，积压的帧稍后补发
+    size_t publish(const std::string &frame);
+    // 取出一个到达的帧（非阻塞），没有时返回 false
+    bool receive(std::string &frame);
+
+    Stats getStats();
+
+private:
+    struct Peer
+    {
+        struct sockaddr_un addr;
+        std::deque<std::string> backlog; // 对端队列已满时暂存的帧，按顺序补发
+        size_t backlog_bytes;
+        int wait_fd; // 有积压时连接到对端的socket，可写即对端队列有空位；没有积压时为 -1
+    };
+
+    std::string directory;
+    std::string path; // 本进程socket文件的路径
+    int fd;
+    int watch_fd; // 监视目录的 inotify 实例
+    std::vector<char> receive_buffer;
+    std::function<void(int)> backlog_handler;
+
+    // 以下成员由 peers_mutex 保护：对端按socket路径索引；发送用的数组在各次发布间复用
+    std::mutex peers_mutex;
+    std::map<std::string, Peer> peers;
+    std::vector<int> retired_fds; // 已退出、仍在等待可写的对端的fd，由 flushPeer 关闭
+    std::vector<struct mmsghdr> msgs;
+    std::vector<Peer *> targets;
+
+    std::atomic<uint64_t> published;
+    std::atomic<uint64_t> delivered;
+    std::atomic<uint64_t> received;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> oversized;
+
+    void enqueueLocked(Peer &peer, const std::string &frame);
+
+    BroadcastBus(const BroadcastBus &) = delete;
+    BroadcastBus &operator=(const BroadcastBus &) = delete;
+};
+
+#endif
@@ -0,0 +1,191 @@
+#include "websocket_capture.h"
+#include "websocket_log.h"
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint32_t capture_magic = 0x57534350; // "WSCP"
+static const uint32_t capture_version = 1;
+static const size_t capture_data_offset = 64; // 数据区从第一个缓存行之后开始
+
+static size_t alignRecord(size_t length)
+{
+    return (length + 7) & ~static_cast<size_t>(7);
+}
+
+TrafficCapture::TrafficCapture()
+    : fd(-1), base(nullptr), capacity(0), mapped_size(0), next(closed_bit), records(0), dropped(0)
+{
+}
+
+TrafficCapture::~TrafficCapture()
+{
+    close();
+    if (base)
+        munmap(base, mapped_size);
+    if (fd >= 0)
+        ::close(fd);
+}
+
+bool TrafficCapture::open(const std::string &path, size_t max_bytes)
+{
+    if (base)
+        return false;
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        WEBSOCKET_LOG_ERROR("Failed to open capture file " << path << ": " << strerror(errno));
+        return false;
+    }
+
+    // 稀疏文件：只有写到的页才占用磁盘和页缓存
+    mapped_size = std::max(max_bytes, capture_data_offset + 4096);
+    void *p = MAP_FAILED;
+    if (ftruncate(fd, mapped_size) == 0)
+        p = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        WEBSOCKET_LOG_ERROR("Failed to map capture file " << path << ": " << strerror(errno));
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    base = static_cast<char *>(p);
+    capacity = mapped_size - capture_data_offset;
+    CaptureFileHeader *header = reinterpret_cast<CaptureFileHeader *>(base);
+    header->magic = capture_magic;
+    header->version = capture_version;
+    header->used = 0;
+
+    start = std::chrono::steady_clock::now();
+    records = 0;
+    dropped = 0;
+    next = 0;
+    return true;
+}
+
+void TrafficCapture::close()
+{
+    if (!base)
+        return;
+    uint64_t end = next.fetch_or(closed_bit);
+    if (end & closed_bit)
+        return;
+
+    // 已预留的记录都在 end 之前，截断后仍在映射范围内
+    CaptureFileHeader *header = reinterpret_cast<CaptureFileHeader *>(base);
+    header->used = end;
+    msync(base, capture_data_offset, MS_SYNC);
+    if (ftruncate(fd, capture_data_offset + end) < 0)
+    {
+        WEBSOCKET_LOG_ERROR("Failed to truncate capture file: " << strerror(errno));
+    }
+}
+
+void TrafficCapture::record(CaptureEvent event, int client_id, const char *data, size_t length, uint8_t opcode)
+{
+    uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+    size_t size = alignRecord(sizeof(CaptureRecordHeader) + length);
+
+    uint64_t offset = next.load(std::memory_order_relaxed);
+    do
+    {
+        if (offset & closed_bit)
+            return;
+        if (offset + size > capacity)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    } while (!next.compare_exchange_weak(offset, offset + size, std::memory_order_relaxed));
+
+    char *slot = base + capture_data_offset + offset;
+    CaptureRecordHeader *header = reinterpret_cast<CaptureRecordHeader *>(slot);
+    header->event = static_cast<uint8_t>(event);
+    header->opcode = opcode;
+    header->reserved = 0;
+    header->client_id = client_id;
+    header->length = static_cast<uint32_t>(length);
+    header->timestamp_ns = timestamp;
+    if (length > 0)
+        memcpy(slot + sizeof(CaptureRecordHeader), data, length);
+    reinterpret_cast<std::atomic<uint32_t> *>(&header->size)->store(static_cast<uint32_t>(size), std::memory_order_release);
+    records.fetch_add(1, std::memory_order_relaxed);
+}
+
+TrafficCapture::Stats TrafficCapture::getStats() const
+{
+    Stats stats;
+    stats.records = records.load();
+    stats.bytes = next.load() & ~closed_bit;
+    stats.dropped = dropped.load();
+    return stats;
+}
+
+TrafficCaptureReader::TrafficCaptureReader() : fd(-1), base(nullptr), mapped_size(0), end(0), offset(0)
+{
+}
+
+TrafficCaptureReader::~TrafficCaptureReader()
+{
+    if (base)
+        munmap(const_cast<char *>(base), mapped_size);
+    if (fd >= 0)
+        ::close(fd);
+}
+
+bool TrafficCaptureReader::open(const std::string &path)
+{
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < capture_data_offset)
+    {
+        WEBSOCKET_LOG_ERROR("Failed to open capture file " << path);
+        return false;
+    }
+
+    mapped_size = st.st_size;
+    void *p = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED)
+        return false;
+    base = static_cast<const char *>(p);
+
+    const CaptureFileHeader *header = reinterpret_cast<const CaptureFileHeader *>(base);
+    if (header->magic != capture_magic || header->version != capture_version)
+    {
+        WEBSOCKET_LOG_ERROR("Not a capture file: " << path);
+        return false;
+    }
+
+    // 录制未正常结束时读到第一条未写完的记录为止
+    end = header->used ? std::min(mapped_size, capture_data_offset + static_cast<size_t>(header->used)) : mapped_size;
+    offset = capture_data_offset;
+    return true;
+}
+
+bool TrafficCaptureReader::next(Record &record)
+{
+    if (!base || offset + sizeof(CaptureRecordHeader) > end)
+        return false;
+
+    const CaptureRecordHeader *header = reinterpret_cast<const CaptureRecordHeader *>(base + offset);
+    if (header->size < sizeof(CaptureRecordHeader) || offset + header->size > end ||
+        sizeof(CaptureRecordHeader) + header->length > header->size)
+        return false;
+
+    record.event = static_cast<CaptureEvent>(header->event);
+    record.opcode = header->opcode;
+    record.client_id = header->client_id;
+    record.timestamp_ns = header->timestamp_ns;
+    record.payload.assign(base + offset + sizeof(CaptureRecordHeader), header->length);
+    offset += header->size;
+    return true;
+}
@@ -0,0 +1,119 @@
+#ifndef WEBSOCKET_CAPTURE_H
+#define WEBSOCKET_CAPTURE_H
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+
+// 流量录制：把连接建立/断开、收到的消息和发出的消息追加到内存映射的日志文件中，
+// 供 websocket_bench replay 在本机按原始节奏或加速重放。
+//
+// 文件开头是固定大小的文件头，之后是按8字节对齐的记录。写入方用CAS在映射区内预留空间后
+// 直接拷贝，不加锁、不做系统调用；记录头中的 size 最后写入，进程崩溃时读取方遇到
+// size 为 0 的记录即停止
+
+enum class CaptureEvent : uint8_t
+{
+    Connect = 1,    // payload 为握手请求路径
+    Disconnect = 2,
+    Inbound = 3,    // 客户端发来的消息
+    Outbound = 4    // 发给客户端的消息，client_id 为 -1 表示广播
+};
+
+struct CaptureFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t used; // 文件头之后已写入的字节数；为 0 表示录制未正常结束
+};
+
+struct CaptureRecordHeader
+{
+    uint32_t size;         // 整条记录（含记录头和对齐填充）的长度
+    uint8_t event;         // CaptureEvent
+    uint8_t opcode;        // 帧类型：1 文本，2 二进制
+    uint16_t reserved;
+    int32_t client_id;
+    uint32_t length;       // payload 字节数
+    uint64_t timestamp_ns; // 相对录制开始的单调时间
+};
+
+class TrafficCapture
+{
+public:
+    struct Stats
+    {
+        uint64_t records; // 已写入的记录数
+        uint64_t bytes;   // 已写入的字节数
+        uint64_t dropped; // 文件已满而丢弃的记录数
+    };
+
+    TrafficCapture();
+    ~TrafficCapture();
+
+    // 创建（覆盖）日志文件并映射 max_bytes 字节，未写到的部分不占磁盘空间
+    bool open(const std::string &path, size_t max_bytes);
+    // 停止录制并把文件截断到实际长度；映射保留到析构，仍在拷贝中的写入不受影响
+    void close();
+    bool isOpen() const { return (next.load(std::memory_order_relaxed) & closed_bit) == 0 && base != nullptr; }
+
+    // 线程安全
+    void record(CaptureEvent event, int client_id, const char *data, size_t length, uint8_t opcode = 0x1);
+    void record(CaptureEvent event, int client_id, const std::string &data)
+    {
+        record(event, client_id, data.data(), data.size());
+    }
+
+    Stats getStats() const;
+
+private:
+    static const uint64_t closed_bit = 1ULL << 63;
+
+    int fd;
+    char *base;
+    size_t capacity;  // 文件头之后可写的字节数
+    size_t mapped_size;
+    std::chrono::steady_clock::time_point start;
+
+    std::atomic<uint64_t> next; // 下一条记录的偏移，最高位表示已停止录制
+    std::atomic<uint64_t> records;
+    std::atomic<uint64_t> dropped;
+
+    TrafficCapture(const TrafficCapture &) = delete;
+    TrafficCapture &operator=(const TrafficCapture &) = delete;
+};
+
+// 按写入顺序读取录制文件（重放工具使用）
+class TrafficCaptureReader
+{
+public:
+    struct Record
+    {
+        CaptureEvent event;
+        uint8_t opcode;
+        int client_id;
+        uint64_t timestamp_ns;
+        std::string payload;
+    };
+
+    TrafficCaptureReader();
+    ~TrafficCaptureReader();
+
+    bool open(const std::string &path);
+    // 读取下一条记录，到达末尾时返回 false
+    bool next(Record &record);
+
+private:
+    int fd;
+    const char *base;
+    size_t mapped_size;
+    size_t end;    // 可读数据的末尾（相对文件开头）
+    size_t offset;
+
+    TrafficCaptureReader(const TrafficCaptureReader &) = delete;
+    TrafficCaptureReader &operator=(const TrafficCaptureReader &) = delete;
+};
+
+#endif
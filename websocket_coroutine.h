@@ -0,0 +1,215 @@
+#ifndef WEBSOCKET_COROUTINE_H
+#define WEBSOCKET_COROUTINE_H
+
+// 可选的 C++20 协程接口（需要 -std=c++20）
+//
+// 处理函数写成协程，在连接所属的epoll线程上运行：
+//   co_await conn.recv()         等待下一条消息，连接断开时返回空
+//   co_await conn.send(message)  发送消息
+//   co_await conn.sleep(delay)   定时等待
+//   co_await conn.readable(fd)   等待下游服务的fd可读（writable 同理）
+// 挂起中的协程只占用协程帧的内存，不占用线程。
+// 回调接口（websocket_server.h）仍然可以在 C++11 下单独使用。
+
+#if __cplusplus < 202002L
+#error "websocket_coroutine.h requires C++20 (-std=c++20)"
+#endif
+
+#include "websocket_server.h"
+#include "websocket_log.h"
+#include <coroutine>
+#include <deque>
+#include <optional>
+#include <unordered_map>
+
+// 协程处理函数的返回类型：立即开始执行，结束时自动销毁协程帧
+class CoTask
+{
+public:
+    struct promise_type
+    {
+        CoTask get_return_object() { return CoTask(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception()
+        {
+            try
+            {
+                throw;
+            }
+            catch (const std::exception &e)
+            {
+                WEBSOCKET_LOG_ERROR("Unhandled exception in coroutine handler: " << e.what());
+            }
+            catch (...)
+            {
+                WEBSOCKET_LOG_ERROR("Unhandled exception in coroutine handler");
+            }
+        }
+    };
+};
+
+class CoConnection
+{
+public:
+    // 单个连接的协程状态，只在该连接的epoll线程上访问
+    struct State
+    {
+        WebSocketServer *server;
+        int client_id;
+        int reactor_index;
+        std::string client_ip;
+        std::deque<std::string> inbox;
+        std::coroutine_handle<> waiting;
+        bool closed = false;
+
+        void resumeWaiting()
+        {
+            if (waiting)
+            {
+                auto handle = waiting;
+                waiting = nullptr;
+                handle.resume();
+            }
+        }
+    };
+
+    explicit CoConnection(std::shared_ptr<State> state) : state(std::move(state)) {}
+
+    int id() const { return state->client_id; }
+    const std::string &ip() const { return state->client_ip; }
+    bool isOpen() const { return !state->closed; }
+
+    struct RecvAwaiter
+    {
+        std::shared_ptr<State> state;
+
+        bool await_ready() const { return !state->inbox.empty() || state->closed; }
+        void await_suspend(std::coroutine_handle<> handle) { state->waiting = handle; }
+        std::optional<std::string> await_resume()
+        {
+            if (state->inbox.empty())
+                return std::nullopt;
+            std::string message = std::move(state->inbox.front());
+            state->inbox.pop_front();
+            return message;
+        }
+    };
+
+    struct SendAwaiter
+    {
+        std::shared_ptr<State> state;
+        std::string message;
+        bool sent = false;
+
+        bool await_ready()
+        {
+            sent = !state->closed && state->server->sendMessageToClient(state->client_id, message);
+            return true;
+        }
+        void await_suspend(std::coroutine_handle<>) {}
+        bool await_resume() const { return sent; }
+    };
+
+    struct SleepAwaiter
+    {
+        std::shared_ptr<State> state;
+        std::chrono::milliseconds delay;
+
+        bool await_ready() const { return delay.count() <= 0; }
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            // 服务器已停止时不挂起，直接继续执行
+            return state->server->runAfter(state->reactor_index, delay, [handle]
+                                           { handle.resume(); });
+        }
+        void await_resume() const {}
+    };
+
+    struct ReadyAwaiter
+    {
+        std::shared_ptr<State> state;
+        int fd;
+        uint32_t events;
+
+        bool await_ready() const { return false; }
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            return state->server->runWhenReady(state->reactor_index, fd, events, [handle]
+                                               { handle.resume(); });
+        }
+        void await_resume() const {}
+    };
+
+    RecvAwaiter recv() { return RecvAwaiter{state}; }
+    SendAwaiter send(std::string message) { return SendAwaiter{state, std::move(message)}; }
+    SleepAwaiter sleep(std::chrono::milliseconds delay) { return SleepAwaiter{state, delay}; }
+    ReadyAwaiter readable(int fd) { return ReadyAwaiter{state, fd, EPOLLIN}; }
+    ReadyAwaiter writable(int fd) { return ReadyAwaiter{state, fd, EPOLLOUT}; }
+
+private:
+    std::shared_ptr<State> state;
+};
+
+// 为服务器安装协程处理函数：每个连接启动一个协程。
+// 会替换服务器上已设置的消息、连接和断开回调。
+inline void setCoroutineHandler(WebSocketServer &server, std::function<CoTask(CoConnection)> handler)
+{
+    struct Registry
+    {
+        std::mutex mutex;
+        std::unordered_map<int, std::shared_ptr<CoConnection::State>> states;
+
+        std::shared_ptr<CoConnection::State> find(int client_id)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = states.find(client_id);
+            return it != states.end() ? it->second : nullptr;
+        }
+    };
+    auto registry = std::make_shared<Registry>();
+
+    // 连接回调在epoll线程上执行，协程从这里开始运行
+    server.setConnectionHandler([&server, registry, handler](int client_id, const std::string &client_ip)
+                                {
+        auto state = std::make_shared<CoConnection::State>();
+        state->server = &server;
+        state->client_id = client_id;
+        state->reactor_index = server.getClientReactor(client_id);
+        state->client_ip = client_ip;
+        {
+            std::lock_guard<std::mutex> lock(registry->mutex);
+            registry->states[client_id] = state;
+        }
+        handler(CoConnection(state)); });
+
+    // 消息可能在工作线程上收到，投递回epoll线程后再恢复协程
+    server.setMessageHandler([&server, registry](int client_id, const std::string &message)
+                             {
+        auto state = registry->find(client_id);
+        if (!state)
+            return;
+        server.runOnReactor(state->reactor_index, [state, message] {
+            state->inbox.push_back(message);
+            state->resumeWaiting();
+        }); });
+
+    server.setDisconnectionHandler([&server, registry](int client_id)
+                                   {
+        std::shared_ptr<CoConnection::State> state;
+        {
+            std::lock_guard<std::mutex> lock(registry->mutex);
+            auto it = registry->states.find(client_id);
+            if (it == registry->states.end())
+                return;
+            state = it->second;
+            registry->states.erase(it);
+        }
+        server.runOnReactor(state->reactor_index, [state] {
+            state->closed = true;
+            state->resumeWaiting();
+        }); });
+}
+
+#endif
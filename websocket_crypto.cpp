@@ -0,0 +1,141 @@
+#include "websocket_crypto.h"
+#ifndef WEBSOCKET_NO_TLS
+#include <openssl/sha.h>
+#endif
+
+std::string computeAcceptKey(const std::string &key)
+{
+    std::string combined = key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    uint8_t digest[20];
+    sha1Digest(combined.data(), combined.size(), digest);
+    return base64Encode(digest, sizeof(digest));
+}
+
+#ifndef WEBSOCKET_NO_TLS
+
+void sha1Digest(const void *data, size_t length, uint8_t digest[20])
+{
+    SHA1(static_cast<const unsigned char *>(data), length, digest);
+}
+
+#else
+
+static uint32_t leftRotate(uint32_t value, int amount)
+{
+    return (value << amount) | (value >> (32 - amount));
+}
+
+static void processChunk(const uint8_t *chunk, uint32_t *h)
+{
+    uint32_t w[80];
+
+    // 复制块到w[0..15]
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = (chunk[i * 4] << 24) | (chunk[i * 4 + 1] << 16) | (chunk[i * 4 + 2] << 8) | chunk[i * 4 + 3];
+    }
+
+    // 扩展到w[16..79]
+    for (int i = 16; i < 80; i++)
+    {
+        w[i] = leftRotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++)
+    {
+        uint32_t f, k;
+        if (i < 20)
+        {
+            f = (b & c) | ((~b) & d);
+            k = 0x5A827999;
+        }
+        else if (i < 40)
+        {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        }
+        else if (i < 60)
+        {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        }
+        else
+        {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+
+        uint32_t temp = leftRotate(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = leftRotate(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+void sha1Digest(const void *data, size_t length, uint8_t digest[20])
+{
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+    // 填充：0x80，补零到 56 (mod 64) 字节，最后是64位的消息比特长度
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    std::string message(reinterpret_cast<const char *>(bytes), length);
+    uint64_t bit_length = static_cast<uint64_t>(length) * 8;
+    message.push_back(static_cast<char>(0x80));
+    while ((message.size() % 64) != 56)
+    {
+        message.push_back(0);
+    }
+    for (int i = 7; i >= 0; i--)
+    {
+        message.push_back(static_cast<char>((bit_length >> (i * 8)) & 0xFF));
+    }
+
+    for (size_t i = 0; i < message.size(); i += 64)
+    {
+        processChunk(reinterpret_cast<const uint8_t *>(message.data()) + i, h);
+    }
+
+    for (int i = 0; i < 5; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            digest[i * 4 + j] = static_cast<uint8_t>(h[i] >> ((3 - j) * 8));
+        }
+    }
+}
+
+#endif
+
+std::string base64Encode(const uint8_t *data, size_t length)
+{
+    static const char chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string result;
+    result.reserve((length + 2) / 3 * 4);
+
+    for (size_t i = 0; i < length; i += 3)
+    {
+        uint32_t value = 0;
+        int count = 0;
+        for (int j = 0; j < 3 && i + j < length; j++)
+        {
+            value = (value << 8) | data[i + j];
+            count++;
+        }
+        value <<= (3 - count) * 8;
+
+        for (int j = 0; j < 4; j++)
+        {
+            result += j <= count ? chars[(value >> (18 - j * 6)) & 0x3F] : '=';
+        }
+    }
+    return result;
+}
@@ -0,0 +1,17 @@
+#ifndef WEBSOCKET_CRYPTO_H
+#define WEBSOCKET_CRYPTO_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// 握手用到的 SHA-1 与 Base64。默认使用 OpenSSL 的 SHA-1；
+// 以 -DWEBSOCKET_NO_TLS 构建时使用内置实现，核心库不依赖 OpenSSL
+
+// 按 RFC 6455 由 Sec-WebSocket-Key 计算 Sec-WebSocket-Accept
+std::string computeAcceptKey(const std::string &key);
+
+void sha1Digest(const void *data, size_t length, uint8_t digest[20]);
+std::string base64Encode(const uint8_t *data, size_t length);
+
+#endif
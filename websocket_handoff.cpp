@@ -0,0 +1,215 @@
+#include "websocket_handoff.h"
+#include "websocket_log.h"
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// 记录头，后面依次跟着 client_ip、request_path、input、output、utf8_pending 五段数据
+struct HandoffHeader
+{
+    uint32_t type;
+    int32_t client_id;
+    uint32_t has_fd;
+    uint32_t message_opcode;
+    uint64_t message_bytes;
+    uint32_t lengths[5];
+};
+
+static bool makeUnixAddress(const std::string &path, struct sockaddr_un &addr)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+        WEBSOCKET_LOG_ERROR("Unix socket path too long: " << path);
+        return false;
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+int listenUnixSocket(const std::string &path)
+{
+    struct sockaddr_un addr;
+    if (!makeUnixAddress(path, addr))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    unlink(path.c_str());
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0)
+    {
+        WEBSOCKET_LOG_ERROR("Failed to listen on upgrade socket " << path << ": " << strerror(errno));
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int connectUnixSocket(const std::string &path)
+{
+    struct sockaddr_un addr;
+    if (!makeUnixAddress(path, addr))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool writeAll(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+static bool readAll(int fd, char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t n = read(fd, data, length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+bool writeHandoffEntry(int channel, const HandoffEntry &entry)
+{
+    const std::string *fields[5] = {&entry.client_ip, &entry.request_path, &entry.input, &entry.output,
+                                    &entry.message.utf8_pending};
+
+    HandoffHeader header;
+    header.type = static_cast<uint32_t>(entry.type);
+    header.client_id = entry.client_id;
+    header.has_fd = entry.fd >= 0;
+    header.message_opcode = entry.message.opcode;
+    header.message_bytes = entry.message.bytes;
+    for (int i = 0; i < 5; i++)
+    {
+        header.lengths[i] = static_cast<uint32_t>(fields[i]->size());
+    }
+
+    // fd 作为辅助数据随记录头一起发送
+    struct iovec iov;
+    iov.iov_base = &header;
+    iov.iov_len = sizeof(header);
+
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (entry.fd >= 0)
+    {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &entry.fd, sizeof(int));
+    }
+
+    ssize_t n;
+    do
+    {
+        n = sendmsg(channel, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+        return false;
+
+    if (!writeAll(channel, reinterpret_cast<const char *>(&header) + n, sizeof(header) - n))
+        return false;
+    for (int i = 0; i < 5; i++)
+    {
+        if (!writeAll(channel, fields[i]->data(), fields[i]->size()))
+            return false;
+    }
+    return true;
+}
+
+bool readHandoffEntry(int channel, HandoffEntry &entry)
+{
+    HandoffHeader header;
+    struct iovec iov;
+    iov.iov_base = &header;
+    iov.iov_len = sizeof(header);
+
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n;
+    do
+    {
+        n = recvmsg(channel, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+        return false;
+
+    entry.fd = -1;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            memcpy(&entry.fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+
+    if (!readAll(channel, reinterpret_cast<char *>(&header) + n, sizeof(header) - n) ||
+        (header.has_fd && entry.fd < 0))
+    {
+        if (entry.fd >= 0)
+            ::close(entry.fd);
+        return false;
+    }
+
+    entry.type = static_cast<HandoffType>(header.type);
+    entry.client_id = header.client_id;
+    entry.message.opcode = static_cast<uint8_t>(header.message_opcode);
+    entry.message.bytes = header.message_bytes;
+    std::string *fields[5] = {&entry.client_ip, &entry.request_path, &entry.input, &entry.output,
+                              &entry.message.utf8_pending};
+    for (int i = 0; i < 5; i++)
+    {
+        fields[i]->resize(header.lengths[i]);
+        if (header.lengths[i] > 0 && !readAll(channel, &(*fields[i])[0], header.lengths[i]))
+        {
+            if (entry.fd >= 0)
+                ::close(entry.fd);
+            return false;
+        }
+    }
+    return true;
+}
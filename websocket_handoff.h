@@ -0,0 +1,51 @@
+#ifndef WEBSOCKET_HANDOFF_H
+#define WEBSOCKET_HANDOFF_H
+
+#include <string>
+#include <cstdint>
+
+// 热升级：新进程通过Unix域socket连接旧进程，旧进程用 SCM_RIGHTS 把监听socket
+// 和已建立的连接（连同其协议状态）交给新进程，整个过程中TCP连接不会被重置。
+//
+// 通道上依次传输若干条记录，每条记录携带至多一个fd，最后以 End 结束；
+// 新进程接管完毕后回复一个字节的确认，旧进程收到后退出。
+
+enum class HandoffType : uint32_t
+{
+    Listener = 1,    // 监听socket，client_id 为所属epoll线程编号
+    Connection = 2,  // 已完成握手的连接
+    Handshaking = 3, // 尚未完成握手的连接，input 中为已收到的部分请求
+    End = 4
+};
+
+// 连接上未结束的分片消息，新进程接着解析后续的延续帧
+struct HandoffMessageState
+{
+    HandoffMessageState() : opcode(0), bytes(0) {}
+
+    uint8_t opcode;           // 未结束消息的类型（0x1/0x2），0 表示不在分片消息中
+    uint64_t bytes;           // 已收到的负载字节数，按累计长度检查消息大小上限
+    std::string utf8_pending; // 文本消息已收到部分末尾未完整的UTF-8序列（至多3字节）
+};
+
+struct HandoffEntry
+{
+    HandoffType type;
+    int client_id;
+    int fd; // 接收时为新进程中的fd，没有fd时为 -1
+    std::string client_ip;
+    std::string request_path;
+    std::string input;  // 已读入但尚未解析的入站数据
+    std::string output; // 尚未发出的出站数据
+    HandoffMessageState message;
+};
+
+// 在 path 上创建监听用的Unix域socket（会先删除遗留的socket文件）
+int listenUnixSocket(const std::string &path);
+// 连接 path 上的Unix域socket，没有进程在监听时返回 -1
+int connectUnixSocket(const std::string &path);
+
+bool writeHandoffEntry(int channel, const HandoffEntry &entry);
+bool readHandoffEntry(int channel, HandoffEntry &entry);
+
+#endif
@@ -0,0 +1,358 @@
+#include "websocket_ingest.h"
+#include "websocket_handoff.h"
+#include "websocket_log.h"
+#include <new>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint32_t ingest_magic = 0x57534952; // "WSIR"
+
+static size_t alignRecord(size_t length)
+{
+    return (length + ingest_record_alignment - 1) & ~(ingest_record_alignment - 1);
+}
+
+IngestRing::IngestRing()
+    : fd(-1), header(nullptr), data(nullptr), mapped_size(0), capacity_mask(0), consumer_count(0)
+{
+}
+
+IngestRing::~IngestRing()
+{
+    if (header)
+        munmap(header, mapped_size);
+    if (fd >= 0)
+        ::close(fd);
+}
+
+bool IngestRing::create(size_t capacity, size_t consumer_count)
+{
+    if (header || consumer_count == 0 || consumer_count > ingest_max_consumers)
+        return false;
+
+    size_t size = 4096;
+    while (size < capacity)
+        size <<= 1;
+
+    fd = memfd_create("websocket-ingest", MFD_CLOEXEC);
+    if (fd < 0)
+    {
+        WEBSOCKET_LOG_ERROR("Failed to create ingest ring: " << strerror(errno));
+        return false;
+    }
+    mapped_size = sizeof(IngestRingHeader) + size;
+    if (ftruncate(fd, mapped_size) < 0)
+    {
+        WEBSOCKET_LOG_ERROR("Failed to size ingest ring: " << strerror(errno));
+        return false;
+    }
+    void *p = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        WEBSOCKET_LOG_ERROR("Failed to map ingest ring: " << strerror(errno));
+        return false;
+    }
+
+    header = new (p) IngestRingHeader();
+    header->magic = ingest_magic;
+    header->consumer_count = static_cast<uint32_t>(consumer_count);
+    header->capacity = size;
+    header->producer.position.store(0);
+    header->producer.sleeping.store(0);
+    header->published.store(0);
+    header->rejected.store(0);
+    for (size_t i = 0; i < ingest_max_consumers; i++)
+    {
+        header->consumers[i].position.store(0);
+        header->consumers[i].sleeping.store(0);
+    }
+    data = static_cast<char *>(p) + sizeof(IngestRingHeader);
+    capacity_mask = size - 1;
+    this->consumer_count = static_cast<uint32_t>(consumer_count);
+    return true;
+}
+
+bool IngestRing::validRecord(const IngestRecordHeader &record, size_t offset, uint64_t available) const
+{
+    if (record.length < sizeof(IngestRecordHeader) || record.length % ingest_record_alignment != 0 ||
+        record.length > available || offset + record.length > capacity_mask + 1)
+        return false;
+    if (record.target == static_cast<uint8_t>(IngestTarget::Padding))
+        return true;
+    if (record.target < static_cast<uint8_t>(IngestTarget::Client) ||
+        record.target > static_cast<uint8_t>(IngestTarget::Broadcast) || (record.opcode != 1 && record.opcode != 2))
+        return false;
+    return sizeof(IngestRecordHeader) + static_cast<uint64_t>(record.topic_length) + record.payload_length <=
+           record.length;
+}
+
+bool IngestRing::prepareSleep(size_t consumer)
+{
+    IngestRingHeader::Cursor &cursor = header->consumers[consumer];
+    cursor.sleeping.store(1);
+    if (header->producer.position.load() != cursor.position.load(std::memory_order_relaxed))
+    {
+        cursor.sleeping.store(0, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void IngestRing::cancelSleep(size_t consumer)
+{
+    header->consumers[consumer].sleeping.store(0, std::memory_order_relaxed);
+}
+
+size_t IngestRing::getBacklog() const
+{
+    if (!header)
+        return 0;
+    uint64_t written = header->producer.position.load();
+    uint64_t slowest = written;
+    for (uint32_t i = 0; i < consumer_count; i++)
+        slowest = std::min<uint64_t>(slowest, header->consumers[i].position.load());
+    return static_cast<size_t>(written - slowest);
+}
+
+IngestProducer::IngestProducer()
+    : channel(-1), header(nullptr), data(nullptr), mapped_size(0), cached_min_read(0)
+{
+}
+
+IngestProducer::~IngestProducer()
+{
+    close();
+}
+
+bool IngestProducer::connect(const std::string &socket_path)
+{
+    if (header)
+        return false;
+
+    channel = connectUnixSocket(socket_path);
+    if (channel < 0)
+        return false;
+
+    // 一条消息携带环的fd和各消费者的eventfd，数据部分为fd的个数
+    uint32_t fd_count = 0;
+    struct iovec iov;
+    iov.iov_base = &fd_count;
+    iov.iov_len = sizeof(fd_count);
+
+    char control[CMSG_SPACE(sizeof(int) * (ingest_max_consumers + 1))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n;
+    do
+    {
+        n = recvmsg(channel, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    } while (n < 0 && errno == EINTR);
+
+    std::vector<int> fds;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); n > 0 && cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int *received = reinterpret_cast<const int *>(CMSG_DATA(cmsg));
+            fds.assign(received, received + count);
+        }
+    }
+    if (n != sizeof(fd_count) || fds.size() != fd_count || fds.size() < 2)
+    {
+        // 服务器已有生产者时直接关闭连接
+        for (int fd : fds)
+            ::close(fd);
+        close();
+        return false;
+    }
+
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fds[0], &st) == 0 && static_cast<size_t>(st.st_size) > sizeof(IngestRingHeader))
+        p = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    ::close(fds[0]);
+    wake_fds.assign(fds.begin() + 1, fds.end());
+    if (p == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+
+    header = static_cast<IngestRingHeader *>(p);
+    mapped_size = st.st_size;
+    data = static_cast<char *>(p) + sizeof(IngestRingHeader);
+    if (header->magic != ingest_magic || header->consumer_count != wake_fds.size() ||
+        sizeof(IngestRingHeader) + header->capacity != mapped_size)
+    {
+        WEBSOCKET_LOG_ERROR("Ingest ring layout mismatch");
+        close();
+        return false;
+    }
+    cached_min_read = minReadPosition();
+    return true;
+}
+
+bool IngestProducer::isConnected() const
+{
+    if (!header)
+        return false;
+    char byte;
+    ssize_t n = recv(channel, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n > 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+void IngestProducer::close()
+{
+    if (header)
+    {
+        munmap(header, mapped_size);
+        header = nullptr;
+        data = nullptr;
+    }
+    for (int fd : wake_fds)
+        ::close(fd);
+    wake_fds.clear();
+    if (channel >= 0)
+    {
+        ::close(channel);
+        channel = -1;
+    }
+}
+
+uint64_t IngestProducer::minReadPosition() const
+{
+    uint64_t slowest = header->producer.position.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < header->consumer_count; i++)
+        slowest = std::min<uint64_t>(slowest, header->consumers[i].position.load(std::memory_order_acquire));
+    return slowest;
+}
+
+bool IngestProducer::sendToClient(int client_id, const char *payload, size_t length, bool binary)
+{
+    return publish(IngestTarget::Client, client_id, nullptr, 0, payload, length, binary);
+}
+
+bool IngestProducer::sendToTopic(const std::string &topic, const char *payload, size_t length, bool binary)
+{
+    return publish(IngestTarget::Topic, -1, topic.data(), topic.size(), payload, length, binary);
+}
+
+bool IngestProducer::broadcast(const char *payload, size_t length, bool binary)
+{
+    return publish(IngestTarget::Broadcast, -1, nullptr, 0, payload, length, binary);
+}
+
+bool IngestProducer::publish(IngestTarget target, int client_id, const char *topic, size_t topic_length,
+                             const char *payload, size_t length, bool binary)
+{
+    if (!header)
+        return false;
+
+    // 单条记录不超过环的四分之一，环尾放不下时先写一条填充记录
+    uint64_t capacity = header->capacity;
+    size_t needed = alignRecord(sizeof(IngestRecordHeader) + topic_length + length);
+    if (topic_length > UINT16_MAX || needed > capacity / 4)
+    {
+        header->rejected.store(header->rejected.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    uint64_t position = header->producer.position.load(std::memory_order_relaxed);
+    size_t offset = static_cast<size_t>(position & (capacity - 1));
+    size_t tail = static_cast<size_t>(capacity - offset);
+    size_t total = needed + (tail < needed ? tail : 0);
+    if (position + total - cached_min_read > capacity)
+    {
+        cached_min_read = minReadPosition();
+        if (position + total - cached_min_read > capacity)
+        {
+            header->rejected.store(header->rejected.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+
+    if (tail < needed)
+    {
+        IngestRecordHeader *padding = reinterpret_cast<IngestRecordHeader *>(data + offset);
+        padding->length = static_cast<uint32_t>(tail);
+        padding->target = static_cast<uint8_t>(IngestTarget::Padding);
+        position += tail;
+        offset = 0;
+    }
+
+    IngestRecordHeader *record = reinterpret_cast<IngestRecordHeader *>(data + offset);
+    record->length = static_cast<uint32_t>(needed);
+    record->target = static_cast<uint8_t>(target);
+    record->opcode = binary ? 0x2 : 0x1;
+    record->topic_length = static_cast<uint16_t>(topic_length);
+    record->client_id = client_id;
+    record->payload_length = static_cast<uint32_t>(length);
+    char *body = reinterpret_cast<char *>(record + 1);
+    if (topic_length > 0)
+        memcpy(body, topic, topic_length);
+    memcpy(body + topic_length, payload, length);
+
+    // 发布位置与读取休眠标记之间需要全序，与消费者的 prepareSleep 配对，不会漏掉唤醒
+    header->producer.position.store(position + needed);
+    header->published.store(header->published.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    for (size_t i = 0; i < wake_fds.size(); i++)
+    {
+        IngestRingHeader::Cursor &cursor = header->consumers[i];
+        if (cursor.sleeping.load() && cursor.sleeping.exchange(0))
+        {
+            uint64_t one = 1;
+            if (write(wake_fds[i], &one, sizeof(one)) < 0 && errno != EAGAIN)
+            {
+                WEBSOCKET_LOG_WARN("Failed to wake ingest consumer " << i << ": " << strerror(errno));
+            }
+        }
+    }
+    return true;
+}
+
+bool sendIngestFds(int channel, int ring_fd, const std::vector<int> &wake_fds)
+{
+    if (wake_fds.empty() || wake_fds.size() > ingest_max_consumers)
+        return false;
+
+    std::vector<int> fds;
+    fds.push_back(ring_fd);
+    fds.insert(fds.end(), wake_fds.begin(), wake_fds.end());
+
+    uint32_t fd_count = static_cast<uint32_t>(fds.size());
+    struct iovec iov;
+    iov.iov_base = &fd_count;
+    iov.iov_len = sizeof(fd_count);
+
+    char control[CMSG_SPACE(sizeof(int) * (ingest_max_consumers + 1))];
+    memset(control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+    ssize_t n;
+    do
+    {
+        n = sendmsg(channel, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n == sizeof(fd_count);
+}
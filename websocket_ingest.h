@@ -0,0 +1,178 @@
+#ifndef WEBSOCKET_INGEST_H
+#define WEBSOCKET_INGEST_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// 外部进程注入消息的共享内存环形队列：一个生产者（如行情进程），每个epoll线程各是一个消费者。
+//
+// 服务器创建环（memfd）并在Unix域socket上等待生产者，生产者连接后经 SCM_RIGHTS 取得环和
+// 各epoll线程的唤醒eventfd，此后写入记录不再经过socket。每个消费者都读取全部记录，
+// 只处理归自己的连接，因此同一连接收到的消息保持写入顺序。
+//
+// 消费者没有数据可读、准备进入 epoll_wait 前在环头中标记休眠，生产者写入后只对
+// 标记了休眠的消费者写eventfd，持续有数据时写入路径上没有系统调用。
+
+// 记录的投递目标
+enum class IngestTarget : uint8_t
+{
+    Client = 1,    // 指定客户端ID
+    Topic = 2,     // 握手请求路径等于 topic 的所有客户端
+    Broadcast = 3, // 所有客户端
+    Padding = 4    // 环尾的填充，消费者跳过
+};
+
+// 记录头，后面依次跟着 topic 和 payload，整条记录按 ingest_record_alignment 对齐且不会跨越环尾
+struct IngestRecordHeader
+{
+    uint32_t length;       // 整条记录（含记录头和对齐填充）的长度
+    uint8_t target;        // IngestTarget
+    uint8_t opcode;        // 帧类型：1 文本，2 二进制
+    uint16_t topic_length;
+    int32_t client_id;
+    uint32_t payload_length;
+};
+
+static const size_t ingest_record_alignment = 16;
+static const size_t ingest_max_consumers = 64;
+
+// 位于共享内存开头，数据区紧随其后；生产者和消费者的游标各占一个缓存行，避免伪共享
+struct IngestRingHeader
+{
+    uint32_t magic;
+    uint32_t consumer_count;
+    uint64_t capacity; // 数据区字节数（2的幂）
+
+    struct alignas(64) Cursor
+    {
+        std::atomic<uint64_t> position; // 累计写入/读取的字节数
+        std::atomic<uint32_t> sleeping; // 消费者：已准备进入 epoll_wait，需要唤醒
+    };
+
+    Cursor producer;
+    std::atomic<uint64_t> published; // 生产者写入的记录数
+    std::atomic<uint64_t> rejected;  // 因环已满而被拒绝的记录数
+    Cursor consumers[ingest_max_consumers];
+};
+
+// 服务器一侧：创建环，供各epoll线程消费
+class IngestRing
+{
+public:
+    IngestRing();
+    ~IngestRing();
+
+    // capacity 向上取整为2的幂
+    bool create(size_t capacity, size_t consumer_count);
+    int getFd() const { return fd; }
+
+    // 消费者 consumer 依次处理至多 limit 条记录，返回处理的记录数。
+    // handler(const IngestRecordHeader &, const char *topic, const char *payload)
+    //
+    // 共享内存由另一个进程写入，其中的游标和记录头都不可信：容量用创建时缓存的值，记录头先拷贝
+    // 再校验，handler 看到的长度不会在读取期间被改写。遇到越界或不完整的记录时 corrupt 置为 true，
+    // 跳过环中已写入的全部数据，由调用方断开生产者
+    template <class Handler>
+    size_t consume(size_t consumer, size_t limit, Handler handler, bool &corrupt)
+    {
+        IngestRingHeader::Cursor &cursor = header->consumers[consumer];
+        uint64_t read = cursor.position.load(std::memory_order_relaxed);
+        uint64_t written = header->producer.position.load(std::memory_order_acquire);
+        size_t count = 0;
+        corrupt = written - read > capacity_mask + 1;
+        while (!corrupt && read != written && count < limit)
+        {
+            size_t offset = static_cast<size_t>(read & capacity_mask);
+            IngestRecordHeader record;
+            std::memcpy(&record, data + offset, sizeof(record));
+            if (!validRecord(record, offset, written - read))
+            {
+                corrupt = true;
+                break;
+            }
+            if (record.target != static_cast<uint8_t>(IngestTarget::Padding))
+            {
+                const char *topic = data + offset + sizeof(record);
+                handler(record, topic, topic + record.topic_length);
+                count++;
+            }
+            read += record.length;
+        }
+        cursor.position.store(corrupt ? written : read, std::memory_order_release);
+        return count;
+    }
+
+    bool hasPending(size_t consumer) const
+    {
+        return header->consumers[consumer].position.load(std::memory_order_relaxed) !=
+               header->producer.position.load(std::memory_order_acquire);
+    }
+
+    // 准备休眠：标记后再次检查，仍有未读记录时撤销标记并返回 false
+    bool prepareSleep(size_t consumer);
+    // epoll_wait 返回后撤销休眠标记
+    void cancelSleep(size_t consumer);
+
+    // 生产者写入的记录数、因环满被拒绝的记录数、最慢的消费者落后的字节数
+    uint64_t getPublished() const { return header ? header->published.load() : 0; }
+    uint64_t getRejected() const { return header ? header->rejected.load() : 0; }
+    size_t getBacklog() const;
+
+private:
+    int fd;
+    IngestRingHeader *header;
+    char *data;
+    size_t mapped_size;
+    uint64_t capacity_mask;  // 创建时的容量减一，不从共享内存重新读取
+    uint32_t consumer_count; // 同上
+
+    // 记录头是否合法：长度对齐、不跨越环尾、不超出已写入的范围（available），且容得下 topic 和 payload
+    bool validRecord(const IngestRecordHeader &record, size_t offset, uint64_t available) const;
+
+    IngestRing(const IngestRing &) = delete;
+    IngestRing &operator=(const IngestRing &) = delete;
+};
+
+// 生产者一侧（在外部进程中使用，只需链接核心库）：同一时刻只允许一个生产者连接
+class IngestProducer
+{
+public:
+    IngestProducer();
+    ~IngestProducer();
+
+    // 连接服务器的注入socket并映射环，服务器已有生产者连接时返回 false
+    bool connect(const std::string &socket_path);
+    void close();
+    // 服务器是否仍在（检查注入socket是否已被对端关闭）。写入持续失败时用它判断是否需要重新连接，
+    // 例如服务器热升级后旧进程退出，生产者需要连接新进程
+    bool isConnected() const;
+
+    // 写入一条记录；环已满（最慢的消费者尚未读完）时返回 false，由调用方决定重试或丢弃
+    bool sendToClient(int client_id, const char *payload, size_t length, bool binary = false);
+    bool sendToTopic(const std::string &topic, const char *payload, size_t length, bool binary = false);
+    bool broadcast(const char *payload, size_t length, bool binary = false);
+
+private:
+    int channel;
+    IngestRingHeader *header;
+    char *data;
+    size_t mapped_size;
+    std::vector<int> wake_fds;
+    uint64_t cached_min_read; // 上次计算出的最慢消费者位置，空间够用时不必重新扫描
+
+    bool publish(IngestTarget target, int client_id, const char *topic, size_t topic_length,
+                 const char *payload, size_t length, bool binary);
+    uint64_t minReadPosition() const;
+
+    IngestProducer(const IngestProducer &) = delete;
+    IngestProducer &operator=(const IngestProducer &) = delete;
+};
+
+// 服务器把环和各消费者的唤醒eventfd一次交给生产者
+bool sendIngestFds(int channel, int ring_fd, const std::vector<int> &wake_fds);
+
+#endif
@@ -0,0 +1,347 @@
+#include "websocket_log.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <cerrno>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+static const size_t log_ring_bytes = 256 * 1024; // 每个线程的环
+static const size_t log_line_bytes = 1024;       // 单条日志的上限，超出部分截断
+static const std::chrono::milliseconds log_flush_interval(10);
+static const std::chrono::milliseconds log_busy_flush_interval(1); // 上一轮取到日志时缩短间隔
+
+std::atomic<int> AsyncLogger::min_level(WEBSOCKET_LOG_MIN_LEVEL);
+std::atomic<uint32_t> AsyncLogger::rate_limit(100);
+std::atomic<uint64_t> AsyncLogger::suppressed(0);
+
+namespace
+{
+    // 记录格式：4字节长度 + 4字节级别 + 内容，跨越环尾时分两段拷贝
+    struct LogRecordHeader
+    {
+        uint32_t length;
+        uint32_t level;
+    };
+
+    // 单生产者（所属线程）单消费者（持有 drain_mutex 的线程）字节环
+    struct LogRing
+    {
+        std::atomic<uint64_t> head; // 生产者写到的位置
+        std::atomic<uint64_t> tail; // 消费者读到的位置
+        std::atomic<uint64_t> lines;
+        std::atomic<uint64_t> dropped;
+        std::atomic<bool> abandoned; // 所属线程已退出，取空后移除
+        uint64_t reported_dropped;   // 消费者已报告过的丢弃条数
+        char data[log_ring_bytes];
+
+        LogRing() : head(0), tail(0), lines(0), dropped(0), abandoned(false), reported_dropped(0) {}
+
+        void copyIn(uint64_t position, const void *src, size_t length)
+        {
+            size_t offset = position % log_ring_bytes;
+            size_t first = std::min(length, log_ring_bytes - offset);
+            memcpy(data + offset, src, first);
+            memcpy(data, static_cast<const char *>(src) + first, length - first);
+        }
+
+        void copyOut(uint64_t position, void *dst, size_t length) const
+        {
+            size_t offset = position % log_ring_bytes;
+            size_t first = std::min(length, log_ring_bytes - offset);
+            memcpy(dst, data + offset, first);
+            memcpy(static_cast<char *>(dst) + first, data, length - first);
+        }
+    };
+
+    // 写入定长数组的流缓冲区，写满后丢弃多余的字符
+    class LineBuffer : public std::streambuf
+    {
+    public:
+        LineBuffer() { reset(); }
+        void reset() { setp(line, line + sizeof(line)); }
+        const char *data() const { return pbase(); }
+        size_t size() const { return static_cast<size_t>(pptr() - pbase()); }
+
+    protected:
+        int_type overflow(int_type ch) override { return traits_type::not_eof(ch); }
+
+    private:
+        char line[log_line_bytes];
+    };
+
+    class LoggerCore
+    {
+    public:
+        LoggerCore() : stopping(false), retired_lines(0), retired_dropped(0) {}
+
+        ~LoggerCore()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wakeup.notify_one();
+            if (flusher.joinable())
+                flusher.join();
+            drain();
+        }
+
+        std::shared_ptr<LogRing> registerThread()
+        {
+            std::shared_ptr<LogRing> ring = std::make_shared<LogRing>();
+            std::lock_guard<std::mutex> lock(mutex);
+            rings.push_back(ring);
+            if (!flusher.joinable() && !stopping)
+                flusher = std::thread([this]
+                                      { run(); });
+            return ring;
+        }
+
+        // 取空所有线程的环并写出，返回取出的条数；同一时刻只有一个消费者
+        size_t drain()
+        {
+            std::lock_guard<std::mutex> drain_lock(drain_mutex);
+            std::vector<std::shared_ptr<LogRing>> snapshot;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                snapshot = rings;
+            }
+
+            std::string out, err;
+            size_t drained = 0;
+            uint64_t newly_dropped = 0;
+            for (const std::shared_ptr<LogRing> &ring : snapshot)
+            {
+                uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+                uint64_t head = ring->head.load(std::memory_order_acquire);
+                while (tail < head)
+                {
+                    LogRecordHeader header;
+                    ring->copyOut(tail, &header, sizeof(header));
+                    std::string &target = header.level >= static_cast<uint32_t>(LogLevel::Warn) ? err : out;
+                    size_t offset = target.size();
+                    target.resize(offset + header.length + 1);
+                    ring->copyOut(tail + sizeof(header), &target[offset], header.length);
+                    target[offset + header.length] = '\n';
+                    tail += sizeof(header) + header.length;
+                    drained++;
+                }
+                ring->tail.store(tail, std::memory_order_release);
+
+                uint64_t dropped = ring->dropped.load(std::memory_order_relaxed);
+                newly_dropped += dropped - ring->reported_dropped;
+                ring->reported_dropped = dropped;
+            }
+            if (newly_dropped > 0)
+            {
+                err += "Log buffer full, dropped " + std::to_string(newly_dropped) + " messages\n";
+            }
+            writeAll(STDOUT_FILENO, out);
+            writeAll(STDERR_FILENO, err);
+
+            // 已退出线程的环取空后移除
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < rings.size();)
+            {
+                LogRing &ring = *rings[i];
+                if (ring.abandoned.load() && ring.tail.load() == ring.head.load())
+                {
+                    retired_lines += ring.lines.load();
+                    retired_dropped += ring.dropped.load();
+                    rings[i] = rings.back();
+                    rings.pop_back();
+                }
+                else
+                {
+                    i++;
+                }
+            }
+            return drained;
+        }
+
+        void getStats(uint64_t &lines, uint64_t &dropped)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            lines = retired_lines;
+            dropped = retired_dropped;
+            for (const std::shared_ptr<LogRing> &ring : rings)
+            {
+                lines += ring->lines.load(std::memory_order_relaxed);
+                dropped += ring->dropped.load(std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        std::mutex mutex; // 保护 rings、stopping 和统计
+        std::mutex drain_mutex;
+        std::condition_variable wakeup;
+        std::vector<std::shared_ptr<LogRing>> rings;
+        std::thread flusher;
+        bool stopping;
+        uint64_t retired_lines;
+        uint64_t retired_dropped;
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            bool busy = false;
+            while (!stopping)
+            {
+                // 写日志的线程从不唤醒刷新线程（那需要系统调用），日志多时由刷新线程自己加快轮询
+                wakeup.wait_for(lock, busy ? log_busy_flush_interval : log_flush_interval);
+                lock.unlock();
+                busy = drain() > 0;
+                lock.lock();
+            }
+        }
+
+        static void writeAll(int fd, const std::string &data)
+        {
+            const char *p = data.data();
+            size_t remaining = data.size();
+            while (remaining > 0)
+            {
+                ssize_t n = write(fd, p, remaining);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return;
+                p += n;
+                remaining -= n;
+            }
+        }
+    };
+
+    LoggerCore &core()
+    {
+        static LoggerCore instance;
+        return instance;
+    }
+
+    // 每个线程的格式化状态和环，线程退出时把环交给刷新线程取空后释放
+    struct ThreadLog
+    {
+        LineBuffer buffer;
+        std::ostream stream;
+        std::shared_ptr<LogRing> ring;
+        bool busy; // 格式化参数时又写日志（如 operator<< 中），内层的直接丢弃
+
+        ThreadLog() : stream(&buffer), busy(false) {}
+        ~ThreadLog()
+        {
+            if (ring)
+                ring->abandoned.store(true);
+        }
+    };
+
+    thread_local ThreadLog thread_log;
+}
+
+bool LogRateLimit::allow(uint64_t &suppressed_before)
+{
+    suppressed_before = 0;
+    uint32_t limit = AsyncLogger::rate_limit.load(std::memory_order_relaxed);
+    if (limit == 0)
+        return true;
+
+    // steady_clock 经 vDSO 读取，不进入内核
+    int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count();
+    int64_t current = window.load(std::memory_order_relaxed);
+    if (current != now && window.compare_exchange_strong(current, now, std::memory_order_relaxed))
+    {
+        count.store(0, std::memory_order_relaxed);
+    }
+    if (count.fetch_add(1, std::memory_order_relaxed) < limit)
+    {
+        if (suppressed.load(std::memory_order_relaxed) > 0)
+            suppressed_before = suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+    suppressed.fetch_add(1, std::memory_order_relaxed);
+    AsyncLogger::suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void AsyncLogger::setLevel(LogLevel level)
+{
+    min_level = std::max(static_cast<int>(level), WEBSOCKET_LOG_MIN_LEVEL);
+}
+
+void AsyncLogger::setRateLimit(uint32_t lines_per_second)
+{
+    rate_limit = lines_per_second;
+}
+
+void AsyncLogger::flush()
+{
+    core().drain();
+}
+
+AsyncLogger::Stats AsyncLogger::getStats()
+{
+    Stats stats;
+    core().getStats(stats.lines, stats.dropped);
+    stats.suppressed = suppressed.load();
+    return stats;
+}
+
+LogLine::LogLine(LogLevel level, LogRateLimit &limit) : level(level), suppressed_before(0), out(nullptr)
+{
+    ThreadLog &log = thread_log;
+    if (log.busy || !limit.allow(suppressed_before))
+        return;
+
+    log.busy = true;
+    log.buffer.reset();
+    log.stream.clear();
+    log.stream.flags(std::ios_base::dec | std::ios_base::skipws);
+    log.stream.width(0);
+    log.stream.precision(6);
+    log.stream.fill(' ');
+    out = &log.stream;
+}
+
+LogLine::~LogLine()
+{
+    if (!out)
+        return;
+
+    ThreadLog &log = thread_log;
+    if (suppressed_before > 0)
+    {
+        log.stream << " (" << suppressed_before << " similar messages suppressed)";
+    }
+    if (!log.ring)
+    {
+        log.ring = core().registerThread();
+    }
+
+    LogRing &ring = *log.ring;
+    LogRecordHeader header;
+    header.length = static_cast<uint32_t>(log.buffer.size());
+    header.level = static_cast<uint32_t>(level);
+    size_t needed = sizeof(header) + header.length;
+
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head + needed - ring.tail.load(std::memory_order_acquire) > log_ring_bytes)
+    {
+        ring.dropped.store(ring.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    else
+    {
+        ring.copyIn(head, &header, sizeof(header));
+        ring.copyIn(head + sizeof(header), log.buffer.data(), header.length);
+        ring.head.store(head + needed, std::memory_order_release);
+        ring.lines.store(ring.lines.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    log.busy = false;
+}
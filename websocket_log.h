@@ -0,0 +1,141 @@
+#ifndef WEBSOCKET_LOG_H
+#define WEBSOCKET_LOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <ostream>
+
+// 异步分级日志：日志语句在调用线程中格式化到线程自己的定长行缓冲区，再拷贝进本线程的单生产者
+// 字节环，不加锁、不分配内存、不做系统调用；后台刷新线程每10毫秒（有日志时每毫秒）取空各线程的环，
+// 信息和调试日志一次 write 到标准输出，警告和错误写到标准错误。环满时丢弃新日志并计数，不会阻塞调用线程。
+//
+// 同一线程的日志保持顺序，不同线程之间的先后只按刷新批次近似。每个日志语句（调用点）每秒最多输出
+// setRateLimit 条，被抑制的条数附在该调用点下一条输出的日志后面。
+// 低于 WEBSOCKET_LOG_MIN_LEVEL 的日志语句在编译期去掉，参数不会被求值
+
+enum class LogLevel : int
+{
+    Debug = 0,
+    Info = 1,
+    Warn = 2,
+    Error = 3,
+    Off = 4
+};
+
+#ifndef WEBSOCKET_LOG_MIN_LEVEL
+#define WEBSOCKET_LOG_MIN_LEVEL 1
+#endif
+
+// 单个调用点的频率限制，由日志宏以静态变量的形式创建
+class LogRateLimit
+{
+public:
+    LogRateLimit() : window(0), count(0), suppressed(0) {}
+
+    // 本秒内未超过上限时返回 true，suppressed_before 取出此前被抑制的条数
+    bool allow(uint64_t &suppressed_before);
+
+private:
+    std::atomic<int64_t> window; // 当前计数所属的秒
+    std::atomic<uint32_t> count;
+    std::atomic<uint64_t> suppressed;
+};
+
+class AsyncLogger
+{
+public:
+    struct Stats
+    {
+        uint64_t lines;      // 已写入环的日志条数
+        uint64_t dropped;    // 环满丢弃的条数
+        uint64_t suppressed; // 因频率限制未输出的条数
+    };
+
+    // 运行时级别，只能在编译期级别的基础上进一步提高
+    static void setLevel(LogLevel level);
+    static bool isEnabled(LogLevel level)
+    {
+        return static_cast<int>(level) >= min_level.load(std::memory_order_relaxed);
+    }
+    // 每个调用点每秒最多输出的条数，0 表示不限制（默认100）
+    static void setRateLimit(uint32_t lines_per_second);
+    static uint32_t getRateLimit() { return rate_limit.load(std::memory_order_relaxed); }
+
+    // 在调用线程中立即输出所有线程已写入的日志（启动、停止等需要与标准输出上其他内容保持顺序时）
+    static void flush();
+    static Stats getStats();
+
+private:
+    friend class LogLine;
+    friend class LogRateLimit;
+
+    static std::atomic<int> min_level;
+    static std::atomic<uint32_t> rate_limit;
+    static std::atomic<uint64_t> suppressed;
+};
+
+// 一条日志：构造时取得本线程的行缓冲区，析构时提交到本线程的环
+class LogLine
+{
+public:
+    LogLine(LogLevel level, LogRateLimit &limit);
+    ~LogLine();
+
+    explicit operator bool() const { return out != nullptr; }
+    std::ostream &stream() { return *out; }
+
+private:
+    LogLevel level;
+    uint64_t suppressed_before;
+    std::ostream *out;
+
+    LogLine(const LogLine &) = delete;
+    LogLine &operator=(const LogLine &) = delete;
+};
+
+#define WEBSOCKET_LOG(level, ...)                                        \
+    do                                                                   \
+    {                                                                    \
+        if (AsyncLogger::isEnabled(level))                               \
+        {                                                                \
+            static LogRateLimit websocket_log_limit;                     \
+            LogLine websocket_log_line(level, websocket_log_limit);      \
+            if (websocket_log_line)                                      \
+                websocket_log_line.stream() << __VA_ARGS__;              \
+        }                                                                \
+    } while (0)
+
+// 编译期关闭的级别：语句只做类型检查（其中用到的变量不会被视为未使用），不生成代码，参数不求值
+#define WEBSOCKET_LOG_DISABLED(...)                                      \
+    do                                                                   \
+    {                                                                    \
+        if (false)                                                       \
+            *static_cast<std::ostream *>(nullptr) << __VA_ARGS__;        \
+    } while (0)
+
+#if WEBSOCKET_LOG_MIN_LEVEL <= 0
+#define WEBSOCKET_LOG_DEBUG(...) WEBSOCKET_LOG(LogLevel::Debug, __VA_ARGS__)
+#else
+#define WEBSOCKET_LOG_DEBUG(...) WEBSOCKET_LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#if WEBSOCKET_LOG_MIN_LEVEL <= 1
+#define WEBSOCKET_LOG_INFO(...) WEBSOCKET_LOG(LogLevel::Info, __VA_ARGS__)
+#else
+#define WEBSOCKET_LOG_INFO(...) WEBSOCKET_LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#if WEBSOCKET_LOG_MIN_LEVEL <= 2
+#define WEBSOCKET_LOG_WARN(...) WEBSOCKET_LOG(LogLevel::Warn, __VA_ARGS__)
+#else
+#define WEBSOCKET_LOG_WARN(...) WEBSOCKET_LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#if WEBSOCKET_LOG_MIN_LEVEL <= 3
+#define WEBSOCKET_LOG_ERROR(...) WEBSOCKET_LOG(LogLevel::Error, __VA_ARGS__)
+#else
+#define WEBSOCKET_LOG_ERROR(...) WEBSOCKET_LOG_DISABLED(__VA_ARGS__)
+#endif
+
+#endif
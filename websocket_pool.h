@@ -0,0 +1,97 @@
+#ifndef WEBSOCKET_POOL_H
+#define WEBSOCKET_POOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+
+// 固定大小内存块的空闲链表：释放的块留给下一次分配复用，向系统按批申请，
+// 省去每个对象单独 malloc 的头部开销和碎片。块一旦申请就不再归还系统，
+// 因此占用量等于历史上同时存在的对象数的峰值
+template <size_t Size>
+class BlockPool
+{
+public:
+    static BlockPool &instance()
+    {
+        // 有意不析构：进程退出时仍可能有线程在释放连接对象
+        static BlockPool *pool = new BlockPool();
+        return *pool;
+    }
+
+    void *allocate()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!free_list)
+            grow();
+        Block *block = free_list;
+        free_list = block->next;
+        return block;
+    }
+
+    void deallocate(void *p)
+    {
+        Block *block = static_cast<Block *>(p);
+        std::lock_guard<std::mutex> lock(mutex);
+        block->next = free_list;
+        free_list = block;
+    }
+
+private:
+    union Block
+    {
+        Block *next;
+        alignas(std::max_align_t) unsigned char storage[Size];
+    };
+
+    std::mutex mutex;
+    Block *free_list;
+
+    BlockPool() : free_list(nullptr) {}
+
+    void grow()
+    {
+        static const size_t blocks_per_batch = 256;
+        Block *batch = static_cast<Block *>(::operator new(sizeof(Block) * blocks_per_batch));
+        for (size_t i = 0; i < blocks_per_batch; i++)
+        {
+            batch[i].next = free_list;
+            free_list = &batch[i];
+        }
+    }
+};
+
+// 从 BlockPool 分配单个对象的分配器，配合 std::allocate_shared 使用时
+// 对象和 shared_ptr 控制块位于同一个池化的块中
+template <class T>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+
+    PoolAllocator() {}
+    template <class U>
+    PoolAllocator(const PoolAllocator<U> &) {}
+
+    T *allocate(size_t n)
+    {
+        if (n != 1)
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        return static_cast<T *>(BlockPool<sizeof(T)>::instance().allocate());
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+        if (n != 1)
+            ::operator delete(p);
+        else
+            BlockPool<sizeof(T)>::instance().deallocate(p);
+    }
+};
+
+template <class T, class U>
+bool operator==(const PoolAllocator<T> &, const PoolAllocator<U> &) { return true; }
+template <class T, class U>
+bool operator!=(const PoolAllocator<T> &, const PoolAllocator<U> &) { return false; }
+
+#endif
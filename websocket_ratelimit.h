@@ -0,0 +1,137 @@
+#ifndef WEBSOCKET_RATELIMIT_H
+#define WEBSOCKET_RATELIMIT_H
+
+#include <chrono>
+#include <mutex>
+#include <cstdint>
+#include <algorithm>
+
+// 令牌桶：每秒补充 rate 个令牌，最多积攒 burst 个。
+// 读取前只检查余额，读到多少再扣多少，所以余额可以透支为负，透支越多恢复读取前等待越久
+class TokenBucket
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    TokenBucket() : rate(0), burst(0), tokens(0) {}
+
+    // rate 为 0 表示不限速
+    void configure(double rate_per_sec, double burst_size, Clock::time_point now)
+    {
+        rate = rate_per_sec;
+        burst = burst_size;
+        tokens = burst_size;
+        last = now;
+    }
+
+    bool enabled() const { return rate > 0; }
+
+    void consume(double amount, Clock::time_point now)
+    {
+        refill(now);
+        tokens -= amount;
+    }
+
+    // 余额恢复为非负还需要等待的时间，0 表示可以继续读取
+    std::chrono::microseconds delay(Clock::time_point now)
+    {
+        refill(now);
+        if (tokens >= 0)
+            return std::chrono::microseconds(0);
+        return std::chrono::microseconds(static_cast<int64_t>(-tokens / rate * 1000000.0) + 1);
+    }
+
+private:
+    double rate;
+    double burst;
+    double tokens;
+    Clock::time_point last;
+
+    void refill(Clock::time_point now)
+    {
+        double elapsed = std::chrono::duration<double>(now - last).count();
+        last = now;
+        tokens = std::min(burst, tokens + elapsed * rate);
+    }
+};
+
+// 一条连接（或同一IP的所有连接）的限速与计量状态：消息数和字节数各一个令牌桶，
+// 另按约一秒的窗口统计实际速率。只在每次读取后记账、每次派发前检查，开销与连接数无关
+class RateLimiter
+{
+public:
+    typedef TokenBucket::Clock Clock;
+
+    RateLimiter()
+        : window_start(Clock::now()), window_messages(0), window_bytes(0), message_rate(0), byte_rate(0)
+    {
+    }
+
+    // 上限为 0 表示不限；突发容量为一秒的额度
+    void configure(double messages_per_sec, double bytes_per_sec)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Clock::time_point now = Clock::now();
+        messages.configure(messages_per_sec, messages_per_sec, now);
+        bytes.configure(bytes_per_sec, bytes_per_sec, now);
+    }
+
+    // 记录一次读取取出的消息数和负载字节数
+    void record(size_t message_count, size_t byte_count)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Clock::time_point now = Clock::now();
+        if (messages.enabled())
+            messages.consume(static_cast<double>(message_count), now);
+        if (bytes.enabled())
+            bytes.consume(static_cast<double>(byte_count), now);
+
+        rollWindow(now);
+        window_messages += message_count;
+        window_bytes += byte_count;
+    }
+
+    // 恢复读取前需要等待的时间，0 表示未超限
+    std::chrono::microseconds delay()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Clock::time_point now = Clock::now();
+        return std::max(messages.enabled() ? messages.delay(now) : std::chrono::microseconds(0),
+                        bytes.enabled() ? bytes.delay(now) : std::chrono::microseconds(0));
+    }
+
+    // 最近一个统计窗口内的实际速率
+    void getRates(double &messages_per_sec, double &bytes_per_sec)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        rollWindow(Clock::now());
+        messages_per_sec = message_rate;
+        bytes_per_sec = byte_rate;
+    }
+
+private:
+    std::mutex mutex;
+    TokenBucket messages;
+    TokenBucket bytes;
+
+    Clock::time_point window_start;
+    uint64_t window_messages;
+    uint64_t window_bytes;
+    double message_rate;
+    double byte_rate;
+
+    void rollWindow(Clock::time_point now)
+    {
+        double elapsed = std::chrono::duration<double>(now - window_start).count();
+        if (elapsed < 1.0)
+            return;
+
+        message_rate = window_messages / elapsed;
+        byte_rate = window_bytes / elapsed;
+        window_start = now;
+        window_messages = 0;
+        window_bytes = 0;
+    }
+};
+
+#endif
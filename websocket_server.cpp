@@ -1,51 +1,432 @@
-#include <openssl/sha.h>
 #include "websocket_server.h"
 #include <sstream>
+#include <algorithm>
 #include <iomanip>
 #include <regex>
 #include <cstring>
 #include <cerrno>
+#include <fstream>
+#include <cstdlib>
+#include <climits>
+#include <csignal>
+#include <exception>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/un.h>
+#include <netinet/tcp.h>
+#include "websocket_utf8.h"
+#include "websocket_crypto.h"
+#include "websocket_pool.h"
+#include "websocket_log.h"
+#include <dirent.h>
+#include <sched.h>
+#include <pthread.h>
+
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49
+#endif
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1u << 28)
+#endif
+
+// socket 的地址族，失败时返回 -1
+static int socketDomain(int fd)
+{
+    int domain = -1;
+    socklen_t length = sizeof(domain);
+    if (getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &domain, &length) < 0)
+        return -1;
+    return domain;
+}
 
-// WebSocketConnection 实现
-WebSocketConnection::WebSocketConnection(int socket_fd, const std::string &client_ip)
-    : socket_fd(socket_fd), client_ip(client_ip), connected(false)
+// 解析 /sys 中的 cpulist 格式（如 "0-3,8-11"）
+static std::vector<int> parseCpuList(const std::string &list)
+{
+    std::vector<int> cpus;
+    std::istringstream iss(list);
+    std::string range;
+    while (std::getline(iss, range, ','))
+    {
+        if (range.empty())
+            continue;
+        size_t dash = range.find('-');
+        int first = std::atoi(range.substr(0, dash).c_str());
+        int last = dash == std::string::npos ? first : std::atoi(range.substr(dash + 1).c_str());
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// 读取系统NUMA拓扑，返回 CPU编号 -> NUMA节点 的映射
+static std::vector<int> loadNumaTopology()
+{
+    std::vector<int> cpu_to_node;
+    DIR *dir = opendir("/sys/devices/system/node");
+    if (!dir)
+        return cpu_to_node;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        int node;
+        if (sscanf(entry->d_name, "node%d", &node) != 1)
+            continue;
+
+        std::ifstream file(std::string("/sys/devices/system/node/") + entry->d_name + "/cpulist");
+        std::string list;
+        std::getline(file, list);
+        for (int cpu : parseCpuList(list))
+        {
+            if (cpu >= static_cast<int>(cpu_to_node.size()))
+                cpu_to_node.resize(cpu + 1, -1);
+            cpu_to_node[cpu] = node;
+        }
+    }
+    closedir(dir);
+    return cpu_to_node;
+}
+
+static const std::vector<int> &numaTopology()
+{
+    static const std::vector<int> topology = loadNumaTopology();
+    return topology;
+}
+
+static int cpuToNumaNode(int cpu)
+{
+    const std::vector<int> &topology = numaTopology();
+    if (cpu < 0 || cpu >= static_cast<int>(topology.size()))
+        return -1;
+    return topology[cpu];
+}
+
+// 当前线程所在CPU的NUMA节点
+static int currentNumaNode()
+{
+    return cpuToNumaNode(sched_getcpu());
+}
+
+static size_t numaNodeCount()
 {
-    if (performHandshake())
+    const std::vector<int> &topology = numaTopology();
+    int max_node = -1;
+    for (int node : topology)
+        max_node = std::max(max_node, node);
+    return max_node + 1;
+}
+
+// 读取 /proc/net/netstat 中 TcpExt 的全连接队列溢出计数
+static void readListenCounters(uint64_t &overflows, uint64_t &drops)
+{
+    overflows = 0;
+    drops = 0;
+
+    // 文件由成对的行组成：一行字段名，一行对应的值
+    std::ifstream file("/proc/net/netstat");
+    std::string names, values;
+    while (std::getline(file, names) && std::getline(file, values))
     {
-        connected = true;
-        std::cout << "WebSocket handshake successful with " << client_ip << std::endl;
+        if (names.compare(0, 7, "TcpExt:") != 0)
+            continue;
+
+        std::istringstream name_stream(names), value_stream(values);
+        std::string name, value;
+        while (name_stream >> name && value_stream >> value)
+        {
+            if (name == "ListenOverflows")
+                overflows = std::strtoull(value.c_str(), nullptr, 10);
+            else if (name == "ListenDrops")
+                drops = std::strtoull(value.c_str(), nullptr, 10);
+        }
     }
+}
+
+// 连接对象（连同 shared_ptr 控制块）从块池分配，断开后留给下一个连接复用
+static std::shared_ptr<WebSocketConnection> newConnection(int socket_fd, const struct sockaddr *peer_addr,
+                                                          TlsContext *tls)
+{
+    return std::allocate_shared<WebSocketConnection>(PoolAllocator<WebSocketConnection>(), socket_fd, peer_addr, tls);
+}
+
+// 缓冲区用完时，容量超过该值就整块释放，空闲连接不长期占着读写大消息时扩出来的内存
+static const size_t idle_buffer_capacity = 4096;
+
+static void releaseBuffer(std::string &buffer)
+{
+    if (buffer.capacity() > idle_buffer_capacity)
+        std::string().swap(buffer);
     else
+        buffer.clear();
+}
+
+// 每次读取的默认上限：读满后交回epoll线程重新派发，其他连接的读取可以插进来
+static const size_t connection_read_budget = 256 * 1024;
+
+// 默认的单条消息负载上限
+static const size_t default_max_message_size = 16 * 1024 * 1024;
+
+// WebSocketConnection 实现
+WebSocketConnection::WebSocketConnection(int socket_fd, const struct sockaddr *peer, TlsContext *tls)
+    : socket_fd(socket_fd), connected(false), closed(false), pending_tasks(0), reactor_index(-1),
+      inline_dispatch(false), closed_by_peer(false), tls(tls), ssl(nullptr), socket_bio(false), tls_established(false), ktls_send(false),
+      read_limit(connection_read_budget), input_pending(false), peer_shutdown(false), read_state(ReadIdle), in_offset(0),
+      max_message_size(0), message_opcode(0), message_bytes(0), tls_out_offset(0), urgent_offset(0), bulk_unit_left(0),
+      closing(false), lingering(false), pending_output(false)
+{
+    memset(&peer_addr, 0, sizeof(peer_addr));
+    if (peer && peer->sa_family == AF_INET)
+        memcpy(&peer_addr.v4, peer, sizeof(peer_addr.v4));
+    else if (peer && peer->sa_family == AF_INET6)
+        memcpy(&peer_addr.v6, peer, sizeof(peer_addr.v6));
+    else if (peer && peer->sa_family == AF_UNIX)
+        peer_addr.sa.sa_family = AF_UNIX; // 客户端一般不绑定路径，只记录地址族
+
+    if (tls)
     {
-        std::cout << "WebSocket handshake failed with " << client_ip << std::endl;
-        ::close(socket_fd);
+        ssl = tls->createSession(socket_fd);
+        socket_bio = tls->isKtlsEnabled();
     }
 }
 
+std::string WebSocketConnection::getClientIP() const
+{
+    char text[INET6_ADDRSTRLEN];
+    if (peer_addr.sa.sa_family == AF_INET)
+        inet_ntop(AF_INET, &peer_addr.v4.sin_addr, text, sizeof(text));
+    else if (peer_addr.sa.sa_family == AF_INET6 && IN6_IS_ADDR_V4MAPPED(&peer_addr.v6.sin6_addr))
+        inet_ntop(AF_INET, &peer_addr.v6.sin6_addr.s6_addr[12], text, sizeof(text)); // 双栈监听上的IPv4客户端
+    else if (peer_addr.sa.sa_family == AF_INET6)
+        inet_ntop(AF_INET6, &peer_addr.v6.sin6_addr, text, sizeof(text));
+    else if (peer_addr.sa.sa_family == AF_UNIX)
+        return "unix";
+    else
+        return "unknown";
+    return text;
+}
+
 WebSocketConnection::~WebSocketConnection()
 {
     close();
+#ifndef WEBSOCKET_NO_TLS
+    if (ssl)
+    {
+        SSL_free(ssl);
+    }
+#endif
+    ::close(socket_fd);
 }
 
 void WebSocketConnection::close()
 {
-    if (connected.exchange(false))
+    connected = false;
+
+    // 等待正在进行的读写结束后再 shutdown，之后的读写都会在 closed 检查处停下
+    std::lock_guard<std::mutex> recv_lock(recv_mutex);
+    std::unique_lock<std::mutex> tls_lock(tls_mutex, std::defer_lock);
+    if (ssl)
+    {
+        tls_lock.lock();
+    }
+    std::lock_guard<std::mutex> send_lock(send_mutex);
+    if (closed)
+        return;
+
+    // 主动关闭（已排队 close 帧或握手拒绝响应）时先尽量写出它们，之后只半关闭写方向：对端读完后看到EOF，
+    // fd 由所属epoll线程读完对端的剩余数据后再关闭（见 WebSocketServer::lingerSocket），
+    // 直接关闭还有未读数据的socket会发出RST，对端可能来不及读到这些数据
+    lingering = closing;
+    if (closing)
+    {
+        flushLocked();
+    }
+
+    // 尚未写出的消息随连接一起丢弃；合并队列中的帧先交给会话编号保存，客户端恢复时重放
+    if (session && conflated)
+    {
+        releaseConflated();
+    }
+    discardBulk();
+    urgent.clear();
+    urgent_offset = 0;
+
+#ifndef WEBSOCKET_NO_TLS
+    // 尽力发送 close_notify，未正常关闭的TLS会话会被标记为不可恢复
+    if (ssl && tls_established)
     {
-        ::close(socket_fd);
+        SSL_shutdown(ssl);
+        if (!socket_bio)
+        {
+            moveTlsOutput();
+            flushLocked();
+        }
     }
+#endif
+    closed = true;
+    ::shutdown(socket_fd, lingering ? SHUT_WR : SHUT_RDWR);
+    tls_out.clear();
+    pending_output = false;
 }
 
-bool WebSocketConnection::performHandshake()
+bool WebSocketConnection::detach(std::string &input, std::string &output, HandoffMessageState &message)
 {
-    char buffer[4096];
-    int bytes_received = recv(socket_fd, buffer, sizeof(buffer) - 1, 0);
-    if (bytes_received <= 0)
+    if (ssl)
     {
+        if (connected)
+        {
+            sendClose(1001, false);
+        }
+        return false;
+    }
+
+    std::lock_guard<std::mutex> recv_lock(recv_mutex);
+    std::lock_guard<std::mutex> send_lock(send_mutex);
+    if (closed)
         return false;
+
+    // 先尽量发送，剩下的交给新进程
+    flushLocked();
+    input.assign(in_buffer, in_offset, std::string::npos);
+    message.opcode = message_opcode;
+    message.bytes = message_bytes;
+    message.utf8_pending = message_opcode == 0x1 ? utf8_stream.pendingBytes() : std::string();
+    output.clear();
+    for (auto &chunk : outbound)
+    {
+        if (chunk.file_fd < 0)
+        {
+            output.append(chunk.data, chunk.offset, std::string::npos);
+            continue;
+        }
+
+        // 文件区间读出后随出站数据一起交接
+        size_t start = output.size();
+        output.resize(start + chunk.file_remaining);
+        size_t done = 0;
+        while (done < chunk.file_remaining)
+        {
+            ssize_t n = pread(chunk.file_fd, &output[start + done], chunk.file_remaining - done,
+                              chunk.file_offset + done);
+            if (n <= 0)
+                break;
+            done += n;
+        }
+        output.resize(start + done);
+        ::close(chunk.file_fd);
+    }
+    outbound.clear();
+    if (conflated)
+    {
+        for (auto &item : conflated->frames)
+        {
+            output.append(item.second);
+        }
+        conflated.reset();
+    }
+
+    // 尚未写出的紧急帧排在普通通道当前帧的剩余部分之后
+    if (urgent_offset < urgent.size())
+    {
+        size_t boundary = std::min(bulk_unit_left, output.size());
+        output.insert(boundary, urgent, urgent_offset, std::string::npos);
+    }
+    urgent.clear();
+    urgent_offset = 0;
+    pending_output = false;
+
+    // socket 由调用方交给新进程，本进程的fd在连接对象释放时关闭，这里不再触碰
+    connected = false;
+    closed = true;
+    return true;
+}
+
+void WebSocketConnection::restore(const std::string &path, const std::string &input, const std::string &output,
+                                  const HandoffMessageState &message, bool established)
+{
+    request_path = path;
+    in_buffer = input;
+    in_offset = 0;
+    // 交接时正处于分片消息中间：后续的延续帧接着这条消息解析（计入大小上限，文本接着校验UTF-8）
+    if (message.opcode == 0x1 || message.opcode == 0x2)
+    {
+        message_opcode = message.opcode;
+        message_bytes = message.bytes;
+        if (message.opcode == 0x1 && !utf8_stream.restore(message.utf8_pending))
+            message_opcode = 0;
     }
+    if (!output.empty())
+    {
+        // 交接过来的数据可能从某个帧的中间开始，整体作为一个不可拆分的单元
+        outputBuffer().append(output);
+        bulk_unit_left = output.size();
+        pending_output = true;
+    }
+    connected = established;
+}
+
+WebSocketConnection::HandshakeState WebSocketConnection::continueHandshake(bool reject)
+{
+    // 握手请求头的最大长度
+    static const size_t max_request_size = 8192;
+
+    std::lock_guard<std::mutex> lock(recv_mutex);
+    if (closed || (tls && !ssl))
+        return HandshakeState::Failed;
+
+    bool open = readInput();
+    if (ssl && !tls_established)
+        return open ? HandshakeState::InProgress : HandshakeState::Failed;
+
+    size_t header_end = in_buffer.find("\r\n\r\n", in_offset);
+    if (header_end == std::string::npos)
+    {
+        if (!open || in_buffer.size() - in_offset > max_request_size)
+            return HandshakeState::Failed;
+        return HandshakeState::InProgress;
+    }
+
+    std::string request = in_buffer.substr(in_offset, header_end + 4 - in_offset);
+    in_offset = header_end + 4;
+
+    if (reject)
+    {
+        static const char response[] = "HTTP/1.1 503 Service Unavailable\r\n"
+                                       "Retry-After: 1\r\n"
+                                       "Content-Length: 0\r\n"
+                                       "Connection: close\r\n"
+                                       "\r\n";
+        // 走紧急通道并按 close 帧处理：关闭时先写出，之后半关闭写方向，客户端能读到完整的响应
+        queueUrgent(response, sizeof(response) - 1, true);
+        return HandshakeState::Rejected;
+    }
+
+    if (!open || !performHandshake(request))
+        return HandshakeState::Failed;
+
+    // 大多数客户端握手后不会紧跟着发帧，请求占用的缓冲区直接释放
+    if (in_offset == in_buffer.size())
+    {
+        std::string().swap(in_buffer);
+        in_offset = 0;
+    }
+    connected = true;
+    return HandshakeState::Completed;
+}
 
-    buffer[bytes_received] = '\0';
-    std::string request(buffer);
+bool WebSocketConnection::performHandshake(const std::string &request)
+{
+    // 请求行形如 "GET /path HTTP/1.1"，记录路径用于按路由选择派发模式
+    size_t path_start = request.find(' ');
+    size_t path_end = path_start == std::string::npos ? std::string::npos : request.find(' ', path_start + 1);
+    if (path_end != std::string::npos)
+    {
+        request_path = request.substr(path_start + 1, path_end - path_start - 1);
+    }
+    if (session_handshake)
+    {
+        parseSessionParams();
+    }
 
     // 解析WebSocket握手请求
     std::regex key_regex("Sec-WebSocket-Key: ([^\r\n]+)");
@@ -57,548 +438,3531 @@ bool WebSocketConnection::performHandshake()
     }
 
     std::string websocket_key = match[1].str();
-    std::string accept_key = generateAcceptKey(websocket_key);
+    std::string accept_key = computeAcceptKey(websocket_key);
 
     // 构建响应
     std::ostringstream response;
     response << "HTTP/1.1 101 Switching Protocols\r\n"
              << "Upgrade: websocket\r\n"
              << "Connection: Upgrade\r\n"
-             << "Sec-WebSocket-Accept: " << accept_key << "\r\n"
-             << "\r\n";
+             << "Sec-WebSocket-Accept: " << accept_key << "\r\n";
+
+    // 会话恢复：确定会话令牌后由 acceptSession 补上响应头发出
+    if (session_handshake)
+    {
+        session_handshake->response = response.str();
+        return true;
+    }
+    response << "\r\n";
 
     std::string response_str = response.str();
-    return send(socket_fd, response_str.c_str(), response_str.length(), 0) > 0;
+    return queueResponse(response_str.c_str(), response_str.length());
 }
 
-std::string WebSocketConnection::generateAcceptKey(const std::string &key)
+void WebSocketConnection::parseSessionParams()
 {
-    std::string magic_string = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
-    std::string combined = key + magic_string;
-
-    unsigned char hash[SHA_DIGEST_LENGTH];
-    SHA1(reinterpret_cast<const unsigned char *>(combined.c_str()), combined.length(), hash);
+    // 从查询串中取出 session 和 last_seq，其余参数保留在路径中，路由和主题匹配不受影响
+    size_t query = request_path.find('?');
+    if (query == std::string::npos)
+        return;
 
-    std::vector<uint8_t> hash_vec(hash, hash + SHA_DIGEST_LENGTH);
-    return base64Encode(hash_vec);
+    std::string kept;
+    size_t start = query + 1;
+    while (start <= request_path.size())
+    {
+        size_t end = request_path.find('&', start);
+        if (end == std::string::npos)
+            end = request_path.size();
+        std::string param = request_path.substr(start, end - start);
+        if (param.compare(0, 8, "session=") == 0)
+        {
+            session_handshake->token = param.substr(8);
+        }
+        else if (param.compare(0, 9, "last_seq=") == 0)
+        {
+            session_handshake->last_seq = std::strtoull(param.c_str() + 9, nullptr, 10);
+        }
+        else if (!param.empty())
+        {
+            kept += kept.empty() ? "?" : "&";
+            kept += param;
+        }
+        start = end + 1;
+    }
+    request_path = request_path.substr(0, query) + kept;
 }
 
-std::string WebSocketConnection::base64Encode(const std::vector<uint8_t> &input)
+void WebSocketConnection::enableSessionHandshake()
 {
-    BIO *bio, *b64;
-    BUF_MEM *bufferPtr;
+    session_handshake.reset(new SessionHandshake());
+    session_handshake->last_seq = 0;
+}
 
-    b64 = BIO_new(BIO_f_base64());
-    bio = BIO_new(BIO_s_mem());
-    bio = BIO_push(b64, bio);
+bool WebSocketConnection::getResumeRequest(std::string &token, uint64_t &last_seq) const
+{
+    if (!session_handshake || session_handshake->token.empty())
+        return false;
+    token = session_handshake->token;
+    last_seq = session_handshake->last_seq;
+    return true;
+}
 
-    BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
-    BIO_write(bio, input.data(), input.size());
-    BIO_flush(bio);
-    BIO_get_mem_ptr(bio, &bufferPtr);
+bool WebSocketConnection::acceptSession(const std::shared_ptr<ReplaySession> &replay_session,
+                                        const std::vector<std::string> &replay)
+{
+    if (!session_handshake)
+        return false;
 
-    std::string result(bufferPtr->data, bufferPtr->length);
-    BIO_free_all(bio);
+    std::string response = session_handshake->response;
+    response += "X-Session-Token: " + replay_session->getToken() + "\r\n\r\n";
+    session_handshake.reset();
+    if (!queueResponse(response.data(), response.size()))
+        return false;
 
-    return result;
+    // 重放的帧已经编过号，设置会话之前入队，不会被重复保存
+    for (const std::string &frame : replay)
+    {
+        queueOutput(frame.data(), frame.size());
+    }
+    session = replay_session;
+    return true;
 }
 
 bool WebSocketConnection::sendMessage(const std::string &message)
 {
-    if (!connected)
+    // 启用会话恢复时，连接断开后发出的消息仍交给会话保存
+    if (!connected && !session)
         return false;
 
-    std::lock_guard<std::mutex> lock(send_mutex);
     std::string frame = encodeFrame(message);
+    return queueOutput(frame.c_str(), frame.length());
+}
+
+bool WebSocketConnection::sendFrame(const std::string &frame)
+{
+    if (!connected && !session)
+        return false;
 
-    int bytes_sent = send(socket_fd, frame.c_str(), frame.length(), 0);
-    return bytes_sent > 0;
+    return queueOutput(frame.data(), frame.size());
 }
 
-std::string WebSocketConnection::receiveMessage()
+bool WebSocketConnection::sendUrgent(const std::string &message)
 {
-    if (!connected)
-        return "";
+    if (!connected && !session)
+        return false;
+
+    std::string frame = encodeFrame(message);
+    return queueUrgent(frame.data(), frame.size());
+}
 
-    std::vector<uint8_t> buffer(4096);
-    int bytes_received = recv(socket_fd, buffer.data(), buffer.size(), 0);
+bool WebSocketConnection::receiveMessages(std::vector<std::string> &messages)
+{
+    std::lock_guard<std::mutex> lock(recv_mutex);
+    if (closed)
+        return false;
 
-    if (bytes_received <= 0)
+    size_t first = messages.size();
+    input_pending = false;
+    bool open = readInput();
+    extractMessages(messages);
+    if (!open)
     {
         connected = false;
-        return "";
     }
 
-    buffer.resize(bytes_received);
-    return decodeFrame(buffer);
+    // 限速记账：按取出的消息数和负载字节数扣减令牌
+    size_t bytes = 0;
+    for (size_t i = first; i < messages.size(); i++)
+    {
+        bytes += messages[i].size();
+    }
+    rate_limiter.record(messages.size() - first, bytes);
+    if (ip_rate_limiter)
+    {
+        ip_rate_limiter->record(messages.size() - first, bytes);
+    }
+    return connected;
+}
+
+bool WebSocketConnection::acquireRead()
+{
+    int state = read_state.load();
+    for (;;)
+    {
+        if (state == ReadIdle)
+        {
+            if (read_state.compare_exchange_weak(state, ReadOwned))
+                return true;
+        }
+        else if (state == ReadOwnedDirty || read_state.compare_exchange_weak(state, ReadOwnedDirty))
+        {
+            // 读取者释放时看到标记，会重新派发
+            return false;
+        }
+    }
 }
 
-std::string WebSocketConnection::encodeFrame(const std::string &payload)
+std::chrono::microseconds WebSocketConnection::rateLimitDelay()
+{
+    std::chrono::microseconds delay = rate_limiter.delay();
+    if (ip_rate_limiter)
+    {
+        delay = std::max(delay, ip_rate_limiter->delay());
+    }
+    return delay;
+}
+
+bool WebSocketConnection::readInput()
+{
+#ifdef WEBSOCKET_NO_TLS
+    return readSocket();
+#else
+    if (!ssl)
+        return readSocket();
+
+    std::lock_guard<std::mutex> tls_lock(tls_mutex);
+
+    // 内存BIO模式：先把密文读入rbio；即使对端已关闭也先处理已收到的数据
+    bool open = socket_bio ? true : readSocket();
+
+    if (!tls_established)
+    {
+        int ret = SSL_do_handshake(ssl);
+        if (ret == 1)
+        {
+            tls_established = true;
+            ktls_send = socket_bio && BIO_get_ktls_send(SSL_get_wbio(ssl));
+            tls->recordHandshake(ssl);
+        }
+        else
+        {
+            int err = SSL_get_error(ssl, ret);
+            if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE)
+            {
+                tls->recordFailure();
+                open = false;
+            }
+        }
+    }
+
+    if (tls_established)
+    {
+        static thread_local std::vector<char> plain;
+        plain.resize(16384);
+        size_t total = 0;
+        while (true)
+        {
+            int n = SSL_read(ssl, plain.data(), static_cast<int>(plain.size()));
+            if (n > 0)
+            {
+                in_buffer.append(plain.data(), n);
+                total += n;
+                if (read_limit > 0 && total >= read_limit)
+                {
+                    input_pending = true;
+                    break;
+                }
+                continue;
+            }
+            int err = SSL_get_error(ssl, n);
+            if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE)
+            {
+                open = false;
+            }
+            break;
+        }
+    }
+
+    // 握手消息、会话票据等由SSL内部产生的输出
+    std::lock_guard<std::mutex> send_lock(send_mutex);
+    if (!socket_bio)
+    {
+        moveTlsOutput();
+    }
+    if (!closed && !flushLocked())
+    {
+        open = false;
+    }
+    return open;
+#endif
+}
+
+bool WebSocketConnection::readSocket()
+{
+    // 线程私有的接收缓冲区：由（已绑核的）工作线程首次访问，
+    // 按Linux首次访问策略分配在该线程所在的NUMA节点上，并在后续读取中复用
+    static thread_local std::vector<char> buffer;
+    buffer.resize(16384);
+
+    size_t total = 0;
+    while (true)
+    {
+        ssize_t bytes_received = recv(socket_fd, buffer.data(), buffer.size(), 0);
+        if (bytes_received > 0)
+        {
+#ifndef WEBSOCKET_NO_TLS
+            if (ssl)
+            {
+                BIO_write(SSL_get_rbio(ssl), buffer.data(), static_cast<int>(bytes_received));
+            }
+            else
+#endif
+            {
+                in_buffer.append(buffer.data(), bytes_received);
+            }
+
+            // 没有读满说明内核缓冲区已空，省去一次以EAGAIN结束的recv；
+            // 对端已关闭写方向时EOF不会再产生边缘事件，需要继续读到EOF
+            if (static_cast<size_t>(bytes_received) < buffer.size() && !peer_shutdown)
+                return true;
+
+            // 读到单次上限时停下，剩余数据不会再产生边缘事件，由调用方重新派发
+            total += bytes_received;
+            if (read_limit > 0 && total >= read_limit)
+            {
+                input_pending = true;
+                return true;
+            }
+            continue;
+        }
+        if (bytes_received == 0)
+            return false;
+        if (errno == EINTR)
+            continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+void WebSocketConnection::extractMessages(std::vector<std::string> &messages)
+{
+    while (in_offset < in_buffer.size())
+    {
+        uint8_t opcode = 0;
+        uint16_t close_status = 0;
+        std::string payload;
+        size_t consumed = decodeFrame(reinterpret_cast<const uint8_t *>(in_buffer.data()) + in_offset,
+                                      in_buffer.size() - in_offset, opcode, payload, close_status);
+        if (consumed == 0)
+            break;
+
+        in_offset += consumed;
+        if (close_status != 0)
+        {
+            // 按 RFC 6455 关闭连接：1002 分片顺序错误，1007 文本帧不是合法的UTF-8，1009 消息超出大小上限
+            sendClose(close_status, true);
+            connected = false;
+            break;
+        }
+        if (opcode == 0x8)
+        { // Close frame
+            closed_by_peer = true;
+            connected = false;
+            break;
+        }
+        if (opcode == 0x9)
+        { // Ping：负载原样放入 pong，走紧急通道，不被出站积压拖住
+            std::string pong = encodeFrameHeader(0xA, payload.size());
+            pong.append(payload);
+            queueUrgent(pong.data(), pong.size());
+            continue;
+        }
+        if (opcode == 0xA)
+        { // Pong：心跳回应，不交给消息回调
+            continue;
+        }
+        messages.push_back(std::move(payload));
+    }
+
+    // 丢弃已处理的数据，只保留不完整的帧
+    if (in_offset == in_buffer.size())
+    {
+        releaseBuffer(in_buffer);
+        in_offset = 0;
+    }
+    else if (in_offset > 0)
+    {
+        in_buffer.erase(0, in_offset);
+        in_offset = 0;
+    }
+}
+
+bool WebSocketConnection::queueOutput(const char *data, size_t length)
 {
-    std::vector<uint8_t> frame;
+    std::unique_lock<std::mutex> tls_lock(tls_mutex, std::defer_lock);
+    if (ssl)
+    {
+        tls_lock.lock();
+    }
+    std::lock_guard<std::mutex> lock(send_mutex);
+    if (session)
+    {
+        session->retain(this, data, length);
+    }
+    return queueLocked(data, length);
+}
 
-    // FIN=1, RSV=000, Opcode=0001 (text frame)
-    frame.push_back(0x81);
+bool WebSocketConnection::queueLocked(const char *data, size_t length)
+{
+    if (closed || closing)
+        return false;
+
+    if (ssl && !socket_bio)
+    {
+        if (!tls_established)
+            return false;
+
+        // 内存BIO模式：没有积压时直接加密整条消息，否则以明文排队，写socket前才加密，紧急帧才能插到前面
+        if (tls_out.empty() && outbound.empty() && urgent.empty())
+        {
+            if (!encrypt(data, length))
+                return false;
+            advanceBulk(data, length, length);
+        }
+        else
+        {
+            outputBuffer().append(data, length);
+            pending_output = true;
+        }
+        return flushLocked();
+    }
+
+    // 没有积压时直接写socket，写不下的部分再放入出站队列，由EPOLLOUT事件继续发送
+    while (outbound.empty() && urgent.empty() && length > 0)
+    {
+        ssize_t bytes_sent = writeSome(data, length);
+        if (bytes_sent < 0)
+        {
+            connected = false;
+            return false;
+        }
+        if (bytes_sent == 0)
+            break;
+        advanceBulk(data, bytes_sent, length);
+        data += bytes_sent;
+        length -= bytes_sent;
+    }
+    if (length > 0)
+    {
+        outputBuffer().append(data, length);
+        pending_output = true;
+    }
+    return true;
+}
+
+bool WebSocketConnection::queueResponse(const char *data, size_t length)
+{
+    std::unique_lock<std::mutex> tls_lock(tls_mutex, std::defer_lock);
+    if (ssl)
+    {
+        tls_lock.lock();
+    }
+    std::lock_guard<std::mutex> lock(send_mutex);
+
+    // HTTP响应不是帧，整体作为一个不可拆分的单元（握手阶段出站队列中只有它）
+    bulk_unit_left += length;
+    return queueLocked(data, length);
+}
+
+bool WebSocketConnection::queueUrgent(const char *data, size_t length, bool close_frame)
+{
+    std::unique_lock<std::mutex> tls_lock(tls_mutex, std::defer_lock);
+    if (ssl)
+    {
+        tls_lock.lock();
+    }
+    std::lock_guard<std::mutex> lock(send_mutex);
+    bool session_frame = session && (data[0] & 0x0F) < 0x8;
+    if (session_frame)
+    {
+        session->retain(this, data, length);
+    }
+    if (closed || closing)
+        return false;
+
+    // 会话中的数据帧按到达客户端的顺序编号：普通通道有积压时不插队，按普通顺序发送
+    if (session_frame && (!outbound.empty() || conflated))
+        return queueLocked(data, length);
+
+    // kTLS 模式下 SSL_write 在写不下时必须以相同的数据重试，无法插队，按普通顺序发送
+    if (socket_bio)
+    {
+        bool queued = queueLocked(data, length);
+        closing = close_frame;
+        return queued;
+    }
+
+    urgent.append(data, length);
+    closing = close_frame;
+    pending_output = true;
+    return flushLocked();
+}
+bool WebSocketConnection::sendFile(int file_fd, off_t offset, size_t length)
+{
+    if (!connected)
+        return false;
+
+    std::string header = encodeFrameHeader(0x2, length);
+
+    // 帧头和文件内容在同一次加锁内入队，不会与其他消息交错
+    std::unique_lock<std::mutex> tls_lock(tls_mutex, std::defer_lock);
+    if (ssl)
+    {
+        tls_lock.lock();
+    }
+    std::lock_guard<std::mutex> lock(send_mutex);
+    if (closed)
+        return false;
+    if (session)
+    {
+        // 文件内容不保存，恢复时需要重放这一帧的请求会失败
+        session->skip(this);
+    }
+
+    // 复制一份fd，调用方返回后即可关闭自己的fd；用户态加密时也按文件区间排队，
+    // 由 flushLocked 在socket可写时每次读出64KB加密发送（见 loadFileChunk）
+    int dup_fd = length > 0 ? fcntl(file_fd, F_DUPFD_CLOEXEC, 0) : -1;
+    if (length > 0 && dup_fd < 0)
+        return false;
+
+    if (!queueLocked(header.data(), header.size()))
+    {
+        if (dup_fd >= 0)
+            ::close(dup_fd);
+        return false;
+    }
+    if (dup_fd < 0)
+        return true;
+
+    OutboundChunk file_chunk;
+    file_chunk.offset = 0;
+    file_chunk.file_fd = dup_fd;
+    file_chunk.file_offset = offset;
+    file_chunk.file_remaining = length;
+    outbound.push_back(std::move(file_chunk));
+    pending_output = true;
+    return flushLocked();
+}
+
+bool WebSocketConnection::sendConflated(const std::string &key, const std::string &message)
+{
+    if (!connected && !session)
+        return false;
+
+    std::string frame = encodeFrame(message);
+
+    std::unique_lock<std::mutex> tls_lock(tls_mutex, std::defer_lock);
+    if (ssl)
+    {
+        tls_lock.lock();
+    }
+    std::lock_guard<std::mutex> lock(send_mutex);
+    if (closed)
+    {
+        if (session)
+            session->retain(this, frame.data(), frame.size());
+        return false;
+    }
+
+    // 没有积压时与普通消息一样直接发送
+    if (outbound.empty() && !conflated && urgent.empty() && tls_out.empty())
+    {
+        if (session)
+            session->retain(this, frame.data(), frame.size());
+        return queueLocked(frame.data(), frame.size());
+    }
+
+    if (!conflated)
+        conflated.reset(new ConflatedQueue());
+    auto it = conflated->index.find(key);
+    if (it != conflated->index.end())
+    {
+        it->second->second.swap(frame);
+        return true;
+    }
+    conflated->frames.push_back(std::make_pair(key, std::move(frame)));
+    conflated->index[key] = std::prev(conflated->frames.end());
+    pending_output = true;
+    return true;
+}
+
+std::string &WebSocketConnection::outputBuffer()
+{
+    // 连续的内存数据合并到队尾同一段中
+    if (outbound.empty() || outbound.back().file_fd >= 0)
+    {
+        OutboundChunk chunk;
+        chunk.offset = 0;
+        chunk.file_fd = -1;
+        chunk.file_offset = 0;
+        chunk.file_remaining = 0;
+        outbound.push_back(std::move(chunk));
+    }
+    return outbound.back().data;
+}
+
+void WebSocketConnection::moveTlsOutput()
+{
+#ifndef WEBSOCKET_NO_TLS
+    BIO *wbio = SSL_get_wbio(ssl);
+    size_t pending = BIO_ctrl_pending(wbio);
+    if (pending == 0)
+        return;
+
+    size_t old_size = tls_out.size();
+    tls_out.resize(old_size + pending);
+    int n = BIO_read(wbio, &tls_out[old_size], static_cast<int>(pending));
+    tls_out.resize(old_size + std::max(n, 0));
+    pending_output = true;
+#endif
+}
+
+bool WebSocketConnection::encrypt(const char *data, size_t length)
+{
+#ifdef WEBSOCKET_NO_TLS
+    (void)data;
+    (void)length;
+    return false;
+#else
+    // 开启了部分写入，每次可能只写一个记录；内存BIO不会写满，总能全部写入
+    while (length > 0)
+    {
+        int written = SSL_write(ssl, data, static_cast<int>(std::min<size_t>(length, INT_MAX)));
+        if (written <= 0)
+            return false;
+        data += written;
+        length -= written;
+    }
+    moveTlsOutput();
+    return true;
+#endif
+}
+void WebSocketConnection::releaseConflated()
+{
+    // 合并的帧写出时才确定先后顺序，此时才交给会话编号
+    for (auto &item : conflated->frames)
+    {
+        if (session)
+            session->retain(this, item.second.data(), item.second.size());
+        outputBuffer().append(item.second);
+    }
+    conflated.reset();
+}
+
+void WebSocketConnection::discardBulk()
+{
+    for (auto &chunk : outbound)
+    {
+        if (chunk.file_fd >= 0)
+            ::close(chunk.file_fd);
+    }
+    outbound.clear();
+    conflated.reset();
+    bulk_unit_left = 0;
+}
+
+void WebSocketConnection::advanceBulk(const char *data, size_t written, size_t available)
+{
+    // 按帧头逐帧跳过已写出的字节，记录当前帧还剩多少字节
+    while (written > 0)
+    {
+        if (bulk_unit_left == 0)
+        {
+            bulk_unit_left = frameLength(reinterpret_cast<const uint8_t *>(data), available);
+        }
+        size_t step = std::min(written, bulk_unit_left);
+        data += step;
+        written -= step;
+        available -= step;
+        bulk_unit_left -= step;
+    }
+}
+
+size_t WebSocketConnection::frameLength(const uint8_t *data, size_t available)
+{
+    // 服务器发出的帧不掩码；帧头不完整时（不应发生）把剩余数据当作一个单元
+    if (available < 2)
+        return available;
+
+    uint64_t payload_length = data[1] & 0x7F;
+    size_t header_size = 2;
+    if (payload_length == 126)
+    {
+        if (available < 4)
+            return available;
+        payload_length = (data[2] << 8) | data[3];
+        header_size = 4;
+    }
+    else if (payload_length == 127)
+    {
+        if (available < 10)
+            return available;
+        payload_length = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            payload_length = (payload_length << 8) | data[2 + i];
+        }
+        header_size = 10;
+    }
+    return header_size + static_cast<size_t>(payload_length);
+}
+void WebSocketConnection::flushOutput()
+{
+    if (!pending_output)
+        return;
+
+    // kTLS 模式下由SSL_write写socket，内存BIO模式下写socket前才加密，都要持有tls_mutex
+    std::unique_lock<std::mutex> tls_lock(tls_mutex, std::defer_lock);
+    if (ssl)
+    {
+        tls_lock.lock();
+    }
+    std::lock_guard<std::mutex> lock(send_mutex);
+    if (!closed)
+    {
+        flushLocked();
+    }
+}
+
+bool WebSocketConnection::flushLocked()
+{
+    for (;;)
+    {
+        // 内存BIO模式：先写出已加密的数据
+        if (tls_out_offset < tls_out.size())
+        {
+            ssize_t bytes_sent = writeSome(tls_out.data() + tls_out_offset, tls_out.size() - tls_out_offset);
+            if (bytes_sent < 0)
+            {
+                connected = false;
+                pending_output = false;
+                return false;
+            }
+            if (bytes_sent == 0)
+                break;
+            tls_out_offset += bytes_sent;
+            if (tls_out_offset < tls_out.size())
+                continue;
+            releaseBuffer(tls_out);
+            tls_out_offset = 0;
+        }
+
+        // 紧急通道：只在普通通道的帧边界处插队，不拆开已经写出一部分的帧
+        if (urgent_offset < urgent.size() && bulk_unit_left == 0)
+        {
+            ssize_t bytes_sent = writePlain(urgent.data() + urgent_offset, urgent.size() - urgent_offset);
+            if (bytes_sent < 0)
+            {
+                connected = false;
+                pending_output = false;
+                return false;
+            }
+            if (bytes_sent == 0)
+                break;
+            urgent_offset += bytes_sent;
+            if (urgent_offset < urgent.size())
+                continue;
+            releaseBuffer(urgent);
+            urgent_offset = 0;
+
+            // close 帧之后不能再发送数据帧
+            if (closing)
+                discardBulk();
+            continue;
+        }
+
+        if (outbound.empty())
+        {
+            // 出站队列发完后写出合并的消息，再继续发送
+            if (!conflated)
+                break;
+            releaseConflated();
+            continue;
+        }
+
+        if (outbound.front().file_fd >= 0 && ssl && !ktls_send)
+        {
+            // 用户态加密无法零拷贝：读出文件的下一块排在区间之前，按普通数据加密发送
+            if (!loadFileChunk())
+            {
+                connected = false;
+                pending_output = false;
+                return false;
+            }
+            continue;
+        }
+
+        // 有紧急帧在等待时只写完当前帧
+        size_t limit = urgent_offset < urgent.size() ? bulk_unit_left : SIZE_MAX;
+        OutboundChunk &chunk = outbound.front();
+        ssize_t bytes_sent;
+        if (chunk.file_fd >= 0)
+        {
+            bytes_sent = writeFile(chunk, limit);
+            if (bytes_sent > 0)
+                bulk_unit_left -= std::min<size_t>(bulk_unit_left, bytes_sent);
+        }
+        else
+        {
+            const char *data = chunk.data.data() + chunk.offset;
+            size_t available = chunk.data.size() - chunk.offset;
+            bytes_sent = writePlain(data, std::min(available, limit));
+            if (bytes_sent > 0)
+                advanceBulk(data, bytes_sent, available);
+        }
+        if (bytes_sent < 0)
+        {
+            connected = false;
+            pending_output = false;
+            return false;
+        }
+        if (bytes_sent == 0)
+            break;
+
+        if (chunk.file_fd >= 0)
+        {
+            if (chunk.file_remaining > 0)
+                continue;
+            ::close(chunk.file_fd);
+        }
+        else
+        {
+            chunk.offset += bytes_sent;
+            if (chunk.offset < chunk.data.size())
+                continue;
+        }
+        outbound.pop_front();
+    }
+
+    // 积压较多时丢弃已发送的部分
+    if (!outbound.empty() && outbound.front().file_fd < 0)
+    {
+        OutboundChunk &chunk = outbound.front();
+        if (chunk.offset >= 65536 && chunk.offset * 2 >= chunk.data.size())
+        {
+            chunk.data.erase(0, chunk.offset);
+            chunk.offset = 0;
+        }
+    }
+    if (tls_out_offset >= 65536 && tls_out_offset * 2 >= tls_out.size())
+    {
+        tls_out.erase(0, tls_out_offset);
+        tls_out_offset = 0;
+    }
+    pending_output = !outbound.empty() || conflated || !urgent.empty() || !tls_out.empty();
+    return true;
+}
+
+ssize_t WebSocketConnection::writePlain(const char *data, size_t length)
+{
+    if (ssl && !socket_bio)
+    {
+        // 内存BIO模式：每次最多加密64KB，已加密的数据写完之前不再加密后面的数据
+        length = std::min<size_t>(length, 65536);
+        return encrypt(data, length) ? static_cast<ssize_t>(length) : -1;
+    }
+    return writeSome(data, length);
+}
+ssize_t WebSocketConnection::writeSome(const char *data, size_t length)
+{
+    if (length == 0)
+        return 0;
+
+#ifndef WEBSOCKET_NO_TLS
+    if (socket_bio)
+    {
+        // kTLS：记录加密由内核完成，这里写入的是明文
+        int n = SSL_write(ssl, data, static_cast<int>(std::min<size_t>(length, INT_MAX)));
+        if (n > 0)
+            return n;
+        int err = SSL_get_error(ssl, n);
+        return (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) ? 0 : -1;
+    }
+#endif
+
+    ssize_t bytes_sent = ::send(socket_fd, data, length, MSG_NOSIGNAL);
+    if (bytes_sent >= 0)
+        return bytes_sent;
+    return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+}
+
+bool WebSocketConnection::loadFileChunk()
+{
+    // 每次只读出一块：这一块写出之后才会再次读取，socket写不下时文件内容留在页缓存中
+    static const size_t file_chunk_size = 65536;
+    OutboundChunk &file = outbound.front();
+    OutboundChunk chunk;
+    chunk.data.resize(std::min(file.file_remaining, file_chunk_size));
+    chunk.offset = 0;
+    chunk.file_fd = -1;
+    chunk.file_offset = 0;
+    chunk.file_remaining = 0;
+    ssize_t n = pread(file.file_fd, &chunk.data[0], chunk.data.size(), file.file_offset);
+    if (n <= 0)
+        return false; // 文件比声明的短：帧已经无法补全
+    chunk.data.resize(n);
+
+    file.file_offset += n;
+    file.file_remaining -= n;
+    if (file.file_remaining == 0)
+    {
+        ::close(file.file_fd);
+        outbound.pop_front();
+    }
+    outbound.push_front(std::move(chunk));
+    return true;
+}
+
+ssize_t WebSocketConnection::writeFile(OutboundChunk &chunk, size_t limit)
+{
+    size_t count = std::min<size_t>(std::min(chunk.file_remaining, limit), 1 << 30);
+    ssize_t bytes_sent;
+
+#if !defined(WEBSOCKET_NO_TLS) && OPENSSL_VERSION_NUMBER >= 0x30000000L
+    if (ssl)
+    {
+        // kTLS：内核直接从页缓存读取并加密
+        bytes_sent = SSL_sendfile(ssl, chunk.file_fd, chunk.file_offset, count, 0);
+        if (bytes_sent < 0)
+        {
+            int err = SSL_get_error(ssl, static_cast<int>(bytes_sent));
+            return (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) ? 0 : -1;
+        }
+    }
+    else
+#endif
+    {
+        off_t offset = chunk.file_offset;
+        bytes_sent = sendfile(socket_fd, chunk.file_fd, &offset, count);
+        if (bytes_sent < 0)
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    }
+
+    // 文件比声明的短：帧已经无法补全
+    if (bytes_sent == 0)
+        return -1;
+
+    chunk.file_offset += bytes_sent;
+    chunk.file_remaining -= bytes_sent;
+    return bytes_sent;
+}
+
+std::string WebSocketConnection::encodeFrameHeader(uint8_t opcode, size_t payload_length)
+{
+    std::string header;
+
+    // FIN=1, RSV=000
+    header.push_back(static_cast<char>(0x80 | opcode));
+
+    if (payload_length < 126)
+    {
+        header.push_back(static_cast<char>(payload_length));
+    }
+    else if (payload_length < 65536)
+    {
+        header.push_back(static_cast<char>(126));
+        header.push_back(static_cast<char>((payload_length >> 8) & 0xFF));
+        header.push_back(static_cast<char>(payload_length & 0xFF));
+    }
+    else
+    {
+        header.push_back(static_cast<char>(127));
+        for (int i = 7; i >= 0; i--)
+        {
+            header.push_back(static_cast<char>((static_cast<uint64_t>(payload_length) >> (i * 8)) & 0xFF));
+        }
+    }
+
+    return header;
+}
+
+std::string WebSocketConnection::encodeFrame(const std::string &payload)
+{
+    // Opcode=0001 (text frame)；预留好空间，负载只拷贝一次
+    std::string frame = encodeFrameHeader(0x1, payload.length());
+    frame.reserve(frame.size() + payload.length());
+    frame.append(payload);
+    return frame;
+}
+
+void WebSocketConnection::sendClose(uint16_t status, bool discard_pending)
+{
+    // FIN=1, Opcode=1000 (close frame)，负载为2字节状态码
+    const char frame[4] = {static_cast<char>(0x88), 2, static_cast<char>(status >> 8), static_cast<char>(status & 0xFF)};
+    if (discard_pending)
+    {
+        // 走紧急通道，写出后丢弃尚未发出的数据帧
+        queueUrgent(frame, sizeof(frame), true);
+    }
+    else
+    {
+        queueOutput(frame, sizeof(frame));
+    }
+}
+
+// 从缓冲区头部解码一个完整的帧，返回消耗的字节数；数据不足一帧时返回0。
+// 协议错误时 close_status 置为应发出的关闭状态码（其余情况保持为0）：分片顺序错误为1002，
+// 文本帧（含分片消息的各个分片）不是合法的UTF-8为1007，消息超出大小上限为1009。
+// 1002/1009 在帧头解析完时就判定，返回帧头长度，负载不必到齐
+size_t WebSocketConnection::decodeFrame(const uint8_t *data, size_t size, uint8_t &opcode, std::string &payload,
+                                        uint16_t &close_status)
+{
+    if (size < 2)
+        return 0;
+
+    bool fin = (data[0] & 0x80) != 0;
+    opcode = data[0] & 0x0F;
+
+    bool masked = (data[1] & 0x80) != 0;
+    uint64_t payload_length = data[1] & 0x7F;
+
+    size_t header_size = 2;
+    if (payload_length == 126)
+    {
+        if (size < 4)
+            return 0;
+        payload_length = (data[2] << 8) | data[3];
+        header_size = 4;
+    }
+    else if (payload_length == 127)
+    {
+        if (size < 10)
+            return 0;
+        payload_length = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            payload_length = (payload_length << 8) | data[2 + i];
+        }
+        header_size = 10;
+    }
+
+    if (masked)
+    {
+        header_size += 4; // mask key
+    }
+
+    if (size < header_size)
+        return 0;
+
+    // 数据帧在帧头解析完时就检查：分片顺序错误以1002关闭，消息（分片消息按累计长度）超出上限以1009关闭，
+    // 不等负载到齐，超大的负载不会进入 in_buffer
+    bool data_frame = opcode < 0x8;
+    if (data_frame && (opcode == 0x0) != (message_opcode != 0))
+    {
+        close_status = 1002; // 没有未结束的消息却收到延续帧，或上一条消息还没结束就开始了新消息
+        return header_size;
+    }
+    if (data_frame && max_message_size > 0 &&
+        (payload_length > max_message_size || message_bytes + payload_length > max_message_size))
+    {
+        close_status = 1009;
+        return header_size;
+    }
+
+    if (payload_length > size - header_size)
+        return 0;
+
+    bool text = opcode == 0x1 || (opcode == 0x0 && message_opcode == 0x1);
+    if (data_frame)
+    {
+        message_opcode = fin ? 0 : (opcode != 0x0 ? opcode : message_opcode);
+        message_bytes = fin ? 0 : message_bytes + payload_length;
+    }
+
+    const uint8_t *body = data + header_size;
+    static const uint8_t no_mask[4] = {0, 0, 0, 0};
+    if (fin && opcode == 0x1)
+    {
+        // 文本帧：去掩码与UTF-8校验合并为一遍扫描
+        payload.resize(payload_length);
+        if (!unmaskAndValidateUtf8(body, payload_length, masked ? body - 4 : no_mask,
+                                   reinterpret_cast<uint8_t *>(&payload[0])))
+            close_status = 1007;
+    }
+    else if (text)
+    {
+        // 分片的文本消息：各个分片单独投递，逐片校验，跨分片的多字节序列由 utf8_stream 接上；
+        // 某个分片非法或最后一个分片停在序列中间时以1007关闭
+        if (opcode == 0x1)
+            utf8_stream.reset();
+        payload.resize(payload_length);
+        if (!utf8_stream.update(body, payload_length, masked ? body - 4 : no_mask,
+                                reinterpret_cast<uint8_t *>(&payload[0])) ||
+            (fin && !utf8_stream.finish()))
+            close_status = 1007;
+    }
+    else if (masked)
+    {
+        const uint8_t *mask = body - 4;
+        payload.resize(payload_length);
+        for (uint64_t i = 0; i < payload_length; i++)
+        {
+            payload[i] = static_cast<char>(body[i] ^ mask[i % 4]);
+        }
+    }
+    else
+    {
+        payload.assign(reinterpret_cast<const char *>(body), payload_length);
+    }
+
+    return header_size + payload_length;
+}
+
+// WebSocketServer 实现
+WebSocketServer::WebSocketServer(int port, size_t thread_pool_size)
+    : port(port), running(false), thread_pool_size(thread_pool_size), next_client_id(1),
+      dispatch_mode(DispatchMode::Pool), inline_time_budget(200), inline_messages(0), inline_budget_overruns(0),
+      inline_max_handler_us(0), last_overrun_report(0), reactor_count(1), incoming_cpu_steering(false),
+      overload_policy(OverloadPolicy::PauseReads), paused_count(0), shed_reads(0), deferred_reads(0), rejected_handshakes(0),
+      client_message_rate(0), client_byte_rate(0), ip_message_rate(0), ip_byte_rate(0), throttled_count(0),
+      throttled_reads(0), max_message_size(default_max_message_size), ip_rate_limiters_swept(0),
+      listen_backlog(4096), defer_accept_seconds(5), accepted_connections(0), accept_errors(0),
+      baseline_listen_overflows(0), baseline_listen_drops(0), ktls_enabled(false), upgrade_fd(-1), handed_off(false), unlocked_sends(0), ingest_ring_bytes(0), ingest_listen_fd(-1), ingest_channel(-1),
+      capture_max_bytes(0), session_grace_seconds(0), session_bytes(0), session_total_bytes(0), local_dispatches(0), cross_node_dispatches(0), cross_node_accepts(0)
+{
+    // 默认派发队列上限：每个工作线程256个任务
+    thread_pool.reset(new ThreadPool(thread_pool_size, thread_pool_size * 256));
+}
+
+WebSocketServer::~WebSocketServer()
+{
+    stop();
+}
+
+bool WebSocketServer::start()
+{
+    if (running)
+        return false;
+
+    reactors.clear();
+
+    // kTLS 模式下OpenSSL直接write()到socket，对端重置时会触发SIGPIPE
+    if (tls_context && ktls_enabled)
+    {
+        signal(SIGPIPE, SIG_IGN);
+    }
+
+    readListenCounters(baseline_listen_overflows, baseline_listen_drops);
+
+    // 热升级：旧进程仍在运行时接管它的监听socket和连接，否则正常绑定端口
+    std::vector<std::vector<int>> listeners; // 每个epoll线程的监听socket
+    std::vector<HandoffEntry> inherited_connections;
+    int upgrade_channel = upgrade_path.empty() ? -1 : connectUnixSocket(upgrade_path);
+    if (upgrade_channel >= 0)
+    {
+        if (!receiveHandoff(upgrade_channel, listeners, inherited_connections))
+        {
+            WEBSOCKET_LOG_ERROR("Failed to take over from previous process");
+            ::close(upgrade_channel);
+            return false;
+        }
+
+        // 沿用旧进程的epoll线程数和监听socket
+        if (reactor_count != listeners.size())
+        {
+            WEBSOCKET_LOG_INFO("Using " << listeners.size() << " reactors inherited from previous process");
+            reactor_count = listeners.size();
+        }
+        for (auto &fds : listeners)
+        {
+            for (int fd : fds)
+                configureListenSocket(fd);
+        }
+    }
+    else if (!setupSockets(listeners))
+    {
+        WEBSOCKET_LOG_ERROR("Failed to setup socket");
+        return false;
+    }
+
+    for (size_t i = 0; i < reactor_count; i++)
+    {
+        std::unique_ptr<Reactor> reactor(new Reactor());
+        reactor->index = static_cast<int>(i);
+        reactor->cpu = reactor_cpus.empty() ? -1 : reactor_cpus[i % reactor_cpus.size()];
+        reactor->numa_node = cpuToNumaNode(reactor->cpu);
+        reactor->listen_fds = listeners[i];
+        reactor->epoll_fd = epoll_create(1);
+        reactor->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        reactors.push_back(std::move(reactor));
+    }
+
+    for (auto &reactor : reactors)
+    {
+        Reactor &r = *reactor;
+        if (r.listen_fds.empty() || r.epoll_fd < 0 || r.wake_fd < 0)
+        {
+            WEBSOCKET_LOG_ERROR("Failed to create epoll instance");
+            stop();
+            return false;
+        }
+
+        struct epoll_event ev;
+        for (int listen_fd : r.listen_fds)
+        {
+            int domain = socketDomain(listen_fd);
+
+            // 让内核把在该CPU上收到的连接交给绑定在同一CPU上的epoll线程
+            if (incoming_cpu_steering && r.cpu >= 0 && domain != AF_UNIX &&
+                setsockopt(listen_fd, SOL_SOCKET, SO_INCOMING_CPU, &r.cpu, sizeof(r.cpu)) < 0)
+            {
+                WEBSOCKET_LOG_WARN("Failed to set SO_INCOMING_CPU: " << strerror(errno));
+            }
+
+            // Unix域socket没有 SO_REUSEPORT 分摊，同一个监听socket加入所有epoll线程，
+            // EPOLLEXCLUSIVE 保证每个新连接只唤醒其中一个
+            ev.events = EPOLLIN;
+            if (domain == AF_UNIX && reactor_count > 1)
+                ev.events |= EPOLLEXCLUSIVE;
+            ev.data.fd = listen_fd;
+            if (epoll_ctl(r.epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0)
+            {
+                WEBSOCKET_LOG_ERROR("Failed to add server socket to epoll");
+                stop();
+                return false;
+            }
+        }
+
+        ev.events = EPOLLIN;
+        ev.data.fd = r.wake_fd;
+        if (epoll_ctl(r.epoll_fd, EPOLL_CTL_ADD, r.wake_fd, &ev) < 0)
+        {
+            WEBSOCKET_LOG_ERROR("Failed to add wakeup eventfd to epoll");
+            stop();
+            return false;
+        }
+    }
+
+    if (!capture_path.empty())
+    {
+        capture.reset(new TrafficCapture());
+        if (!capture->open(capture_path, capture_max_bytes))
+        {
+            capture.reset();
+            stop();
+            return false;
+        }
+    }
+
+    sessions.reset();
+    if (session_grace_seconds > 0)
+    {
+        sessions = std::make_shared<SessionStore>(std::chrono::seconds(session_grace_seconds), session_bytes,
+                                                  session_total_bytes);
+    }
+
+    // 注入环的消费者是各epoll线程，线程启动前创建好
+    ingest_ring.reset();
+    if (!ingest_path.empty())
+    {
+        ingest_ring.reset(new IngestRing());
+        ingest_listen_fd = ingest_ring->create(ingest_ring_bytes, reactors.size()) ? listenUnixSocket(ingest_path) : -1;
+        if (ingest_listen_fd < 0)
+        {
+            WEBSOCKET_LOG_ERROR("Failed to set up ingest socket " << ingest_path);
+            ingest_ring.reset();
+            stop();
+            return false;
+        }
+    }
+
+    if (!bus_directory.empty())
+    {
+        bus.reset(new BroadcastBus());
+        bus->setBacklogHandler([this](int wait_fd)
+                               { watchBusBacklog(wait_fd); });
+        if (!bus->open(bus_directory))
+        {
+            WEBSOCKET_LOG_ERROR("Failed to join broadcast bus in " << bus_directory);
+            bus.reset();
+            stop();
+            return false;
+        }
+    }
+
+    running = true;
+
+    for (auto &reactor : reactors)
+    {
+        Reactor *r = reactor.get();
+        r->thread = std::thread([this, r]
+                                { eventLoop(*r); });
+    }
+
+    if (bus)
+    {
+        watchBroadcastBus();
+        watchBusPeers();
+    }
+    if (ingest_ring)
+    {
+        watchIngestSocket();
+    }
+    if (sessions)
+    {
+        runAfter(0, std::chrono::seconds(1), [this]
+                 { expireSessions(); });
+    }
+
+    if (upgrade_channel >= 0)
+    {
+        adoptConnections(inherited_connections);
+
+        // 确认接管完成，旧进程收到后退出
+        char ack = 1;
+        if (send(upgrade_channel, &ack, 1, MSG_NOSIGNAL) != 1)
+        {
+            WEBSOCKET_LOG_ERROR("Failed to acknowledge handoff");
+        }
+        ::close(upgrade_channel);
+        WEBSOCKET_LOG_INFO("Took over " << inherited_connections.size() << " connections from previous process");
+    }
+
+    // 等待下一个新进程来接管
+    if (!upgrade_path.empty())
+    {
+        upgrade_fd = listenUnixSocket(upgrade_path);
+        if (upgrade_fd >= 0)
+        {
+            watchUpgradeSocket();
+        }
+    }
+
+    if (listen_addresses.empty())
+    {
+        WEBSOCKET_LOG_INFO("WebSocket server started on port " << port);
+    }
+    else
+    {
+        std::ostringstream addresses;
+        for (const ListenAddress &address : listen_addresses)
+        {
+            if (address.family == AF_UNIX)
+                addresses << " unix:" << address.host;
+            else if (address.family == AF_INET6)
+                addresses << " [" << address.host << "]:" << address.port;
+            else
+                addresses << " " << address.host << ":" << address.port;
+        }
+        WEBSOCKET_LOG_INFO("WebSocket server started on" << addresses.str());
+    }
+    // 启动信息先于调用方随后的输出
+    AsyncLogger::flush();
+    return true;
+}
+
+void WebSocketServer::eventLoop(Reactor &reactor)
+{
+    struct epoll_event events[1024];
+
+    // 先绑核再分配内存，保证epoll线程使用的内存位于本地NUMA节点
+    if (reactor.cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(reactor.cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        {
+            WEBSOCKET_LOG_WARN("Failed to pin reactor " << reactor.index << " to CPU " << reactor.cpu);
+        }
+    }
+
+    while (running)
+    {
+        // 有被暂停读取的连接时缩短超时，以便及时恢复；有定时任务时按最近的到期时间等待
+        int timeout = nextTimerTimeout(reactor, reactor.paused_sockets.empty() ? 1000 : 10);
+
+        // 处理外部注入的消息；环中还有记录时不等待，否则标记休眠，由生产者写wake_fd唤醒
+        if (ingest_ring)
+        {
+            drainIngest(reactor);
+            if (!ingest_ring->prepareSleep(reactor.index))
+                timeout = 0;
+        }
+
+        int n = epoll_wait(reactor.epoll_fd, events, 1024, timeout);
+        if (ingest_ring)
+        {
+            ingest_ring->cancelSleep(reactor.index);
+        }
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue; // 被信号中断，继续
+            WEBSOCKET_LOG_ERROR("epoll_wait error: " << strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.fd == reactor.wake_fd)
+            {
+                // 其他线程投递了任务
+                uint64_t value;
+                while (read(reactor.wake_fd, &value, sizeof(value)) > 0)
+                {
+                }
+                runPostedTasks(reactor);
+            }
+            else if (reactor.fd_watchers.count(events[i].data.fd))
+            {
+                // 等待就绪的外部fd（一次性）
+                auto watcher = reactor.fd_watchers.find(events[i].data.fd);
+                Task task(std::move(watcher->second));
+                reactor.fd_watchers.erase(watcher);
+                epoll_ctl(reactor.epoll_fd, EPOLL_CTL_DEL, events[i].data.fd, nullptr);
+                task();
+            }
+            else if (std::find(reactor.listen_fds.begin(), reactor.listen_fds.end(), events[i].data.fd) !=
+                     reactor.listen_fds.end())
+            {
+                // 处理新连接
+                acceptConnections(reactor, events[i].data.fd);
+            }
+            else if (reactor.lingering.count(events[i].data.fd))
+            {
+                // 主动关闭的连接：丢弃对端随后发来的数据，直到对端关闭
+                drainLingering(reactor, events[i].data.fd);
+            }
+            else if (reactor.handshaking.count(events[i].data.fd))
+            {
+                // 推进尚未完成的握手；客户端发完请求就关闭时，握手完成后还要读到EOF
+                if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                {
+                    reactor.handshaking[events[i].data.fd]->setPeerShutdown();
+                }
+                advanceHandshake(reactor, events[i].data.fd);
+            }
+            else
+            {
+                // 处理客户端消息
+                dispatchRead(reactor, events[i].data.fd, events[i].events);
+            }
+        }
+
+        // 执行到期的定时任务
+        runExpiredTimers(reactor);
+
+        // 队列消化后恢复被暂停的连接
+        if (!reactor.paused_sockets.empty())
+        {
+            resumePausedReads(reactor);
+        }
+    }
+
+    // 清理epoll
+    while (!reactor.lingering.empty())
+    {
+        closeLingering(reactor, reactor.lingering.begin()->first);
+    }
+    ::close(reactor.epoll_fd);
+    reactor.epoll_fd = -1;
+}
+
+bool WebSocketServer::postToReactor(int reactor_index, PostedTask &&posted)
+{
+    if (!running || reactor_index < 0 || reactor_index >= static_cast<int>(reactors.size()))
+        return false;
+
+    Reactor &reactor = *reactors[reactor_index];
+    {
+        std::lock_guard<std::mutex> lock(reactor.posted_mutex);
+        reactor.posted_tasks.push_back(std::move(posted));
+    }
+
+    uint64_t one = 1;
+    return write(reactor.wake_fd, &one, sizeof(one)) == sizeof(one) || errno == EAGAIN;
+}
+
+void WebSocketServer::runPostedTasks(Reactor &reactor)
+{
+    std::vector<PostedTask> posted;
+    {
+        std::lock_guard<std::mutex> lock(reactor.posted_mutex);
+        posted.swap(reactor.posted_tasks);
+    }
+
+    for (auto &item : posted)
+    {
+        if (item.fd >= 0)
+        {
+            struct epoll_event ev;
+            ev.events = item.events | EPOLLONESHOT;
+            ev.data.fd = item.fd;
+            if (epoll_ctl(reactor.epoll_fd, EPOLL_CTL_ADD, item.fd, &ev) == 0)
+            {
+                reactor.fd_watchers[item.fd] = std::move(item.task);
+            }
+            else
+            {
+                // 无法监听时立即执行，由调用方在恢复后自行处理错误
+                item.task();
+            }
+        }
+        else if (item.deadline != TimePoint())
+        {
+            reactor.timers.insert(std::make_pair(item.deadline, std::move(item.task)));
+        }
+        else
+        {
+            item.task();
+        }
+    }
+}
+
+void WebSocketServer::runExpiredTimers(Reactor &reactor)
+{
+    TimePoint now = std::chrono::steady_clock::now();
+    while (!reactor.timers.empty() && reactor.timers.begin()->first <= now)
+    {
+        Task task(std::move(reactor.timers.begin()->second));
+        reactor.timers.erase(reactor.timers.begin());
+        task();
+    }
+}
+
+int WebSocketServer::nextTimerTimeout(Reactor &reactor, int timeout)
+{
+    if (reactor.timers.empty())
+        return timeout;
+
+    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(reactor.timers.begin()->first - std::chrono::steady_clock::now());
+    // 向上取整，避免在到期前反复空转
+    int wait_ms = static_cast<int>(wait.count()) + 1;
+    return std::max(0, std::min(timeout, wait_ms));
+}
+
+void WebSocketServer::advanceHandshake(Reactor &reactor, int client_socket)
+{
+    auto it = reactor.handshaking.find(client_socket);
+    std::shared_ptr<WebSocketConnection> connection = it->second;
+
+    // 线程池过载时以503拒绝新握手，避免继续加重积压
+    bool reject = overload_policy == OverloadPolicy::RejectHandshakes && thread_pool->isOverloaded();
+
+    WebSocketConnection::HandshakeState state = connection->continueHandshake(reject);
+    if (state == WebSocketConnection::HandshakeState::InProgress)
+        return;
+
+    reactor.handshaking.erase(it);
+    if (state != WebSocketConnection::HandshakeState::Completed)
+    {
+        if (state == WebSocketConnection::HandshakeState::Rejected)
+        {
+            rejected_handshakes++;
+        }
+        else
+        {
+            WEBSOCKET_LOG_INFO("WebSocket handshake failed with " << connection->getClientIP());
+        }
+        epoll_ctl(reactor.epoll_fd, EPOLL_CTL_DEL, client_socket, nullptr);
+        connection->close();
+        if (connection->isLingering())
+        {
+            lingerSocket(reactor, client_socket);
+        }
+        return;
+    }
+
+    WEBSOCKET_LOG_INFO("WebSocket handshake successful with " << connection->getClientIP());
+
+    // 按握手路径确定该连接的派发模式
+    connection->setInlineDispatch(routeDispatchMode(connection->getRequestPath()) == DispatchMode::Inline);
+    connection->setReactorIndex(reactor.index);
+    applyRateLimits(*connection);
+
+    int client_id;
+    bool resumed = false;
+    size_t replayed = 0;
+    std::shared_ptr<WebSocketConnection> replaced;
+    {
+        // 在 clients_mutex 内接管会话，发给该客户端ID的消息要么已在重放的帧中，要么直接写给新连接
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        if (sessions)
+        {
+            std::string token;
+            uint64_t last_seq;
+            std::vector<std::string> replay;
+            std::shared_ptr<ReplaySession> session;
+            if (connection->getResumeRequest(token, last_seq))
+            {
+                session = sessions->resume(token, last_seq, connection.get(), replay);
+            }
+            if (session)
+            {
+                client_id = session->getClientId();
+                resumed = true;
+                replayed = replay.size();
+                // 旧连接可能还没发现自己已断开
+                auto old = clients.find(client_id);
+                if (old != clients.end())
+                {
+                    replaced = old->second;
+                    clients.erase(old);
+                }
+            }
+            else
+            {
+                client_id = next_client_id++;
+                session = sessions->create(client_id, connection->getRequestPath(), connection.get());
+            }
+            connection->acceptSession(session, replay);
+        }
+        else
+        {
+            client_id = next_client_id++;
+        }
+        clients[client_id] = connection;
+    }
+    if (replaced)
+    {
+        closeConnection(replaced);
+    }
+    reactor.socket_to_client_id[client_socket] = client_id;
+    if (capture)
+    {
+        capture->record(CaptureEvent::Connect, client_id, connection->getRequestPath());
+    }
+
+    // 触发连接事件；恢复的会话沿用原来的客户端ID，只触发恢复事件
+    if (resumed)
+    {
+        if (resume_handler)
+        {
+            resume_handler(client_id, replayed);
+        }
+    }
+    else if (connection_handler)
+    {
+        connection_handler(client_id, connection->getClientIP());
+    }
+
+    // 客户端紧跟握手请求发送的帧已经读入缓冲区、或者客户端已经关闭，都不会再产生边缘事件
+    if (connection->hasBufferedInput() || connection->isPeerShutdown())
+    {
+        dispatchRead(reactor, client_socket, EPOLLIN);
+    }
+}
+
+WebSocketServer::DispatchMode WebSocketServer::routeDispatchMode(const std::string &path) const
+{
+    auto route_it = route_dispatch_modes.find(path);
+    return route_it != route_dispatch_modes.end() ? route_it->second : dispatch_mode;
+}
+
+void WebSocketServer::dispatchRead(Reactor &reactor, int client_socket, uint32_t events)
+{
+    auto it = reactor.socket_to_client_id.find(client_socket);
+    if (it == reactor.socket_to_client_id.end())
+        return;
+
+    int client_id = it->second;
+
+    // 获取对应的连接对象
+    std::shared_ptr<WebSocketConnection> connection;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        auto client_it = clients.find(client_id);
+        if (client_it != clients.end())
+        {
+            connection = client_it->second;
+        }
+    }
+
+    if (!connection || !connection->isConnected())
+    {
+        // 连接已断开（包括其他线程 close 后 shutdown 产生的EPOLLHUP），清理
+        cleanupSocket(reactor, client_socket);
+        return;
+    }
+
+    // socket出错（如收到RST）时已无法收发，不再读取剩余数据，立即清理
+    if (events & EPOLLERR)
+    {
+        connection->close();
+        cleanupSocket(reactor, client_socket);
+        return;
+    }
+    // 对端关闭了写方向：FIN之前的数据照常读取处理，读到EOF后清理
+    if (events & (EPOLLRDHUP | EPOLLHUP))
+    {
+        connection->setPeerShutdown();
+    }
+
+    // socket可写时继续发送积压的出站数据
+    if (events & EPOLLOUT)
+    {
+        connection->flushOutput();
+    }
+    if (!(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) || reactor.paused_sockets.count(client_socket) ||
+        reactor.throttled_sockets.count(client_socket))
+        return;
+
+    // 已有线程在读取该连接时只记下有新数据，由它读完后重新派发，同一连接的消息不会被并发处理
+    if (!connection->acquireRead())
+        return;
+
+    // 超出限速的连接暂停读取，令牌补足后再恢复
+    if (client_message_rate > 0 || client_byte_rate > 0 || ip_message_rate > 0 || ip_byte_rate > 0)
+    {
+        std::chrono::microseconds delay = connection->rateLimitDelay();
+        if (delay.count() > 0)
+        {
+            connection->releaseRead();
+            throttleReads(reactor, connection, delay);
+            return;
+        }
+    }
+
+    // 轻量处理直接在epoll线程上执行，省去线程池的往返
+    if (connection->isInlineDispatch())
+    {
+        handleInline(reactor, connection, client_id);
+        return;
+    }
+
+    // 排队延迟持续超标时，按 CoDel 节奏暂停最重的连接
+    if (overload_policy == OverloadPolicy::PauseReads && thread_pool->shouldShed())
+    {
+        shedHeaviestConnection(reactor);
+        if (reactor.paused_sockets.count(client_socket))
+        {
+            connection->releaseRead();
+            return;
+        }
+    }
+
+    // 在线程池中处理消息（不需要返回值，走无分配的有界提交路径）
+    int origin_node = currentNumaNode();
+    connection->beginTask();
+    bool posted = thread_pool->tryPost([this, connection, client_id, origin_node]
+                                       {
+        // 统计epoll线程到工作线程的跨NUMA节点交接
+        int worker_node = currentNumaNode();
+        if(origin_node >= 0 && worker_node >= 0) {
+            if(origin_node == worker_node) {
+                local_dispatches.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                cross_node_dispatches.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        static thread_local std::vector<std::string> messages;
+        messages.clear();
+        bool open = connection->receiveMessages(messages);
+        if(capture) {
+            captureInbound(client_id, messages);
+        }
+        if(message_handler) {
+            for(const std::string &message : messages) {
+                invokeMessageHandler(client_id, message);
+            }
+        }
+        // 读到单次上限、或读取期间又来了数据时，交回epoll线程重新派发，其他连接的读取可以排在前面
+        bool pending = connection->hasPendingInput();
+        bool more = connection->releaseRead();
+        if(!open) {
+            // 连接断开：epoll注册和映射只能由所属epoll线程清理，交给它立即处理
+            closeConnection(connection);
+        } else if(pending || more) {
+            redispatchRead(connection);
+        }
+        connection->endTask(); });
+
+    if (!posted)
+    {
+        // 队列已满：不阻塞epoll线程，暂停该连接的读取，待队列消化后再处理
+        connection->endTask();
+        connection->releaseRead();
+        deferred_reads++;
+        pauseReads(reactor, client_socket);
+    }
+}
+
+void WebSocketServer::handleInline(Reactor &reactor, std::shared_ptr<WebSocketConnection> connection, int client_id)
+{
+    static thread_local std::vector<std::string> messages;
+    messages.clear();
+    bool open = connection->receiveMessages(messages);
+    if (capture)
+    {
+        captureInbound(client_id, messages);
+    }
+
+    if (message_handler)
+    {
+        for (const std::string &message : messages)
+        {
+            runInlineHandler(connection, client_id, message);
+        }
+    }
+
+    bool pending = connection->hasPendingInput();
+    bool more = connection->releaseRead();
+    if (!open)
+    {
+        // 在epoll线程上可以立即清理断开的连接
+        connection->close();
+        cleanupSocket(reactor, connection->getSocketFd());
+    }
+    else if (pending || more)
+    {
+        redispatchRead(connection);
+    }
+}
+
+void WebSocketServer::redispatchRead(const std::shared_ptr<WebSocketConnection> &connection)
+{
+    // 读取在单次上限处停下（socket中剩余的数据不会再产生边缘事件），或者读取期间到达的数据被记在了读取标记上：
+    // 回到epoll线程重新检查限速，未超限则继续读取，否则暂停读取直到令牌补足
+    int reactor_index = connection->getReactorIndex();
+    runOnReactor(reactor_index, [this, connection, reactor_index]
+                 {
+        if(connection->isConnected()) {
+            dispatchRead(*reactors[reactor_index], connection->getSocketFd(), EPOLLIN);
+        } });
+}
+
+void WebSocketServer::invokeMessageHandler(int client_id, const std::string &message)
+{
+    try
+    {
+        message_handler(client_id, message);
+    }
+    catch (const std::exception &e)
+    {
+        WEBSOCKET_LOG_ERROR("Message handler for client " << client_id << " threw: " << e.what());
+    }
+    catch (...)
+    {
+        WEBSOCKET_LOG_ERROR("Message handler for client " << client_id << " threw a non-standard exception");
+    }
+}
+
+void WebSocketServer::runInlineHandler(const std::shared_ptr<WebSocketConnection> &connection, int client_id,
+                                       const std::string &message)
+{
+    auto start = std::chrono::steady_clock::now();
+    invokeMessageHandler(client_id, message);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    inline_messages.fetch_add(1, std::memory_order_relaxed);
+    uint64_t elapsed_us = elapsed.count();
+    uint64_t max_us = inline_max_handler_us.load(std::memory_order_relaxed);
+    while (elapsed_us > max_us && !inline_max_handler_us.compare_exchange_weak(max_us, elapsed_us))
+    {
+    }
+
+    // 超时监控：处理耗时超出预算会阻塞该epoll线程上的所有连接，需要提示改回线程池执行
+    if (elapsed > inline_time_budget)
+    {
+        inline_budget_overruns.fetch_add(1, std::memory_order_relaxed);
+
+        int64_t now_sec = std::chrono::duration_cast<std::chrono::seconds>(start.time_since_epoch()).count();
+        int64_t last = last_overrun_report.load(std::memory_order_relaxed);
+        if (now_sec != last && last_overrun_report.compare_exchange_strong(last, now_sec))
+        {
+            WEBSOCKET_LOG_WARN("Inline handler for route '" << connection->getRequestPath() << "' took "
+                            << elapsed_us << "us (budget " << inline_time_budget.count()
+                            << "us), consider dispatching it to the thread pool");
+        }
+    }
+}
+
+void WebSocketServer::closeConnection(const std::shared_ptr<WebSocketConnection> &connection)
+{
+    connection->close();
+
+    // 经 wake_fd 投递给所属epoll线程清理；任务持有连接，清理完成之前fd不会关闭，也就不会被新连接复用
+    int reactor_index = connection->getReactorIndex();
+    runOnReactor(reactor_index, [this, connection, reactor_index]
+                 { cleanupSocket(*reactors[reactor_index], connection->getSocketFd()); });
+}
+
+void WebSocketServer::cleanupSocket(Reactor &reactor, int sock_fd)
+{
+    auto it = reactor.socket_to_client_id.find(sock_fd);
+    if (it == reactor.socket_to_client_id.end())
+        return;
+
+    int client_id = it->second;
+    epoll_ctl(reactor.epoll_fd, EPOLL_CTL_DEL, sock_fd, nullptr);
+    reactor.socket_to_client_id.erase(it);
+    if (reactor.paused_sockets.erase(sock_fd))
+    {
+        paused_count--;
+    }
+    if (reactor.throttled_sockets.erase(sock_fd))
+    {
+        throttled_count--;
+    }
+
+    bool retained = false;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        auto client = clients.find(client_id);
+        // 已被 disconnectClient 移除，或者已被恢复会话的新连接接管
+        if (client == clients.end() || client->second->getSocketFd() != sock_fd)
+            return;
+        std::shared_ptr<WebSocketConnection> connection = client->second;
+        clients.erase(client);
+        connection->close();
+        if (connection->isLingering())
+        {
+            lingerSocket(reactor, sock_fd);
+        }
+
+        // 客户端没有发送 close 帧就断开时保留会话等待重连，断开事件推迟到会话结束时触发；
+        // 在 clients_mutex 内完成，之后发给该客户端ID的消息都会存入会话
+        if (sessions)
+        {
+            retained = !connection->isClosedByPeer() && sessions->detach(client_id, connection.get());
+            if (!retained)
+            {
+                sessions->end(client_id);
+            }
+        }
+    }
+    if (capture)
+    {
+        capture->record(CaptureEvent::Disconnect, client_id, nullptr, 0);
+    }
+    if (!retained && disconnection_handler)
+    {
+        disconnection_handler(client_id);
+    }
+}
+
+void WebSocketServer::lingerSocket(Reactor &reactor, int sock_fd)
+{
+    // 调用方持有连接，sock_fd 仍然有效；复制一份由epoll线程持有，连接析构时关闭原fd不影响这里
+    static const std::chrono::seconds linger_timeout(2);
+    int fd = ::dup(sock_fd);
+    if (fd < 0)
+        return;
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    ev.data.fd = fd;
+    if (epoll_ctl(reactor.epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+    {
+        ::close(fd);
+        return;
+    }
+
+    // 对端迟迟不关闭时到期直接关闭；fd 关闭后编号可能被复用，按最迟关闭时间确认还是同一次等待
+    TimePoint deadline = std::chrono::steady_clock::now() + linger_timeout;
+    reactor.lingering[fd] = deadline;
+    reactor.timers.emplace(deadline, [this, &reactor, fd, deadline]
+                           {
+        auto it = reactor.lingering.find(fd);
+        if (it != reactor.lingering.end() && it->second == deadline)
+            closeLingering(reactor, fd); });
+    drainLingering(reactor, fd);
+}
+
+void WebSocketServer::drainLingering(Reactor &reactor, int fd)
+{
+    // 对端关闭前最多丢弃这么多数据，继续灌入数据的对端直接关闭
+    static const size_t linger_drain_limit = 256 * 1024;
+    char buffer[16384];
+    for (size_t drained = 0; drained < linger_drain_limit;)
+    {
+        ssize_t n = ::read(fd, buffer, sizeof(buffer));
+        if (n > 0)
+        {
+            drained += n;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (n < 0 && errno == EINTR)
+            continue;
+        break;
+    }
+    closeLingering(reactor, fd);
+}
+
+void WebSocketServer::closeLingering(Reactor &reactor, int fd)
+{
+    epoll_ctl(reactor.epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    reactor.lingering.erase(fd);
+    ::close(fd);
+}
+
+void WebSocketServer::captureInbound(int client_id, const std::vector<std::string> &messages)
+{
+    for (const std::string &message : messages)
+    {
+        capture->record(CaptureEvent::Inbound, client_id, message);
+    }
+}
+
+void WebSocketServer::pauseReads(Reactor &reactor, int sock_fd)
+{
+    if (!reactor.paused_sockets.insert(sock_fd).second)
+        return;
+
+    // 去掉EPOLLIN，数据留在内核缓冲区中，由TCP流控反压给客户端；出站数据照常发送
+    struct epoll_event ev;
+    ev.events = EPOLLOUT | EPOLLET;
+    ev.data.fd = sock_fd;
+    epoll_ctl(reactor.epoll_fd, EPOLL_CTL_MOD, sock_fd, &ev);
+    paused_count++;
+}
+
+void WebSocketServer::resumePausedReads(Reactor &reactor)
+{
+    if (thread_pool->isOverloaded() || thread_pool->getAvailableThreads() == 0)
+        return;
+
+    // 重新注册EPOLLIN，内核会为已有数据的socket再次产生边缘事件；仍在限速中的连接由限速定时器恢复
+    for (int sock_fd : reactor.paused_sockets)
+    {
+        if (reactor.throttled_sockets.count(sock_fd))
+            continue;
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = sock_fd;
+        epoll_ctl(reactor.epoll_fd, EPOLL_CTL_MOD, sock_fd, &ev);
+    }
+    paused_count -= reactor.paused_sockets.size();
+    reactor.paused_sockets.clear();
+}
+
+void WebSocketServer::applyRateLimits(WebSocketConnection &connection)
+{
+    connection.setMaxMessageSize(max_message_size);
+    bool client_limited = client_message_rate > 0 || client_byte_rate > 0;
+    bool ip_limited = ip_message_rate > 0 || ip_byte_rate > 0;
+    if (client_limited)
+    {
+        connection.getRateLimiter().configure(client_message_rate, client_byte_rate);
+    }
+    if (!client_limited && !ip_limited)
+        return;
+
+    // 限速连接每次派发最多读取 64KB，使超限后的透支量有上限
+    static const size_t rate_limited_read_size = 65536;
+    connection.setReadLimit(rate_limited_read_size);
+    if (!ip_limited)
+        return;
+
+    // 同一IP的连接共享一个令牌桶，最后一条连接释放后该项失效
+    std::lock_guard<std::mutex> lock(ip_rate_limiters_mutex);
+    std::weak_ptr<RateLimiter> &slot = ip_rate_limiters[connection.getClientIP()];
+    std::shared_ptr<RateLimiter> limiter = slot.lock();
+    if (!limiter)
+    {
+        limiter = std::make_shared<RateLimiter>();
+        limiter->configure(ip_message_rate, ip_byte_rate);
+        slot = limiter;
+    }
+    connection.setIpRateLimiter(limiter);
+
+    if (ip_rate_limiters.size() >= 2 * ip_rate_limiters_swept + 64)
+    {
+        for (auto it = ip_rate_limiters.begin(); it != ip_rate_limiters.end();)
+        {
+            if (it->second.expired())
+                it = ip_rate_limiters.erase(it);
+            else
+                ++it;
+        }
+        ip_rate_limiters_swept = ip_rate_limiters.size();
+    }
+}
+
+void WebSocketServer::throttleReads(Reactor &reactor, const std::shared_ptr<WebSocketConnection> &connection,
+                                    std::chrono::microseconds delay)
+{
+    int sock_fd = connection->getSocketFd();
+    if (!reactor.throttled_sockets.insert(sock_fd).second)
+        return;
+
+    // 与过载暂停相同，去掉EPOLLIN让数据留在内核缓冲区中
+    struct epoll_event ev;
+    ev.events = EPOLLOUT | EPOLLET;
+    ev.data.fd = sock_fd;
+    epoll_ctl(reactor.epoll_fd, EPOLL_CTL_MOD, sock_fd, &ev);
+    throttled_count++;
+    throttled_reads++;
+
+    std::weak_ptr<WebSocketConnection> weak_connection = connection;
+    reactor.timers.emplace(std::chrono::steady_clock::now() + delay, [this, &reactor, weak_connection, sock_fd]
+                           {
+        // 连接已清理（fd 可能已被新连接复用）时不做任何事
+        std::shared_ptr<WebSocketConnection> connection = weak_connection.lock();
+        if(!connection || !reactor.throttled_sockets.count(sock_fd) || !reactor.socket_to_client_id.count(sock_fd)) {
+            return;
+        }
+        reactor.throttled_sockets.erase(sock_fd);
+        throttled_count--;
+
+        // 仍因过载暂停的连接留给过载恢复逻辑
+        if(reactor.paused_sockets.count(sock_fd)) {
+            return;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = sock_fd;
+        epoll_ctl(reactor.epoll_fd, EPOLL_CTL_MOD, sock_fd, &ev);
+
+        // 暂停前已读入缓冲区的帧和未读完的数据不会再产生边缘事件
+        if(connection->hasBufferedInput() || connection->hasPendingInput()) {
+            dispatchRead(reactor, sock_fd, EPOLLIN);
+        } });
+}
+
+void WebSocketServer::shedHeaviestConnection(Reactor &reactor)
+{
+    int heaviest_socket = -1;
+    int heaviest_pending = -1;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        for (const auto &pair : reactor.socket_to_client_id)
+        {
+            if (reactor.paused_sockets.count(pair.first))
+                continue;
+            auto client_it = clients.find(pair.second);
+            if (client_it == clients.end())
+                continue;
+            int pending = client_it->second->getPendingTasks();
+            if (pending > heaviest_pending)
+            {
+                heaviest_pending = pending;
+                heaviest_socket = pair.first;
+            }
+        }
+    }
+
+    if (heaviest_socket != -1)
+    {
+        pauseReads(reactor, heaviest_socket);
+        shed_reads++;
+    }
+}
+
+void WebSocketServer::stop()
+{
+    bool was_running = running.exchange(false);
+
+    // 等待epoll线程退出（最多一个epoll_wait超时周期）
+    for (auto &reactor : reactors)
+    {
+        if (!reactor->thread.joinable())
+        {
+            // 线程未启动（start()失败），由这里关闭epoll实例
+            if (reactor->epoll_fd != -1)
+            {
+                ::close(reactor->epoll_fd);
+                reactor->epoll_fd = -1;
+            }
+        }
+        else if (reactor->thread.get_id() == std::this_thread::get_id())
+        {
+            reactor->thread.detach();
+        }
+        else
+        {
+            reactor->thread.join();
+        }
+    }
+
+    // 结束录制，文件截断到实际长度
+    if (capture)
+    {
+        capture->close();
+    }
+
+    // 关闭注入socket；环本身保留到下次 start()，生产者写入的记录不再有人读取
+    if (ingest_listen_fd != -1)
+    {
+        ::close(ingest_listen_fd);
+        ingest_listen_fd = -1;
+        unlink(ingest_path.c_str());
+    }
+    int producer_channel = ingest_channel.exchange(-1);
+    if (producer_channel != -1)
+    {
+        ::close(producer_channel);
+    }
+
+    // 退出广播总线（删除本进程的socket文件，其他进程不再向这里发送）
+    if (bus)
+    {
+        bus->close();
+    }
+
+    // 关闭所有客户端连接
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        for (auto &pair : clients)
+        {
+            pair.second->close();
+        }
+        clients.clear();
+    }
+    if (sessions)
+    {
+        sessions->clear();
+    }
+
+    // 关闭监听socket和尚未完成握手的连接；共享的Unix域监听socket只关闭一次
+    std::set<int> closed_listeners;
+    for (auto &reactor : reactors)
+    {
+        for (auto &pair : reactor->handshaking)
+        {
+            pair.second->close();
+        }
+        reactor->handshaking.clear();
+        reactor->socket_to_client_id.clear();
+        reactor->paused_sockets.clear();
+        reactor->throttled_sockets.clear();
+        for (int listen_fd : reactor->listen_fds)
+        {
+            if (closed_listeners.insert(listen_fd).second)
+                ::close(listen_fd);
+        }
+        reactor->listen_fds.clear();
+        if (reactor->wake_fd != -1)
+        {
+            ::close(reactor->wake_fd);
+            reactor->wake_fd = -1;
+        }
+    }
+    // 删除本进程创建的Unix域socket文件；已交接时归新进程所有，不能删除
+    if (!closed_listeners.empty() && !handed_off)
+    {
+        for (const ListenAddress &address : listen_addresses)
+        {
+            if (address.family == AF_UNIX)
+                unlink(address.host.c_str());
+        }
+    }
+
+    // 已交接时升级socket文件已归新进程所有，不能删除
+    if (upgrade_fd != -1)
+    {
+        ::close(upgrade_fd);
+        upgrade_fd = -1;
+        if (!handed_off)
+        {
+            unlink(upgrade_path.c_str());
+        }
+    }
+    if (upgrade_thread.joinable())
+    {
+        if (upgrade_thread.get_id() == std::this_thread::get_id())
+            upgrade_thread.detach();
+        else
+            upgrade_thread.join();
+    }
+
+    if (was_running)
+    {
+        WEBSOCKET_LOG_INFO("WebSocket server stopped");
+    }
+    AsyncLogger::flush();
+}
+
+bool WebSocketServer::setupSockets(std::vector<std::vector<int>> &listeners)
+{
+    std::vector<ListenAddress> addresses = listen_addresses;
+    if (addresses.empty())
+    {
+        ListenAddress any;
+        any.family = AF_INET;
+        any.host = "0.0.0.0";
+        any.port = port;
+        addresses.push_back(any);
+    }
+
+    // 多个epoll线程时TCP地址每个线程各建一个监听socket（SO_REUSEPORT），Unix域socket只建一个并共享
+    listeners.assign(reactor_count, std::vector<int>());
+    for (const ListenAddress &address : addresses)
+    {
+        for (size_t i = 0; i < reactor_count; i++)
+        {
+            int listen_fd = address.family == AF_UNIX && i > 0 ? listeners[0].back()
+                                                               : createListenSocket(address, reactor_count > 1);
+            if (listen_fd < 0)
+            {
+                std::set<int> closed;
+                for (auto &fds : listeners)
+                {
+                    for (int fd : fds)
+                    {
+                        if (closed.insert(fd).second)
+                            ::close(fd);
+                    }
+                }
+                listeners.clear();
+                return false;
+            }
+            listeners[i].push_back(listen_fd);
+        }
+    }
+    return true;
+}
+
+bool WebSocketServer::receiveHandoff(int channel, std::vector<std::vector<int>> &listeners,
+                                     std::vector<HandoffEntry> &connections)
+{
+    // 监听socket记录的 client_id 为所属epoll线程编号
+    HandoffEntry entry;
+    while (readHandoffEntry(channel, entry))
+    {
+        if (entry.type == HandoffType::End)
+        {
+            if (!listeners.empty())
+                return true;
+            break;
+        }
+        if (entry.type == HandoffType::Listener && entry.client_id >= 0)
+        {
+            if (static_cast<size_t>(entry.client_id) >= listeners.size())
+                listeners.resize(entry.client_id + 1);
+            listeners[entry.client_id].push_back(entry.fd);
+        }
+        else
+        {
+            connections.push_back(entry);
+        }
+    }
+
+    // 交接中断：已收到的socket无法再使用
+    for (auto &fds : listeners)
+    {
+        for (int fd : fds)
+            ::close(fd);
+    }
+    for (auto &connection : connections)
+        ::close(connection.fd);
+    listeners.clear();
+    connections.clear();
+    return false;
+}
+
+void WebSocketServer::adoptConnections(std::vector<HandoffEntry> &connections)
+{
+    typedef std::vector<std::pair<int, std::shared_ptr<WebSocketConnection>>> Batch;
+    std::vector<Batch> adopted(reactors.size());
+
+    size_t next_reactor = 0;
+    for (auto &entry : connections)
+    {
+        int index = static_cast<int>(next_reactor++ % reactors.size());
+        bool established = entry.type == HandoffType::Connection;
+        // 对端地址直接从socket取得，交接记录中的 client_ip 只用于兼容旧版本
+        struct sockaddr_storage peer;
+        socklen_t peer_len = sizeof(peer);
+        if (getpeername(entry.fd, (struct sockaddr *)&peer, &peer_len) < 0)
+            peer.ss_family = AF_UNSPEC;
+        auto connection = newConnection(entry.fd, (struct sockaddr *)&peer, nullptr);
+        connection->restore(entry.request_path, entry.input, entry.output, entry.message, established);
+        connection->setReactorIndex(index);
+        adopted[index].push_back(std::make_pair(established ? entry.client_id : 0, connection));
+
+        if (!established)
+        {
+            if (sessions)
+            {
+                connection->enableSessionHandshake();
+            }
+            continue;
+        }
+
+        // 沿用旧进程分配的客户端ID
+        connection->setInlineDispatch(routeDispatchMode(entry.request_path) == DispatchMode::Inline);
+        applyRateLimits(*connection);
+        {
+            std::lock_guard<std::mutex> lock(clients_mutex);
+            clients[entry.client_id] = connection;
+        }
+        int next_id = next_client_id;
+        while (entry.client_id >= next_id && !next_client_id.compare_exchange_weak(next_id, entry.client_id + 1))
+        {
+        }
+    }
+
+    // 在各自的epoll线程上注册，保证连接事件先于该连接的消息回调；
+    // 交接时已读入缓冲区的数据不会再产生边缘事件，注册后立即处理
+    for (size_t i = 0; i < reactors.size(); i++)
+    {
+        if (adopted[i].empty())
+            continue;
+
+        Reactor *reactor = reactors[i].get();
+        auto batch = std::make_shared<Batch>(std::move(adopted[i]));
+        runOnReactor(reactor->index, [this, reactor, batch]
+                     {
+            for (auto &item : *batch)
+            {
+                int client_id = item.first;
+                std::shared_ptr<WebSocketConnection> &connection = item.second;
+                int fd = connection->getSocketFd();
+
+                struct epoll_event ev;
+                ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                ev.data.fd = fd;
+                if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+                {
+                    connection->close();
+                    if (client_id)
+                        removeClient(client_id);
+                    continue;
+                }
+
+                if (!client_id)
+                {
+                    reactor->handshaking[fd] = connection;
+                    advanceHandshake(*reactor, fd);
+                    continue;
+                }
+
+                reactor->socket_to_client_id[fd] = client_id;
+                if (capture)
+                {
+                    capture->record(CaptureEvent::Connect, client_id, connection->getRequestPath());
+                }
+                if (connection_handler)
+                {
+                    connection_handler(client_id, connection->getClientIP());
+                }
+                if (connection->hasBufferedInput())
+                {
+                    dispatchRead(*reactor, fd, EPOLLIN);
+                }
+            } });
+    }
+}
+
+void WebSocketServer::watchUpgradeSocket()
+{
+    runWhenReady(0, upgrade_fd, EPOLLIN, [this]
+                 {
+        int channel = accept4(upgrade_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (channel < 0)
+        {
+            if (running)
+                watchUpgradeSocket();
+            return;
+        }
+
+        // 交接需要各epoll线程配合，不能在epoll线程上等待
+        if (upgrade_thread.joinable())
+            upgrade_thread.join();
+        upgrade_thread = std::thread([this, channel]
+                                     { handOff(channel); }); });
+}
+
+void WebSocketServer::watchBroadcastBus()
+{
+    runWhenReady(0, bus->getFd(), EPOLLIN, [this]
+                 {
+        // 每次最多处理一批，避免持续的跨进程广播独占0号epoll线程；剩余的帧在下一轮继续处理
+        static const int frames_per_wakeup = 64;
+        std::string frame;
+        for (int i = 0; i < frames_per_wakeup && bus->receive(frame); i++)
+        {
+            deliverFrame(frame);
+        }
+        if (running)
+            watchBroadcastBus(); });
+}
+
+void WebSocketServer::watchBusPeers()
+{
+    runWhenReady(0, bus->getWatchFd(), EPOLLIN, [this]
+                 {
+        // 总线目录中有进程加入或退出
+        bus->refreshPeers();
+        if (running)
+            watchBusPeers(); });
+}
+
+void WebSocketServer::watchBusBacklog(int wait_fd)
+{
+    // 对端队列有空位时补发积压的帧，还有积压则继续等待
+    runWhenReady(0, wait_fd, EPOLLOUT, [this, wait_fd]
+                 {
+        if (bus->flushPeer(wait_fd) && running)
+            watchBusBacklog(wait_fd); });
+}
+
+void WebSocketServer::watchIngestSocket()
+{
+    runWhenReady(0, ingest_listen_fd, EPOLLIN, [this]
+                 {
+        int channel = accept4(ingest_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (channel >= 0)
+        {
+            std::vector<int> wake_fds;
+            for (auto &reactor : reactors)
+                wake_fds.push_back(reactor->wake_fd);
+
+            // 只允许一个生产者：已有连接时直接关闭新连接
+            if (ingest_channel != -1)
+            {
+                WEBSOCKET_LOG_WARN("Ingest producer already connected, rejecting another one");
+                ::close(channel);
+            }
+            else if (!sendIngestFds(channel, ingest_ring->getFd(), wake_fds))
+            {
+                WEBSOCKET_LOG_ERROR("Failed to hand ingest ring to producer");
+                ::close(channel);
+            }
+            else
+            {
+                ingest_channel = channel;
+                WEBSOCKET_LOG_INFO("Ingest producer connected");
+                watchIngestProducer();
+            }
+        }
+        if (running)
+            watchIngestSocket(); });
+}
+
+void WebSocketServer::watchIngestProducer()
+{
+    runWhenReady(0, ingest_channel, EPOLLIN, [this]
+                 {
+        // 生产者不在连接上发送数据，可读即表示已断开
+        int channel = ingest_channel;
+        char byte;
+        ssize_t n = recv(channel, &byte, 1, MSG_DONTWAIT);
+        if (n > 0 || (n < 0 && (errno == EAGAIN || errno == EINTR)))
+        {
+            if (running)
+                watchIngestProducer();
+            return;
+        }
+        if (ingest_channel.compare_exchange_strong(channel, -1))
+        {
+            ::close(channel);
+            WEBSOCKET_LOG_INFO("Ingest producer disconnected");
+        } });
+}
+
+static std::string ingestFrame(const IngestRecordHeader &record, const char *payload)
+{
+    std::string frame = WebSocketConnection::encodeFrameHeader(record.opcode, record.payload_length);
+    frame.append(payload, record.payload_length);
+    return frame;
+}
+
+void WebSocketServer::drainIngest(Reactor &reactor)
+{
+    // 每轮最多处理的记录数，超出部分留到下一轮，避免持续的注入流量饿死socket事件；
+    // 客户端表的锁只在解析一小批记录的接收者时持有，写socket在释放锁之后进行
+    static const size_t records_per_round = 4096;
+    static const size_t records_per_lock = 256;
+
+    // 记录直接编码到各连接的待发缓冲区，同时持有连接的引用，一批结束后每个连接只写一次
+    IngestOutput &output = reactor.ingest_output;
+    auto append = [&output](const std::shared_ptr<WebSocketConnection> &connection, const IngestRecordHeader &record,
+                            const char *payload)
+    {
+        std::pair<std::shared_ptr<WebSocketConnection>, std::string> &entry = output[connection.get()];
+        if (!entry.first)
+            entry.first = connection;
+        entry.second += WebSocketConnection::encodeFrameHeader(record.opcode, record.payload_length);
+        entry.second.append(payload, record.payload_length);
+    };
+
+    size_t handled = 0;
+    bool corrupt = false;
+    while (!corrupt && handled < records_per_round && ingest_ring->hasPending(reactor.index))
+    {
+        std::unique_lock<std::mutex> lock(clients_mutex);
+        std::shared_ptr<void> in_flight = beginUnlockedSend();
+        handled += ingest_ring->consume(
+            reactor.index, records_per_lock,
+            [this, &reactor, &append](const IngestRecordHeader &record, const char *topic, const char *payload)
+            {
+                // 断开中、等待重连的会话不属于任何epoll线程，由0号线程存入
+                bool retain = reactor.index == 0 && sessions && sessions->hasDetached();
+                if (record.target == static_cast<uint8_t>(IngestTarget::Client))
+                {
+                    // 只由连接所在的epoll线程发送，同一连接的消息保持写入顺序
+                    auto it = clients.find(record.client_id);
+                    if (it != clients.end() && it->second->getReactorIndex() == reactor.index)
+                        append(it->second, record, payload);
+                    else if (it == clients.end() && retain)
+                        sessions->retain(record.client_id, ingestFrame(record, payload));
+                    return;
+                }
+
+                // 路由或广播：各epoll线程只写给自己负责的连接
+                bool topic_only = record.target == static_cast<uint8_t>(IngestTarget::Topic);
+                if (retain)
+                {
+                    sessions->retainDetached(ingestFrame(record, payload), topic_only ? topic : nullptr,
+                                             record.topic_length);
+                }
+                for (const auto &pair : reactor.socket_to_client_id)
+                {
+                    auto it = clients.find(pair.second);
+                    if (it == clients.end() || (!it->second->isConnected() && !sessions))
+                        continue;
+                    const std::string &path = it->second->getRequestPath();
+                    if (topic_only && (path.size() != record.topic_length ||
+                                       memcmp(path.data(), topic, record.topic_length) != 0))
+                        continue;
+                    append(it->second, record, payload);
+                }
+            },
+            corrupt);
+        lock.unlock();
+
+        // 与 sendToClients 一样在锁外写入：连接由引用保活，期间被移除的连接已关闭，写入直接失败；
+        // 同一连接的消息只由本线程按批次顺序写出，顺序不变
+        for (auto &pair : output)
+            pair.second.first->sendFrame(pair.second.second);
+        output.clear();
+    }
+
+    if (corrupt)
+    {
+        // 生产者写坏了环（或不是本库的生产者）：已写入的记录全部丢弃，断开它。只关闭连接的读写，
+        // 由 watchIngestProducer 照常回收socket，生产者的 isConnected() 随即返回 false
+        WEBSOCKET_LOG_ERROR("Ingest ring holds an invalid record, disconnecting producer");
+        int channel = ingest_channel;
+        if (channel != -1)
+            shutdown(channel, SHUT_RDWR);
+    }
+}
+
+void WebSocketServer::runOnEachReactor(const std::function<void(Reactor &)> &fn)
+{
+    std::vector<std::future<void>> done;
+    for (auto &reactor : reactors)
+    {
+        Reactor *r = reactor.get();
+        auto promise = std::make_shared<std::promise<void>>();
+        done.push_back(promise->get_future());
+        if (!runOnReactor(r->index, [&fn, r, promise]
+                          { fn(*r); promise->set_value(); }))
+        {
+            promise->set_value();
+        }
+    }
+
+    // 服务器在等待期间被停止时，epoll线程可能不再执行投递的任务
+    for (auto &f : done)
+    {
+        while (f.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready && running)
+        {
+        }
+    }
+}
+
+void WebSocketServer::handOff(int channel)
+{
+    WEBSOCKET_LOG_INFO("New process connected, handing over...");
+
+    // 1. 交出监听socket；此后新进程开始accept，旧进程这边已accept的连接在下一步一并交出
+    bool ok = true;
+    for (auto &reactor : reactors)
+    {
+        for (int listen_fd : reactor->listen_fds)
+        {
+            HandoffEntry entry;
+            entry.type = HandoffType::Listener;
+            entry.client_id = reactor->index;
+            entry.fd = listen_fd;
+            ok = ok && writeHandoffEntry(channel, entry);
+        }
+    }
+    if (!ok)
+    {
+        // 新进程在接管前断开，继续服务
+        WEBSOCKET_LOG_WARN("Upgrade handoff failed, continuing to serve");
+        ::close(channel);
+        watchUpgradeSocket();
+        return;
+    }
+
+    // 2. 各epoll线程停止accept，并停止监听所有连接
+    std::vector<std::pair<int, std::shared_ptr<WebSocketConnection>>> detached;
+    std::mutex detached_mutex;
+    runOnEachReactor([&](Reactor &reactor)
+                     {
+        for (int listen_fd : reactor.listen_fds)
+            epoll_ctl(reactor.epoll_fd, EPOLL_CTL_DEL, listen_fd, nullptr);
+
+        std::lock_guard<std::mutex> lock(detached_mutex);
+        for (auto &pair : reactor.handshaking)
+        {
+            epoll_ctl(reactor.epoll_fd, EPOLL_CTL_DEL, pair.first, nullptr);
+            detached.push_back(std::make_pair(0, pair.second));
+        }
+        for (auto &pair : reactor.socket_to_client_id)
+        {
+            epoll_ctl(reactor.epoll_fd, EPOLL_CTL_DEL, pair.first, nullptr);
+            std::lock_guard<std::mutex> clients_lock(clients_mutex);
+            auto it = clients.find(pair.second);
+            if (it != clients.end())
+                detached.push_back(std::make_pair(pair.second, it->second));
+        }
+        reactor.handshaking.clear();
+        reactor.socket_to_client_id.clear();
+        paused_count -= reactor.paused_sockets.size();
+        reactor.paused_sockets.clear();
+        throttled_count -= reactor.throttled_sockets.size();
+        reactor.throttled_sockets.clear(); });
+
+    // 3. 等待已派发到线程池的读任务处理完，它们的回复会进入出站队列一并交出
+    for (auto &item : detached)
+    {
+        while (item.second->getPendingTasks() > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        for (auto &item : detached)
+        {
+            if (item.first)
+                clients.erase(item.first);
+        }
+    }
+
+    // 此后的发送找不到这些客户端，返回 false（sendToClients 不计入）；移除之前已取得连接、
+    // 在锁外写入的发送要等它们写完，写入的消息进入出站队列随连接一并交出
+    while (unlocked_sends.load() > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // 4. 逐个交出连接及其协议状态
+    size_t transferred = 0;
+    for (auto &item : detached)
+    {
+        std::shared_ptr<WebSocketConnection> &connection = item.second;
+        HandoffEntry entry;
+        entry.type = item.first ? HandoffType::Connection : HandoffType::Handshaking;
+        entry.client_id = item.first;
+        entry.fd = connection->getSocketFd();
+        entry.client_ip = connection->getClientIP();
+        entry.request_path = connection->getRequestPath();
+
+        bool usable = !item.first || connection->isConnected();
+        if (!usable || !connection->detach(entry.input, entry.output, entry.message))
+        {
+            connection->close();
+            continue;
+        }
+        if (ok && writeHandoffEntry(channel, entry))
+        {
+            transferred++;
+        }
+        else
+        {
+            ok = false;
+        }
+    }
+
+    HandoffEntry end;
+    end.type = HandoffType::End;
+    end.client_id = 0;
+    end.fd = -1;
+    char ack = 0;
+    ok = ok && writeHandoffEntry(channel, end) && recv(channel, &ack, 1, 0) == 1;
+    ::close(channel);
+
+    if (ok)
+        WEBSOCKET_LOG_INFO("Handed over " << transferred << " connections to new process");
+    else
+        WEBSOCKET_LOG_WARN("Upgrade handoff was interrupted, some connections were lost");
+
+    handed_off = true;
+    stop();
+    if (upgrade_handler)
+    {
+        upgrade_handler();
+    }
+}
+
+void WebSocketServer::setUpgradeSocket(const std::string &path)
+{
+    upgrade_path = path;
+}
+
+void WebSocketServer::setUpgradeHandler(std::function<void()> handler)
+{
+    upgrade_handler = handler;
+}
+
+void WebSocketServer::setBroadcastBus(const std::string &directory)
+{
+    bus_directory = directory;
+}
+
+void WebSocketServer::setCaptureFile(const std::string &path, size_t max_bytes)
+{
+    capture_path = path;
+    capture_max_bytes = max_bytes;
+}
+
+void WebSocketServer::setSessionResumption(int grace_seconds, size_t session_bytes, size_t total_bytes)
+{
+    session_grace_seconds = grace_seconds;
+    this->session_bytes = session_bytes;
+    session_total_bytes = total_bytes;
+}
+
+void WebSocketServer::setResumeHandler(std::function<void(int, size_t)> handler)
+{
+    resume_handler = handler;
+}
+
+void WebSocketServer::expireSessions()
+{
+    if (!running)
+        return;
+
+    // 宽限期已过或因内存上限被逐出的会话，此时才触发断开事件
+    for (int client_id : sessions->collectExpired())
+    {
+        if (disconnection_handler)
+        {
+            disconnection_handler(client_id);
+        }
+    }
+    runAfter(0, std::chrono::seconds(1), [this]
+             { expireSessions(); });
+}
+
+void WebSocketServer::setIngestSocket(const std::string &socket_path, size_t ring_bytes)
+{
+    ingest_path = socket_path;
+    ingest_ring_bytes = ring_bytes;
+}
+
+int WebSocketServer::createListenSocket(const ListenAddress &address, bool reuse_port)
+{
+    int listen_fd = socket(address.family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (listen_fd == -1)
+    {
+        WEBSOCKET_LOG_ERROR("Failed to create socket");
+        return -1;
+    }
+
+    union
+    {
+        struct sockaddr sa;
+        struct sockaddr_in v4;
+        struct sockaddr_in6 v6;
+        struct sockaddr_un un;
+    } addr;
+    socklen_t addr_len;
+    memset(&addr, 0, sizeof(addr));
+
+    if (address.family == AF_UNIX)
+    {
+        if (address.host.size() >= sizeof(addr.un.sun_path))
+        {
+            WEBSOCKET_LOG_ERROR("Unix socket path too long: " << address.host);
+            ::close(listen_fd);
+            return -1;
+        }
+        // 上次运行遗留的socket文件会导致bind失败
+        unlink(address.host.c_str());
+        addr.un.sun_family = AF_UNIX;
+        memcpy(addr.un.sun_path, address.host.c_str(), address.host.size());
+        addr_len = sizeof(addr.un);
+    }
+    else
+    {
+        // 设置socket选项
+        int opt = 1;
+        if (setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0)
+        {
+            WEBSOCKET_LOG_ERROR("Failed to set socket options");
+            ::close(listen_fd);
+            return -1;
+        }
+
+        // 多个epoll线程各自监听同一端口，由内核分摊新连接
+        if (reuse_port && setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
+        {
+            WEBSOCKET_LOG_ERROR("Failed to set SO_REUSEPORT");
+            ::close(listen_fd);
+            return -1;
+        }
+
+        if (address.family == AF_INET6)
+        {
+            // 双栈：IPv4客户端以 ::ffff:a.b.c.d 的形式接入同一个socket
+            int v6only = 0;
+            setsockopt(listen_fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+            addr.v6.sin6_family = AF_INET6;
+            addr.v6.sin6_port = htons(address.port);
+            inet_pton(AF_INET6, address.host.c_str(), &addr.v6.sin6_addr);
+            addr_len = sizeof(addr.v6);
+        }
+        else
+        {
+            addr.v4.sin_family = AF_INET;
+            addr.v4.sin_port = htons(address.port);
+            inet_pton(AF_INET, address.host.c_str(), &addr.v4.sin_addr);
+            addr_len = sizeof(addr.v4);
+        }
+    }
+
+    if (bind(listen_fd, &addr.sa, addr_len) < 0)
+    {
+        if (address.family == AF_UNIX)
+            WEBSOCKET_LOG_ERROR("Failed to bind socket to " << address.host << ": " << strerror(errno));
+        else
+            WEBSOCKET_LOG_ERROR("Failed to bind socket to " << address.host << " port " << address.port << ": "
+                             << strerror(errno));
+        ::close(listen_fd);
+        return -1;
+    }
+
+    if (!configureListenSocket(listen_fd))
+    {
+        ::close(listen_fd);
+        return -1;
+    }
+
+    return listen_fd;
+}
+
+bool WebSocketServer::configureListenSocket(int listen_fd)
+{
+    // 热升级接管的socket可能来自旧版本，这里统一设为非阻塞
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    // 客户端总是先发送升级请求，请求到达之前不必唤醒epoll线程（仅TCP）
+    if (socketDomain(listen_fd) != AF_UNIX &&
+        setsockopt(listen_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer_accept_seconds, sizeof(defer_accept_seconds)) < 0)
+    {
+        WEBSOCKET_LOG_WARN("Failed to set TCP_DEFER_ACCEPT: " << strerror(errno));
+    }
+
+    // 开始监听（对已在监听的socket再次调用只会更新队列长度）
+    if (listen(listen_fd, listen_backlog) < 0)
+    {
+        WEBSOCKET_LOG_ERROR("Failed to listen on socket");
+        return false;
+    }
+    return true;
+}
+
+void WebSocketServer::acceptConnections(Reactor &reactor, int listen_fd)
+{
+    // 监听socket是非阻塞的，一次唤醒取空全连接队列，重连风暴时队列不会因处理不及而溢出
+    for (;;)
+    {
+        struct sockaddr_storage client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        int client_socket = accept4(listen_fd, (struct sockaddr *)&client_addr, &client_len,
+                                    SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_socket < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+
+            accept_errors++;
+            if (running)
+            {
+                WEBSOCKET_LOG_WARN("Failed to accept client connection: " << strerror(errno));
+            }
+            return;
+        }
+
+        accepted_connections++;
+        addConnection(reactor, client_socket, (struct sockaddr *)&client_addr);
+    }
+}
+
+void WebSocketServer::addConnection(Reactor &reactor, int client_socket, const struct sockaddr *client_addr)
+{
+    // 统计网卡中断所在节点与当前epoll线程不一致的连接
+    int incoming_cpu = -1;
+    socklen_t incoming_len = sizeof(incoming_cpu);
+    if (getsockopt(client_socket, SOL_SOCKET, SO_INCOMING_CPU, &incoming_cpu, &incoming_len) == 0)
+    {
+        int incoming_node = cpuToNumaNode(incoming_cpu);
+        int reactor_node = currentNumaNode();
+        if (incoming_node >= 0 && reactor_node >= 0 && incoming_node != reactor_node)
+        {
+            cross_node_accepts++;
+        }
+    }
+
+    // 客户端socket由accept4设为非阻塞，握手和读写都由epoll事件驱动，不会阻塞epoll线程；
+    // 关闭Nagle，避免TLS会话票据与101响应这类连续小包被推迟到对端ACK之后
+    int nodelay = 1;
+    setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    auto connection = newConnection(client_socket, client_addr, tls_context.get());
+    if (sessions)
+    {
+        connection->enableSessionHandshake();
+    }
+
+    // 将客户端socket添加到epoll监听（边缘触发），握手完成前由 advanceHandshake 处理其事件；
+    // EPOLLRDHUP 让对端关闭立即可见，EPOLLHUP/EPOLLERR 总会报告
+    struct epoll_event client_ev;
+    client_ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    client_ev.data.fd = client_socket;
+    if (epoll_ctl(reactor.epoll_fd, EPOLL_CTL_ADD, client_socket, &client_ev) < 0)
+    {
+        WEBSOCKET_LOG_ERROR("Failed to add client socket to epoll: " << strerror(errno));
+        connection->close();
+        return;
+    }
+    reactor.handshaking[client_socket] = connection;
+}
+
+void WebSocketServer::removeClient(int client_id)
+{
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    auto it = clients.find(client_id);
+    if (it != clients.end())
+    {
+        it->second->close();
+        clients.erase(it);
+    }
+}
+
+void WebSocketServer::broadcastMessage(const std::string &message)
+{
+    std::string frame = WebSocketConnection::encodeFrame(message);
+
+    if (capture)
+    {
+        capture->record(CaptureEvent::Outbound, -1, message);
+    }
+    // 先写给本地客户端，再发给其他进程（发布不阻塞，对端积压的帧由0号epoll线程补发）
+    deliverFrame(frame);
+    if (bus)
+    {
+        bus->publish(frame);
+    }
+}
+
+void WebSocketServer::deliverFrame(const std::string &frame)
+{
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    for (auto &pair : clients)
+    {
+        // 开启会话恢复时，已断开但尚未清理的连接由自己把帧存入会话
+        if (pair.second->isConnected() || sessions)
+        {
+            pair.second->sendFrame(frame);
+        }
+    }
+    if (sessions && sessions->hasDetached())
+    {
+        sessions->retainDetached(frame);
+    }
+}
+
+size_t WebSocketServer::sendToClients(const std::vector<int> &client_ids, const std::string &message)
+{
+    return sendToClients(client_ids.data(), client_ids.size(), message);
+}
+
+size_t WebSocketServer::sendToClients(const int *client_ids, size_t count, const std::string &message)
+{
+    if (count == 0)
+        return 0;
+
+    // 所有接收者共享同一份编码结果
+    auto frame = std::make_shared<const std::string>(WebSocketConnection::encodeFrame(message));
+
+    // 接收者排序去重后与有序的客户端表归并，一次加锁解析全部接收者
+    std::vector<int> ids(client_ids, client_ids + count);
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    std::vector<std::shared_ptr<WebSocketConnection>> recipients;
+    recipients.reserve(ids.size());
+    size_t retained = 0;
+    bool retain = sessions && sessions->hasDetached();
+    std::shared_ptr<void> in_flight;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        in_flight = beginUnlockedSend();
+        // 接收者远少于在线客户端时逐个查找，否则顺序归并
+        bool lookup = ids.size() * 8 < clients.size();
+        auto it = clients.begin();
+        for (int id : ids)
+        {
+            if (lookup)
+            {
+                it = clients.lower_bound(id);
+            }
+            else
+            {
+                while (it != clients.end() && it->first < id)
+                    ++it;
+            }
+            if (it == clients.end() || it->first != id)
+            {
+                // 不在客户端表中的接收者可能正在等待重连
+                if (retain && sessions->retain(id, *frame))
+                    retained++;
+                else if (it == clients.end() && !retain)
+                    break;
+                continue;
+            }
+            if (it->second->isConnected() || sessions)
+            {
+                recipients.push_back(it->second);
+                if (capture)
+                    capture->record(CaptureEvent::Outbound, id, message);
+            }
+        }
+    }
 
-    size_t payload_length = payload.length();
-    if (payload_length < 126)
+    // 接收者不多时直接在调用线程写入，保持与调用线程其他发送的先后顺序
+    const size_t direct_limit = 256;
+    if (recipients.size() < direct_limit || reactors.size() < 2)
     {
-        frame.push_back(static_cast<uint8_t>(payload_length));
+        for (auto &connection : recipients)
+            connection->sendFrame(*frame);
+        return recipients.size() + retained;
     }
-    else if (payload_length < 65536)
+
+    // 按连接所在的epoll线程分组，由各线程并行写入（同时也避开与该线程flushOutput争锁）
+    std::vector<std::vector<std::shared_ptr<WebSocketConnection>>> groups(reactors.size());
+    for (auto &connection : recipients)
     {
-        frame.push_back(126);
-        frame.push_back((payload_length >> 8) & 0xFF);
-        frame.push_back(payload_length & 0xFF);
+        int index = connection->getReactorIndex();
+        groups[index >= 0 && index < static_cast<int>(groups.size()) ? index : 0].push_back(connection);
     }
-    else
+    for (size_t i = 0; i < groups.size(); i++)
     {
-        frame.push_back(127);
-        for (int i = 7; i >= 0; i--)
+        if (groups[i].empty())
+            continue;
+
+        auto batch = std::make_shared<std::vector<std::shared_ptr<WebSocketConnection>>>(std::move(groups[i]));
+        bool posted = runOnReactor(static_cast<int>(i), [batch, frame, in_flight]
+                                   {
+            for (auto &connection : *batch)
+                connection->sendFrame(*frame); });
+        if (!posted)
         {
-            frame.push_back((payload_length >> (i * 8)) & 0xFF);
+            for (auto &connection : *batch)
+                connection->sendFrame(*frame);
         }
     }
-
-    // 添加payload
-    frame.insert(frame.end(), payload.begin(), payload.end());
-
-    return std::string(frame.begin(), frame.end());
+    return recipients.size() + retained;
 }
 
-std::string WebSocketConnection::decodeFrame(const std::vector<uint8_t> &frame)
+bool WebSocketServer::sendFile(int client_id, int fd, off_t offset, size_t length)
 {
-    if (frame.size() < 2)
-        return "";
-
-    uint8_t opcode = frame[0] & 0x0F;
-    if (opcode == 0x8)
-    { // Close frame
-        connected = false;
-        return "";
+    std::shared_ptr<WebSocketConnection> connection;
+    std::shared_ptr<void> in_flight;
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        auto it = clients.find(client_id);
+        if (it == clients.end())
+            return false;
+        connection = it->second;
+        in_flight = beginUnlockedSend();
     }
+    if (capture)
+    {
+        // 文件内容不录制，只记下发出了一条二进制消息
+        capture->record(CaptureEvent::Outbound, client_id, nullptr, 0, 0x2);
+    }
+    return connection->sendFile(fd, offset, length);
+}
 
-    bool masked = (frame[1] & 0x80) != 0;
-    uint64_t payload_length = frame[1] & 0x7F;
-
-    size_t header_size = 2;
-    if (payload_length == 126)
+bool WebSocketServer::sendConflated(int client_id, const std::string &key, const std::string &message)
+{
+    std::shared_ptr<WebSocketConnection> connection;
+    std::shared_ptr<void> in_flight;
     {
-        if (frame.size() < 4)
-            return "";
-        payload_length = (frame[2] << 8) | frame[3];
-        header_size = 4;
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        auto it = clients.find(client_id);
+        if (it == clients.end())
+            return retainForSession(client_id, message);
+        connection = it->second;
+        in_flight = beginUnlockedSend();
     }
-    else if (payload_length == 127)
+    if (capture)
     {
-        if (frame.size() < 10)
-            return "";
-        payload_length = 0;
-        for (int i = 0; i < 8; i++)
-        {
-            payload_length = (payload_length << 8) | frame[2 + i];
-        }
-        header_size = 10;
+        capture->record(CaptureEvent::Outbound, client_id, message);
     }
+    return connection->sendConflated(key, message);
+}
 
-    if (masked)
+bool WebSocketServer::sendUrgentToClient(int client_id, const std::string &message)
+{
+    std::shared_ptr<WebSocketConnection> connection;
+    std::shared_ptr<void> in_flight;
     {
-        header_size += 4; // mask key
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        auto it = clients.find(client_id);
+        if (it == clients.end())
+            return retainForSession(client_id, message);
+        connection = it->second;
+        in_flight = beginUnlockedSend();
     }
+    if (capture)
+    {
+        capture->record(CaptureEvent::Outbound, client_id, message);
+    }
+    return connection->sendUrgent(message);
+}
 
-    if (frame.size() < header_size + payload_length)
-        return "";
-
-    std::string payload;
-    if (masked)
+bool WebSocketServer::sendMessageToClient(int client_id, const std::string &message)
+{
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    auto it = clients.find(client_id);
+    if (it == clients.end())
+        return retainForSession(client_id, message);
+    if (it->second->isConnected() || sessions)
     {
-        uint8_t mask[4] = {frame[header_size - 4], frame[header_size - 3], frame[header_size - 2], frame[header_size - 1]};
-        for (uint64_t i = 0; i < payload_length; i++)
+        if (capture)
         {
-            payload += static_cast<char>(frame[header_size + i] ^ mask[i % 4]);
+            capture->record(CaptureEvent::Outbound, client_id, message);
         }
+        return it->second->sendMessage(message);
     }
-    else
-    {
-        payload = std::string(frame.begin() + header_size, frame.begin() + header_size + payload_length);
-    }
+    return false;
+}
 
-    return payload;
+std::shared_ptr<void> WebSocketServer::beginUnlockedSend()
+{
+    unlocked_sends.fetch_add(1);
+    return std::shared_ptr<void>(nullptr, [this](void *)
+                                 { unlocked_sends.fetch_sub(1); });
 }
 
-// WebSocketServer 实现
-WebSocketServer::WebSocketServer(int port, size_t thread_pool_size)
-    : port(port), server_socket(-1), running(false), thread_pool_size(thread_pool_size), next_client_id(1)
+bool WebSocketServer::retainForSession(int client_id, const std::string &message)
 {
-    thread_pool.reset(new ThreadPool(thread_pool_size));
+    // 客户端断开、会话仍在宽限期内时存入会话，重连后重放；调用方持有 clients_mutex
+    return sessions && sessions->hasDetached() &&
+           sessions->retain(client_id, WebSocketConnection::encodeFrame(message));
 }
 
-WebSocketServer::~WebSocketServer()
+void WebSocketServer::setMessageHandler(std::function<void(int, const std::string &)> handler)
 {
-    stop();
+    message_handler = handler;
 }
 
-bool WebSocketServer::start()
+void WebSocketServer::setConnectionHandler(std::function<void(int, const std::string &)> handler)
 {
-    if (running)
-        return false;
+    connection_handler = handler;
+}
 
-    if (!setupSocket())
-    {
-        std::cerr << "Failed to setup socket" << std::endl;
-        return false;
-    }
+void WebSocketServer::setDisconnectionHandler(std::function<void(int)> handler)
+{
+    disconnection_handler = handler;
+}
 
-    running = true;
+int WebSocketServer::getClientReactor(int client_id) const
+{
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    auto it = clients.find(client_id);
+    return it != clients.end() ? it->second->getReactorIndex() : -1;
+}
 
-    std::thread([this]
-                {
-        struct epoll_event ev, events[1024];
-        int epoll_fd = epoll_create(1);
-        if(epoll_fd < 0) {
-            std::cerr << "Failed to create epoll instance" << std::endl;
-            running = false;
-            return;
-        }
+bool WebSocketServer::runOnReactor(int reactor_index, Task task)
+{
+    PostedTask posted = {std::move(task), TimePoint(), -1, 0};
+    return postToReactor(reactor_index, std::move(posted));
+}
 
-        ev.events = EPOLLIN;
-        ev.data.fd = server_socket;
-        if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_socket, &ev) < 0) {
-            std::cerr << "Failed to add server socket to epoll" << std::endl;
-            running = false;
-            return;
-        }
+bool WebSocketServer::runAfter(int reactor_index, std::chrono::milliseconds delay, Task task)
+{
+    PostedTask posted = {std::move(task), std::chrono::steady_clock::now() + delay, -1, 0};
+    return postToReactor(reactor_index, std::move(posted));
+}
 
-        // 用于存储socket fd到client id的映射
-        std::map<int, int> socket_to_client_id;
+bool WebSocketServer::runWhenReady(int reactor_index, int fd, uint32_t events, Task task)
+{
+    PostedTask posted = {std::move(task), TimePoint(), fd, events};
+    return postToReactor(reactor_index, std::move(posted));
+}
 
-        while(running) {
-            int n = epoll_wait(epoll_fd, events, 1024, 1000); // 1秒超时
-            if(n < 0) {
-                if(errno == EINTR) continue; // 被信号中断，继续
-                std::cerr << "epoll_wait error: " << strerror(errno) << std::endl;
-                break;
-            }
+void WebSocketServer::setDispatchMode(DispatchMode mode)
+{
+    dispatch_mode = mode;
+}
 
-            // 定期检查并清理断开的连接
-            if(n == 0) { // 超时，进行清理检查
-                std::vector<int> disconnected_sockets;
-                {
-                    std::lock_guard<std::mutex> lock(clients_mutex);
-                    for(const auto& pair : socket_to_client_id) {
-                        int sock_fd = pair.first;
-                        int client_id = pair.second;
-                        auto client_it = clients.find(client_id);
-                        if(client_it != clients.end() && !client_it->second->isConnected()) {
-                            disconnected_sockets.push_back(sock_fd);
-                        }
-                    }
-                }
+void WebSocketServer::setRouteDispatchMode(const std::string &path, DispatchMode mode)
+{
+    route_dispatch_modes[path] = mode;
+}
 
-                // 清理断开的连接
-                for(int sock_fd : disconnected_sockets) {
-                    auto it = socket_to_client_id.find(sock_fd);
-                    if(it != socket_to_client_id.end()) {
-                        int client_id = it->second;
-                        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, sock_fd, nullptr);
-                        socket_to_client_id.erase(it);
-                        removeClient(client_id);
-                        if(disconnection_handler) {
-                            disconnection_handler(client_id);
-                        }
-                        std::cout << "Cleaned up disconnected client " << client_id << std::endl;
-                    }
-                }
-            }
+void WebSocketServer::setInlineTimeBudget(std::chrono::microseconds budget)
+{
+    inline_time_budget = budget;
+}
 
-            for(int i = 0; i < n; i++) {
-                if(events[i].data.fd == server_socket) {
-                    // 处理新连接
-                    auto connection = acceptConnections();
-                    if(connection && connection->isConnected()) {
-                        // 将客户端socket添加到epoll监听
-                        struct epoll_event client_ev;
-                        client_ev.events = EPOLLIN | EPOLLET; // 边缘触发
-                        client_ev.data.fd = connection->getSocketFd();
-
-                        if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connection->getSocketFd(), &client_ev) == 0) {
-                            // 找到对应的client_id
-                            int client_id = -1;
-                            {
-                                std::lock_guard<std::mutex> lock(clients_mutex);
-                                for(const auto& pair : clients) {
-                                    if(pair.second == connection) {
-                                        client_id = pair.first;
-                                        break;
-                                    }
-                                }
-                            }
-                            if(client_id != -1) {
-                                socket_to_client_id[connection->getSocketFd()] = client_id;
-                                // std::cout << "Added client socket " << connection->getSocketFd()
-                                //          << " (client_id: " << client_id << ") to epoll" << std::endl;
-                            }
-                        } else {
-                            std::cerr << "Failed to add client socket to epoll: " << strerror(errno) << std::endl;
-                        }
-                    }
-                } else {
-                    // 处理客户端消息
-                    int client_socket = events[i].data.fd;
-                    auto it = socket_to_client_id.find(client_socket);
-                    if(it != socket_to_client_id.end()) {
-                        int client_id = it->second;
-
-                        // 获取对应的连接对象
-                        std::shared_ptr<WebSocketConnection> connection;
-                        {
-                            std::lock_guard<std::mutex> lock(clients_mutex);
-                            auto client_it = clients.find(client_id);
-                            if(client_it != clients.end()) {
-                                connection = client_it->second;
-                            }
-                        }
-
-                        if(connection && connection->isConnected()) {
-                            // 检查是否有空闲线程，如果没有则等待
-                            if(thread_pool->getAvailableThreads() == 0) {
-                                std::cout << "No available threads, waiting..." << std::endl;
-                                thread_pool->waitForAvailableThread();
-                            }
-
-                            // 在线程池中处理消息
-                            thread_pool->enqueue([this, connection, client_id, client_socket, &socket_to_client_id, epoll_fd] {
-                                // std::cout << "Thread processing message for client " << client_id << std::endl;
-
-                                std::string message = connection->receiveMessage();
-                                if(!message.empty()) {
-                                    if(message_handler) {
-                                        message_handler(client_id, message);
-                                    }
-                                } else {
-                                    // 连接断开，需要在主线程中处理epoll清理
-                                    // 这里我们只标记连接为断开，实际清理在epoll线程中进行
-                                    connection->close();
-                                }
-
-                                // std::cout << "Thread finished processing message for client " << client_id
-                                //          << ", returning to pool" << std::endl;
-                            });
-                        } else {
-                            // 连接已断开，清理
-                            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_socket, nullptr);
-                            socket_to_client_id.erase(client_socket);
-                            removeClient(client_id);
-                            if(disconnection_handler) {
-                                disconnection_handler(client_id);
-                            }
-                        }
-                    }
-                }
-            }
-        }
+WebSocketServer::InlineStats WebSocketServer::getInlineStats() const
+{
+    InlineStats stats;
+    stats.inline_messages = inline_messages;
+    stats.budget_overruns = inline_budget_overruns;
+    stats.max_handler_us = inline_max_handler_us;
+    return stats;
+}
 
-        // 清理epoll
-        ::close(epoll_fd); })
-        .detach();
+void WebSocketServer::setOverloadPolicy(OverloadPolicy policy)
+{
+    overload_policy = policy;
+}
 
-    std::cout << "WebSocket server started on port " << port << std::endl;
-    return true;
+void WebSocketServer::setDispatchQueueLimit(size_t limit)
+{
+    thread_pool->setMaxQueueSize(limit);
 }
 
-void WebSocketServer::stop()
+void WebSocketServer::setClientRateLimit(double messages_per_sec, double bytes_per_sec)
 {
-    if (!running)
-        return;
+    client_message_rate = messages_per_sec;
+    client_byte_rate = bytes_per_sec;
+}
 
-    running = false;
+void WebSocketServer::setIpRateLimit(double messages_per_sec, double bytes_per_sec)
+{
+    ip_message_rate = messages_per_sec;
+    ip_byte_rate = bytes_per_sec;
+}
 
-    // 关闭所有客户端连接
-    {
-        std::lock_guard<std::mutex> lock(clients_mutex);
-        for (auto &pair : clients)
-        {
-            pair.second->close();
-        }
-        clients.clear();
-    }
+void WebSocketServer::setMaxMessageSize(size_t bytes)
+{
+    max_message_size = bytes;
+}
+
+void WebSocketServer::setReactorCount(size_t count)
+{
+    reactor_count = count > 0 ? count : 1;
+}
+
+void WebSocketServer::setReactorCpus(const std::vector<int> &cpus)
+{
+    reactor_cpus = cpus;
+}
 
-    // 关闭服务器socket
-    if (server_socket != -1)
+void WebSocketServer::setWorkerCpus(const std::vector<int> &cpus)
+{
+    if (!thread_pool->setAffinity(cpus))
     {
-        ::close(server_socket);
-        server_socket = -1;
+        WEBSOCKET_LOG_WARN("Failed to pin worker threads");
     }
+}
+
+void WebSocketServer::setIncomingCpuSteering(bool enable)
+{
+    incoming_cpu_steering = enable;
+}
+
+WebSocketServer::NumaStats WebSocketServer::getNumaStats() const
+{
+    NumaStats stats;
+    stats.numa_nodes = numaNodeCount();
+    stats.local_dispatches = local_dispatches;
+    stats.cross_node_dispatches = cross_node_dispatches;
+    stats.cross_node_accepts = cross_node_accepts;
+    return stats;
+}
 
-    std::cout << "WebSocket server stopped" << std::endl;
+void WebSocketServer::setListenBacklog(int backlog)
+{
+    listen_backlog = backlog;
+}
+
+void WebSocketServer::setDeferAccept(int seconds)
+{
+    defer_accept_seconds = seconds;
 }
 
-bool WebSocketServer::setupSocket()
+bool WebSocketServer::addListenAddress(const std::string &address)
 {
-    server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_socket == -1)
+    ListenAddress listen_address;
+    listen_address.port = port;
+
+    if (address.compare(0, 5, "unix:") == 0)
     {
-        std::cerr << "Failed to create socket" << std::endl;
-        return false;
+        listen_address.family = AF_UNIX;
+        listen_address.host = address.substr(5);
+        if (listen_address.host.empty())
+            return false;
+        listen_addresses.push_back(listen_address);
+        return true;
     }
 
-    // 设置socket选项
-    int opt = 1;
-    if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0)
+    // "[v6]:port"、"v6"（含多个冒号）、"v4:port"、"v4"
+    std::string host = address;
+    std::string port_text;
+    if (!host.empty() && host[0] == '[')
     {
-        std::cerr << "Failed to set socket options" << std::endl;
-        ::close(server_socket);
-        return false;
+        size_t close_bracket = host.find(']');
+        if (close_bracket == std::string::npos)
+            return false;
+        if (close_bracket + 1 < host.size())
+        {
+            if (host[close_bracket + 1] != ':')
+                return false;
+            port_text = host.substr(close_bracket + 2);
+        }
+        host = host.substr(1, close_bracket - 1);
     }
-
-    // 绑定地址
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(port);
-
-    if (bind(server_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+    else if (std::count(host.begin(), host.end(), ':') == 1)
     {
-        std::cerr << "Failed to bind socket to port " << port << std::endl;
-        ::close(server_socket);
-        return false;
+        size_t colon = host.find(':');
+        port_text = host.substr(colon + 1);
+        host = host.substr(0, colon);
     }
 
-    // 开始监听
-    if (listen(server_socket, 10) < 0)
+    if (!port_text.empty())
     {
-        std::cerr << "Failed to listen on socket" << std::endl;
-        ::close(server_socket);
-        return false;
+        char *end = nullptr;
+        long value = std::strtol(port_text.c_str(), &end, 10);
+        if (*end != '\0' || value <= 0 || value > 65535)
+            return false;
+        listen_address.port = static_cast<int>(value);
     }
 
+    struct in6_addr probe;
+    if (inet_pton(AF_INET, host.c_str(), &probe) == 1)
+        listen_address.family = AF_INET;
+    else if (inet_pton(AF_INET6, host.c_str(), &probe) == 1)
+        listen_address.family = AF_INET6;
+    else
+        return false;
+
+    listen_address.host = host;
+    listen_addresses.push_back(listen_address);
     return true;
 }
 
-std::shared_ptr<WebSocketConnection> WebSocketServer::acceptConnections()
+WebSocketServer::AcceptStats WebSocketServer::getAcceptStats() const
 {
-    while (running)
+    AcceptStats stats;
+    stats.accepted = accepted_connections;
+    stats.accept_errors = accept_errors;
+    stats.backlog_queued = 0;
+    stats.backlog_limit = 0;
+
+    // 对监听socket，tcpi_unacked 为当前全连接队列长度，tcpi_sacked 为队列上限
+    for (const auto &reactor : reactors)
     {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-
-        int client_socket = accept(server_socket, (struct sockaddr *)&client_addr, &client_len);
-        if (client_socket < 0)
+        for (int listen_fd : reactor->listen_fds)
         {
-            if (running)
+            struct tcp_info info;
+            socklen_t length = sizeof(info);
+            if (getsockopt(listen_fd, IPPROTO_TCP, TCP_INFO, &info, &length) == 0)
             {
-                std::cerr << "Failed to accept client connection" << std::endl;
+                stats.backlog_queued += info.tcpi_unacked;
+                stats.backlog_limit += info.tcpi_sacked;
             }
-            continue;
         }
+    }
 
-        std::string client_ip = inet_ntoa(client_addr.sin_addr);
-        int client_id = next_client_id++;
-
-        // 创建WebSocket连接
-        auto connection = std::make_shared<WebSocketConnection>(client_socket, client_ip);
-
-        if (connection->isConnected())
-        {
-            {
-                std::lock_guard<std::mutex> lock(clients_mutex);
-                clients[client_id] = connection;
-            }
-
-            // 触发连接事件
-            if (connection_handler)
-            {
-                connection_handler(client_id, client_ip);
-            }
+    uint64_t overflows, drops;
+    readListenCounters(overflows, drops);
+    stats.listen_overflows = overflows - baseline_listen_overflows;
+    stats.listen_drops = drops - baseline_listen_drops;
+    return stats;
+}
 
-            // 客户端处理现在由epoll线程负责
+bool WebSocketServer::enableTls(const std::string &cert_file, const std::string &key_file)
+{
+    std::unique_ptr<TlsContext> context(new TlsContext());
+    if (!context->loadCertificate(cert_file, key_file))
+        return false;
 
-            return connection;
-        }
-    }
+    context->setKtls(ktls_enabled);
+    tls_context = std::move(context);
+    return true;
+}
 
-    // 如果服务器停止运行，返回空指针
-    return nullptr;
+bool WebSocketServer::setTlsTicketKeyFile(const std::string &key_file)
+{
+    return tls_context && tls_context->loadTicketKeys(key_file);
 }
 
-void WebSocketServer::handleClient(std::shared_ptr<WebSocketConnection> connection, int client_id)
+void WebSocketServer::setKtlsEnabled(bool enable)
 {
-    while (connection->isConnected() && running)
+    ktls_enabled = enable;
+    if (tls_context)
     {
-        std::string message = connection->receiveMessage();
-
-        if (!message.empty())
-        {
-            // 触发消息处理事件
-            if (message_handler)
-            {
-                message_handler(client_id, message);
-            }
-        }
-        else
-        {
-            // 连接断开
-            break;
-        }
+        tls_context->setKtls(enable);
     }
+}
 
-    // 清理客户端连接
-    removeClient(client_id);
+WebSocketServer::TlsStats WebSocketServer::getTlsStats() const
+{
+    if (tls_context)
+        return tls_context->getStats();
 
-    // 触发断开连接事件
-    if (disconnection_handler)
-    {
-        disconnection_handler(client_id);
-    }
+    TlsStats stats = {0, 0, 0, 0};
+    return stats;
 }
 
-void WebSocketServer::removeClient(int client_id)
+WebSocketServer::CaptureStats WebSocketServer::getCaptureStats() const
 {
-    std::lock_guard<std::mutex> lock(clients_mutex);
-    auto it = clients.find(client_id);
-    if (it != clients.end())
-    {
-        it->second->close();
-        clients.erase(it);
-    }
+    if (capture)
+        return capture->getStats();
+
+    CaptureStats stats = {0, 0, 0};
+    return stats;
 }
 
-void WebSocketServer::broadcastMessage(const std::string &message)
+WebSocketServer::SessionStats WebSocketServer::getSessionStats() const
 {
-    std::lock_guard<std::mutex> lock(clients_mutex);
-    for (auto &pair : clients)
-    {
-        if (pair.second->isConnected())
-        {
-            pair.second->sendMessage(message);
-        }
-    }
+    if (sessions)
+        return sessions->getStats();
+
+    SessionStats stats = {0, 0, 0, 0, 0, 0, 0};
+    return stats;
 }
 
-void WebSocketServer::sendMessageToClient(int client_id, const std::string &message)
+std::string WebSocketServer::getSessionToken(int client_id) const
 {
     std::lock_guard<std::mutex> lock(clients_mutex);
     auto it = clients.find(client_id);
-    if (it != clients.end() && it->second->isConnected())
-    {
-        it->second->sendMessage(message);
-    }
+    if (it == clients.end() || !it->second->getSession())
+        return std::string();
+    return it->second->getSession()->getToken();
 }
 
-void WebSocketServer::setMessageHandler(std::function<void(int, const std::string &)> handler)
+WebSocketServer::IngestStats WebSocketServer::getIngestStats() const
 {
-    message_handler = handler;
+    IngestStats stats = {false, 0, 0, 0};
+    if (ingest_ring)
+    {
+        stats.producer_connected = ingest_channel != -1;
+        stats.published = ingest_ring->getPublished();
+        stats.rejected = ingest_ring->getRejected();
+        stats.backlog_bytes = ingest_ring->getBacklog();
+    }
+    return stats;
 }
 
-void WebSocketServer::setConnectionHandler(std::function<void(int, const std::string &)> handler)
+WebSocketServer::BusStats WebSocketServer::getBusStats() const
 {
-    connection_handler = handler;
+    if (bus)
+        return bus->getStats();
+
+    BusStats stats = {0, 0, 0, 0, 0, 0};
+    return stats;
 }
 
-void WebSocketServer::setDisconnectionHandler(std::function<void(int)> handler)
+WebSocketServer::OverloadStats WebSocketServer::getOverloadStats() const
 {
-    disconnection_handler = handler;
+    OverloadStats stats;
+    stats.overloaded = thread_pool->isOverloaded();
+    stats.queue_size = thread_pool->getQueueSize();
+    stats.paused_connections = paused_count;
+    stats.shed_reads = shed_reads;
+    stats.deferred_reads = deferred_reads;
+    stats.rejected_handshakes = rejected_handshakes;
+    stats.throttled_connections = throttled_count;
+    stats.throttled_reads = throttled_reads;
+    return stats;
 }
 
 // 服务器状态查询方法实现
@@ -634,26 +3998,54 @@ std::vector<std::pair<int, std::string>> WebSocketServer::getConnectedClients()
     return result;
 }
 
+std::vector<WebSocketServer::ClientInfo> WebSocketServer::getClientInfo() const
+{
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    std::vector<ClientInfo> result;
+
+    for (const auto &pair : clients)
+    {
+        if (pair.second && pair.second->isConnected())
+        {
+            ClientInfo info;
+            info.client_id = pair.first;
+            info.client_ip = pair.second->getClientIP();
+            pair.second->getRateLimiter().getRates(info.messages_per_sec, info.bytes_per_sec);
+            result.push_back(info);
+        }
+    }
+
+    return result;
+}
+
 bool WebSocketServer::disconnectClient(int client_id)
 {
     std::lock_guard<std::mutex> lock(clients_mutex);
     auto it = clients.find(client_id);
+    bool connected = it != clients.end() && it->second->isConnected();
+
+    // 断开中、等待重连的会话也在这里结束
+    bool ended = sessions && sessions->end(client_id);
+    if (!connected && !ended)
+        return false;
 
-    if (it != clients.end() && it->second->isConnected())
+    if (it != clients.end())
     {
-        it->second->close();
+        closeConnection(it->second);
         clients.erase(it);
-
-        // 触发断开连接事件
-        if (disconnection_handler)
+        if (capture)
         {
-            disconnection_handler(client_id);
+            capture->record(CaptureEvent::Disconnect, client_id, nullptr, 0);
         }
+    }
 
-        return true;
+    // 触发断开连接事件
+    if (disconnection_handler)
+    {
+        disconnection_handler(client_id);
     }
 
-    return false;
+    return true;
 }
 
 bool WebSocketServer::isClientExists(int client_id) const
@@ -5,64 +5,371 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <set>
 #include <memory>
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <chrono>
 #ifdef __linux__
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #else
 // Windows compatibility headers would go here
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #pragma comment(lib, "ws2_32.lib")
 #endif
-#include <openssl/sha.h>
-#include <openssl/evp.h>
-#include <openssl/bio.h>
-#include <openssl/buffer.h>
 #include "thread_pool.h"
+#include "websocket_tls.h"
+#include "websocket_handoff.h"
+#include "websocket_bus.h"
+#include "websocket_ingest.h"
+#include "websocket_capture.h"
+#include "websocket_session.h"
+#include "websocket_ratelimit.h"
+#include "websocket_utf8.h"
+
+// 对端地址按 sockaddr 原样保存，需要显示时才格式化，连接上不常驻地址字符串
+union PeerAddress
+{
+    struct sockaddr sa;
+    struct sockaddr_in v4;
+    struct sockaddr_in6 v6;
+};
 
 class WebSocketConnection
 {
 public:
-    WebSocketConnection(int socket_fd, const std::string &client_ip);
+    // 握手推进结果
+    enum class HandshakeState
+    {
+        InProgress, // 数据尚未到齐，等待下一次可读事件
+        Completed,  // 已发送101响应，连接可用
+        Rejected,   // 已以503拒绝
+        Failed      // 握手失败，连接应关闭
+    };
+
+    // tls 非空时该连接走 wss://，TLS握手与HTTP升级握手一起在epoll线程上非阻塞地完成；
+    // peer_addr 为 accept/getpeername 得到的对端地址，可为空
+    WebSocketConnection(int socket_fd, const struct sockaddr *peer_addr, TlsContext *tls = nullptr);
     ~WebSocketConnection();
 
+    // 推进握手（socket可读或可写时由epoll线程调用）；reject 为 true 时在请求到齐后以503拒绝
+    HandshakeState continueHandshake(bool reject);
+
     bool sendMessage(const std::string &message);
-    std::string receiveMessage();
+    // 发送已编码好的帧，多个接收者可以共享同一份编码结果
+    bool sendFrame(const std::string &frame);
+    // 以二进制帧发送文件 [offset, offset + length) 的内容，与其他消息按调用顺序发送
+    bool sendFile(int file_fd, off_t offset, size_t length);
+    // 按键合并发送：socket有积压时，同一键尚未发出的消息被新值替换
+    bool sendConflated(const std::string &key, const std::string &message);
+    // 紧急消息：与控制帧一起走紧急通道，在普通消息积压的当前帧写完后立即发送
+    bool sendUrgent(const std::string &message);
+    // 读取socket上所有可读的数据（边缘触发，读到EAGAIN为止）并取出其中完整的消息；
+    // 连接已关闭时返回 false，关闭前已收到的完整消息仍会放入 messages
+    bool receiveMessages(std::vector<std::string> &messages);
+    // 发送积压的出站数据，socket可写时由epoll线程调用
+    void flushOutput();
+    // 握手完成后输入缓冲区中是否还有未处理的数据（客户端紧跟握手请求发送的帧）
+    bool hasBufferedInput() const { return in_offset < in_buffer.size(); }
+
     bool isConnected() const { return connected; }
+    bool isTls() const { return ssl != nullptr; }
+
+    // 帧编码（服务器发出的帧不掩码）
+    static std::string encodeFrameHeader(uint8_t opcode, size_t payload_length);
+    static std::string encodeFrame(const std::string &payload);
     int getSocketFd() const { return socket_fd; }
-    std::string getClientIP() const { return client_ip; }
+    std::string getClientIP() const;
+    const std::string &getRequestPath() const { return request_path; }
+    // 关闭连接：shutdown 读写两个方向（所属epoll线程随即收到EPOLLHUP），fd 本身在连接对象释放时才关闭，
+    // 持有连接的一方清理完epoll注册和映射之前，这个fd号不会被新连接复用
     void close();
 
+    // 热升级：停止使用该连接但不关闭socket，取出尚未解析的入站数据、尚未发出的出站数据和未结束的分片消息。
+    // TLS会话状态无法交接，此时发送1001（going away）关闭帧并返回 false
+    bool detach(std::string &input, std::string &output, HandoffMessageState &message);
+    // 在新进程中恢复交接过来的连接
+    void restore(const std::string &request_path, const std::string &input, const std::string &output,
+                 const HandoffMessageState &message, bool established);
+
+    // 会话恢复：握手时解析请求路径中的 session/last_seq 参数（并从路径中去掉），101响应推迟到
+    // acceptSession 时发出，带上会话令牌；replay 中的帧紧跟在响应之后发送
+    void enableSessionHandshake();
+    bool getResumeRequest(std::string &token, uint64_t &last_seq) const;
+    bool acceptSession(const std::shared_ptr<ReplaySession> &session, const std::vector<std::string> &replay);
+    const std::shared_ptr<ReplaySession> &getSession() const { return session; }
+    // 是否收到了客户端的 close 帧（正常关闭，不再保留会话）
+    bool isClosedByPeer() const { return closed_by_peer; }
+
+    // 负责该连接的epoll线程编号
+    void setReactorIndex(int index) { reactor_index = index; }
+    int getReactorIndex() const { return reactor_index; }
+
+    // 是否直接在epoll线程上执行消息处理回调
+    void setInlineDispatch(bool enable) { inline_dispatch = enable; }
+    bool isInlineDispatch() const { return inline_dispatch; }
+
+    // 已派发到线程池但尚未处理完的读任务数，用于过载时挑选最重的连接
+    void beginTask() { pending_tasks.fetch_add(1, std::memory_order_relaxed); }
+    void endTask() { pending_tasks.fetch_sub(1, std::memory_order_relaxed); }
+    int getPendingTasks() const { return pending_tasks.load(std::memory_order_relaxed); }
+
+    // 限速：每条连接自己的计量与限速状态，以及同一客户端IP的所有连接共享的状态（可为空）。
+    // receiveMessages 取出消息后记账，epoll线程派发前通过 rateLimitDelay 检查是否超限
+    RateLimiter &getRateLimiter() { return rate_limiter; }
+    void setIpRateLimiter(const std::shared_ptr<RateLimiter> &limiter) { ip_rate_limiter = limiter; }
+    std::chrono::microseconds rateLimitDelay();
+    // 每次 receiveMessages 最多读取的字节数（默认256KB，0 表示读到EAGAIN为止），避免一条连接的突发数据
+    // 长时间占住读取线程；读到上限时 hasPendingInput 返回 true，socket中剩余的数据需要由调用方重新派发读取
+    void setReadLimit(size_t bytes) { read_limit = bytes; }
+    bool hasPendingInput() const { return input_pending; }
+    // 单条消息的负载上限（分片消息按所有分片累计），0 表示不限；帧头一解析完就检查，超出时以1009关闭
+    void setMaxMessageSize(size_t bytes) { max_message_size = bytes; }
+    // 读取所有权：同一时刻只有一个线程读取该连接并执行它的消息回调，消息按到达顺序处理。
+    // epoll线程派发读取前 acquireRead，已有读取者时返回 false 并记下有新数据；读取者读完后 releaseRead，
+    // 返回 true 表示读取期间来了新的边缘事件，需要重新派发读取。这样socket中不会有无人负责读取的数据
+    bool acquireRead();
+    bool releaseRead() { return read_state.exchange(ReadIdle) == ReadOwnedDirty; }
+    // epoll报告对端已关闭写方向（EPOLLRDHUP/EPOLLHUP）：之后的读取不再以短读判断缓冲区已空，一直读到EOF
+    void setPeerShutdown() { peer_shutdown = true; }
+    bool isPeerShutdown() const { return peer_shutdown; }
+    // close() 时是否只半关闭了写方向（本端先发出了 close 帧或拒绝响应），此时应读完对端的剩余数据再关闭fd
+    bool isLingering() const { return lingering; }
+
 private:
     int socket_fd;
-    std::string client_ip;
+    PeerAddress peer_addr;
     std::atomic<bool> connected;
+    std::atomic<bool> closed;
+    std::atomic<int> pending_tasks;
+    std::string request_path;
+    int reactor_index;
+    bool inline_dispatch;
+    RateLimiter rate_limiter;
+    std::shared_ptr<RateLimiter> ip_rate_limiter;
+    bool closed_by_peer;
+
+    // 会话恢复：握手完成后设置，此后发出的数据帧在发送锁内交给会话编号保存
+    struct SessionHandshake
+    {
+        std::string response; // 尚未发出的101响应（不含结尾的空行）
+        std::string token;
+        uint64_t last_seq;
+    };
+    std::unique_ptr<SessionHandshake> session_handshake; // 只在握手期间存在
+    std::shared_ptr<ReplaySession> session;
+
+    // TLS 状态；锁顺序为 recv_mutex -> tls_mutex -> send_mutex
+    TlsContext *tls;
+    SSL *ssl;
+    bool socket_bio;      // kTLS 模式下SSL直接读写socket，否则经由内存BIO
+    bool tls_established; // TLS握手是否完成
+    bool ktls_send;       // 内核已接管发送方向的记录加密，可以使用 SSL_sendfile
+    std::mutex tls_mutex;
+
+    // 入站数据（TLS时为解密后的明文）
+    std::mutex recv_mutex;
+    size_t read_limit;
+    std::atomic<bool> input_pending;
+    std::atomic<bool> peer_shutdown;
+    enum ReadState
+    {
+        ReadIdle,
+        ReadOwned,
+        ReadOwnedDirty // 读取期间又有数据到达
+    };
+    std::atomic<int> read_state;
+    std::string in_buffer;
+    size_t in_offset;
+    size_t max_message_size;
+    uint8_t message_opcode; // 未结束的分片消息的类型（0x1/0x2），0 表示不在分片消息中
+    uint64_t message_bytes; // 未结束的分片消息已收到的负载字节数
+    Utf8StreamValidator utf8_stream; // 分片文本消息跨分片的UTF-8校验状态
+
+    // 出站队列中的一段：明文内存数据，或待sendfile发送的文件区间
+    struct OutboundChunk
+    {
+        std::string data;
+        size_t offset;  // data 中已发送的字节数
+        int file_fd;    // >= 0 表示文件区间（复制得到的fd，发送完毕后关闭）
+        off_t file_offset;
+        size_t file_remaining;
+    };
+
+    // 出站数据分两条通道，都以明文帧排队（内存BIO模式下写socket前才加密）：
+    // 普通通道 outbound 按入队顺序发送；紧急通道 urgent 存放控制帧和紧急消息，
+    // 在普通通道的帧边界处插队，不会拆开已经写出一部分的帧
     std::mutex send_mutex;
+    std::list<OutboundChunk> outbound; // 空队列不占堆内存（deque 构造时就会分配）
+    std::string tls_out; // 内存BIO模式：已加密、尚未写出的数据
+    size_t tls_out_offset;
+    std::string urgent;
+    size_t urgent_offset;
+    size_t bulk_unit_left; // 普通通道中正在写出的帧（或握手响应）还剩的字节数，0 表示位于帧边界
+    bool closing;          // 紧急通道中有 close 帧，写出后丢弃普通通道
+    bool lingering;        // 主动关闭，只半关闭了写方向
+    std::atomic<bool> pending_output;
+
+    // 按键合并的消息（已编码的帧）：出站队列发完后按各键首次入队的顺序写出，
+    // 因此积压时占用的内存只与键的数量有关。只在积压时创建，写出后即释放
+    typedef std::list<std::pair<std::string, std::string>> ConflatedList;
+    struct ConflatedQueue
+    {
+        ConflatedList frames;
+        std::unordered_map<std::string, ConflatedList::iterator> index;
+    };
+    std::unique_ptr<ConflatedQueue> conflated;
+
+    bool readInput();
+    bool readSocket();
+    void extractMessages(std::vector<std::string> &messages);
+    bool queueOutput(const char *data, size_t length);
+    bool queueLocked(const char *data, size_t length);
+    bool queueResponse(const char *data, size_t length);
+    bool queueUrgent(const char *data, size_t length, bool close_frame = false);
+    std::string &outputBuffer();
+    void moveTlsOutput();
+    bool encrypt(const char *data, size_t length);
+    void releaseConflated();
+    void discardBulk();
+    void advanceBulk(const char *data, size_t written, size_t available);
+    static size_t frameLength(const uint8_t *data, size_t available);
+    bool flushLocked();
+    ssize_t writePlain(const char *data, size_t length);
+    ssize_t writeSome(const char *data, size_t length);
+    ssize_t writeFile(OutboundChunk &chunk, size_t limit);
+    bool loadFileChunk();
 
-    std::string encodeFrame(const std::string &payload);
-    std::string decodeFrame(const std::vector<uint8_t> &frame);
-    bool performHandshake();
-    std::string generateAcceptKey(const std::string &key);
-    std::string base64Encode(const std::vector<uint8_t> &input);
+    // discard_pending 为 true 时 close 帧插到积压之前发送（协议错误时），否则排在已有消息之后
+    void sendClose(uint16_t status, bool discard_pending);
+    // 解析一帧，数据不完整时返回 0；协议错误时 close_status 为应发出的关闭状态码，返回值为应丢弃的字节数
+    size_t decodeFrame(const uint8_t *data, size_t size, uint8_t &opcode, std::string &payload, uint16_t &close_status);
+    bool performHandshake(const std::string &request);
+    void parseSessionParams();
 };
 
 class WebSocketServer
 {
 public:
+    // 线程池持续过载时的负载削减策略
+    enum class OverloadPolicy
+    {
+        PauseReads,      // 暂停读取积压最多的连接，等队列消化后恢复
+        RejectHandshakes // 拒绝新的握手请求（返回 503）
+    };
+
+    // 消息处理回调的执行位置
+    enum class DispatchMode
+    {
+        Pool,  // 交给线程池执行（默认）
+        Inline // 直接在epoll线程上执行，适合回显这类极轻量的处理
+    };
+
+    // 内联处理统计
+    struct InlineStats
+    {
+        uint64_t inline_messages; // 在epoll线程上处理的消息数
+        uint64_t budget_overruns; // 处理耗时超出预算的次数
+        uint64_t max_handler_us;  // 观察到的最长处理耗时（微秒）
+    };
+
+    // 过载控制统计
+    struct OverloadStats
+    {
+        bool overloaded;              // 当前是否处于过载状态
+        size_t queue_size;            // 当前排队任务数
+        size_t paused_connections;    // 当前被暂停读取的连接数
+        uint64_t shed_reads;          // 因 CoDel 削减而暂停读取的次数
+        uint64_t deferred_reads;      // 因队列已满而推迟读取的次数
+        uint64_t rejected_handshakes; // 以 503 拒绝的握手数
+        size_t throttled_connections; // 当前因超出限速而暂停读取的连接数
+        uint64_t throttled_reads;     // 因超出限速而暂停读取的次数
+    };
+
+    // 客户端信息（console 的 list 命令使用）
+    struct ClientInfo
+    {
+        int client_id;
+        std::string client_ip;
+        double messages_per_sec; // 最近约一秒内收到的消息速率
+        double bytes_per_sec;    // 最近约一秒内收到的负载字节速率
+    };
+
+    // TLS 握手统计
+    typedef TlsContext::Stats TlsStats;
+
+    // 广播总线统计
+    typedef BroadcastBus::Stats BusStats;
+
+    // 流量录制统计
+    typedef TrafficCapture::Stats CaptureStats;
+
+    // 会话恢复统计
+    typedef SessionStore::Stats SessionStats;
+
+    // 外部注入统计
+    struct IngestStats
+    {
+        bool producer_connected; // 当前是否有生产者连接
+        uint64_t published;      // 生产者写入的记录数
+        uint64_t rejected;       // 因环已满被拒绝的记录数（生产者侧计数）
+        size_t backlog_bytes;    // 最慢的epoll线程尚未处理的字节数
+    };
+
+    // accept 统计
+    struct AcceptStats
+    {
+        uint64_t accepted;         // 已接受的连接数
+        uint64_t accept_errors;    // accept 失败次数（如fd耗尽）
+        size_t backlog_queued;     // 当前在全连接队列中等待accept的连接数
+        size_t backlog_limit;      // 全连接队列上限（内核按 somaxconn 截断后的值）
+        uint64_t listen_overflows; // 启动以来全连接队列溢出次数（TcpExt ListenOverflows，全系统计数）
+        uint64_t listen_drops;     // 启动以来被丢弃的连接请求数（TcpExt ListenDrops，全系统计数）
+    };
+
+    // NUMA 放置统计
+    struct NumaStats
+    {
+        size_t numa_nodes;              // 系统 NUMA 节点数
+        uint64_t local_dispatches;      // epoll线程与工作线程位于同一节点的派发数
+        uint64_t cross_node_dispatches; // 跨节点交给工作线程处理的派发数
+        uint64_t cross_node_accepts;    // 网卡中断所在节点与接管的epoll线程不同的连接数
+    };
+
     WebSocketServer(int port, size_t thread_pool_size = 4);
     ~WebSocketServer();
 
     bool start();
     void stop();
+    // 向所有客户端广播；配置了广播总线时同一份编码结果也发给同机的其他服务器进程
     void broadcastMessage(const std::string &message);
-    void sendMessageToClient(int client_id, const std::string &message);
+    bool sendMessageToClient(int client_id, const std::string &message);
+    // 向一组客户端发送同一条消息：只编码一次，一次遍历客户端表解析全部接收者。
+    // 接收者较多时按所在epoll线程分组并行写入，此时发送是异步完成的，
+    // 与调用线程随后通过 sendMessageToClient 发出的消息之间不保证先后顺序。
+    // 返回找到的在线接收者数
+    size_t sendToClients(const int *client_ids, size_t count, const std::string &message);
+    size_t sendToClients(const std::vector<int> &client_ids, const std::string &message);
+    // 以二进制帧向客户端发送文件内容：明文和kTLS连接上负载经sendfile直接从页缓存发送，
+    // 不经过用户态拷贝，用户态加密的TLS连接在socket可写时每次读出64KB；fd 在调用返回后即可关闭
+    bool sendFile(int client_id, int fd, off_t offset, size_t length);
+    // 只关心最新值的更新（行情、状态）：客户端跟不上时，同一 key 尚未写出的消息被新值替换，
+    // 每个连接积压的内存以不同 key 的数量为上限。合并的消息在积压的普通消息发完后才写出，
+    // 可能晚于之后发出的普通消息到达
+    bool sendConflated(int client_id, const std::string &key, const std::string &message);
+    // 紧急消息（如取消、告警）：与 ping/pong/close 等控制帧一起走紧急通道，不排在普通消息的积压之后，
+    // 只等待正在写出的那一帧写完。kTLS 连接上退化为按顺序发送
+    bool sendUrgentToClient(int client_id, const std::string &message);
 
     // 服务器状态查询
     bool isRunning() const { return running; }
@@ -70,6 +377,7 @@ public:
     size_t getThreadPoolSize() const;
     size_t getAvailableThreads() const;
     std::vector<std::pair<int, std::string>> getConnectedClients() const;
+    std::vector<ClientInfo> getClientInfo() const;
     bool disconnectClient(int client_id);
     bool isClientExists(int client_id) const;
 
@@ -78,9 +386,143 @@ public:
     void setConnectionHandler(std::function<void(int, const std::string &)> handler);
     void setDisconnectionHandler(std::function<void(int)> handler);
 
+    // 在指定epoll线程上执行任务（线程安全），供协程等上层接口在epoll线程上恢复执行
+    int getClientReactor(int client_id) const;
+    bool runOnReactor(int reactor_index, Task task);
+    bool runAfter(int reactor_index, std::chrono::milliseconds delay, Task task);
+    // fd 就绪（events 为 EPOLLIN/EPOLLOUT）时执行一次任务
+    bool runWhenReady(int reactor_index, int fd, uint32_t events, Task task);
+
+    // 派发模式配置：按服务器默认值，或按握手请求路径单独指定
+    void setDispatchMode(DispatchMode mode);
+    void setRouteDispatchMode(const std::string &path, DispatchMode mode);
+    void setInlineTimeBudget(std::chrono::microseconds budget);
+    InlineStats getInlineStats() const;
+
+    // 过载控制配置
+    void setOverloadPolicy(OverloadPolicy policy);
+    void setDispatchQueueLimit(size_t limit);
+    OverloadStats getOverloadStats() const;
+
+    // 限速配置（需在 start() 之前调用，0 表示不限）：分别限制每条连接和每个客户端IP的
+    // 消息数/秒与负载字节数/秒，允许一秒额度的突发。超限的连接在epoll线程上暂停读取，
+    // 数据留在内核缓冲区中由TCP流控反压给客户端，令牌补足后自动恢复，不会丢弃消息
+    void setClientRateLimit(double messages_per_sec, double bytes_per_sec);
+    void setIpRateLimit(double messages_per_sec, double bytes_per_sec);
+    // 单条消息的负载上限（需在 start() 之前调用，默认16MB，0 表示不限）：分片消息按所有分片累计，
+    // 帧头一解析完就检查，超出时以1009关闭连接，不会先把超大的负载读进内存
+    void setMaxMessageSize(size_t bytes);
+
+    // CPU 亲和性与 NUMA 配置（需在 start() 之前调用）
+    void setReactorCount(size_t count);
+    void setReactorCpus(const std::vector<int> &cpus);
+    void setWorkerCpus(const std::vector<int> &cpus);
+    void setIncomingCpuSteering(bool enable);
+    NumaStats getNumaStats() const;
+
+    // 监听配置（需在 start() 之前调用）
+    void setListenBacklog(int backlog);
+    // 开启 TCP_DEFER_ACCEPT：连接上有数据（升级请求）到达后才唤醒accept，seconds 为最长等待时间，0 表示关闭
+    void setDeferAccept(int seconds);
+    // 添加监听地址，可多次调用；设置后不再监听默认的 0.0.0.0:port。所有监听socket上的新连接
+    // 都交给同一组epoll线程处理。地址格式：
+    //   "0.0.0.0"、"127.0.0.1:9000"        IPv4，省略端口时使用构造函数中的端口
+    //   "::"、"[::1]:9000"                 IPv6；"::" 为双栈，同时接受IPv4连接（不要再同时监听 0.0.0.0）
+    //   "unix:/run/websocket.sock"         Unix域socket，启动时会先删除遗留的socket文件
+    // 地址无法解析时返回 false
+    bool addListenAddress(const std::string &address);
+    AcceptStats getAcceptStats() const;
+
+    // TLS（wss://）配置（需在 start() 之前调用）
+    bool enableTls(const std::string &cert_file, const std::string &key_file);
+    // 多个进程加载同一份80字节票据密钥文件后，客户端在任一进程上都能恢复会话
+    bool setTlsTicketKeyFile(const std::string &key_file);
+    void setKtlsEnabled(bool enable);
+    bool isTlsEnabled() const { return tls_context != nullptr; }
+    TlsStats getTlsStats() const;
+
+    // 热升级（需在 start() 之前调用）：start() 时若 path 上有旧进程在运行，则通过 SCM_RIGHTS
+    // 接管它的监听socket和明文连接（TCP连接不会重置），之后在 path 上等待下一个新进程。
+    // 交接完成后旧进程停止服务并调用升级回调（通常用于退出进程）
+    void setUpgradeSocket(const std::string &path);
+    void setUpgradeHandler(std::function<void()> handler);
+
+    // 同机多进程广播（需在 start() 之前调用）：使用同一目录的服务器进程组成广播总线，
+    // broadcastMessage 只编码一次，帧经Unix域数据报发给其他进程，由它们直接写给各自的客户端。
+    // 单个帧超过 BroadcastBus::max_frame_size 时只在本进程广播
+    void setBroadcastBus(const std::string &directory);
+    bool isBroadcastBusEnabled() const { return bus != nullptr; }
+    BusStats getBusStats() const;
+
+    // 外部进程注入（需在 start() 之前调用）：在 socket_path 上等待一个生产者（IngestProducer）连接，
+    // 之后生产者经 ring_bytes 大小的共享内存环写入发给指定客户端、某个请求路径上的所有客户端
+    // 或所有客户端的消息，各epoll线程直接从环中读出记录编码成帧写给自己负责的连接
+    void setIngestSocket(const std::string &socket_path, size_t ring_bytes = 16 * 1024 * 1024);
+    IngestStats getIngestStats() const;
+
+    // 流量录制（需在 start() 之前调用）：把连接建立/断开、收到和发出的消息连同客户端ID和单调时间戳
+    // 追加到内存映射的 path 中，供 websocket_bench replay 重放。文件最多 max_bytes 字节，写满后丢弃新记录。
+    // 广播记为一条 client_id 为 -1 的记录；sendFile 不录制文件内容，经广播总线和注入环送达的消息不录制
+    void setCaptureFile(const std::string &path, size_t max_bytes = 1024 * 1024 * 1024);
+    CaptureStats getCaptureStats() const;
+
+    // 会话恢复（需在 start() 之前调用，grace_seconds 为 0 表示关闭）：握手响应带 X-Session-Token 头，
+    // 之后发给客户端的文本/二进制帧按顺序编号，每个会话保留最近 session_bytes 字节的帧。
+    // 连接意外断开后会话保留 grace_seconds 秒，期间发给该客户端ID的消息照常存入会话；客户端用
+    // ?session=<令牌>&last_seq=<已收到的数据帧数> 重连时沿用原来的客户端ID，只重放错过的帧，
+    // 调用恢复回调（参数为重放的帧数）而不是连接回调。断开回调推迟到会话过期或被逐出时调用。
+    // 客户端发送 close 帧或服务器调用 disconnectClient 时会话立即结束。所有会话合计最多保留
+    // total_bytes 字节，超出时先结束断开最久的会话。会话不随热升级交接
+    void setSessionResumption(int grace_seconds, size_t session_bytes = 256 * 1024,
+                              size_t total_bytes = 256 * 1024 * 1024);
+    void setResumeHandler(std::function<void(int, size_t)> handler);
+    // 浏览器读不到握手响应头，可在连接回调中把令牌作为普通消息发给客户端
+    std::string getSessionToken(int client_id) const;
+    SessionStats getSessionStats() const;
+
 private:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+    // 注入消息的待发缓冲区：连接 -> （连接的引用，攒好的帧）
+    typedef std::unordered_map<WebSocketConnection *, std::pair<std::shared_ptr<WebSocketConnection>, std::string>>
+        IngestOutput;
+
+    // 投递到epoll线程的任务：立即执行、定时执行或等待fd就绪后执行
+    struct PostedTask
+    {
+        Task task;
+        TimePoint deadline; // 非零表示定时任务
+        int fd;             // >= 0 表示等待该fd就绪
+        uint32_t events;
+    };
+
+    // 一个epoll线程及其独占的监听socket和连接表
+    struct Reactor
+    {
+        int index;
+        int epoll_fd;
+        std::vector<int> listen_fds; // Unix域socket的监听fd由所有epoll线程共享
+        int wake_fd;   // eventfd，用于唤醒epoll线程处理投递的任务
+        int cpu;       // 绑定的CPU，-1 表示不绑定
+        int numa_node; // 绑定CPU所在的NUMA节点，-1 表示未知
+        std::thread thread;
+
+        // 其他线程投递的任务
+        std::mutex posted_mutex;
+        std::vector<PostedTask> posted_tasks;
+
+        // 以下状态仅由该epoll线程访问
+        std::map<int, std::shared_ptr<WebSocketConnection>> handshaking; // 尚未完成握手的连接
+        std::unordered_map<int, int> socket_to_client_id;
+        std::set<int> paused_sockets;
+        std::set<int> throttled_sockets; // 因超出限速而暂停读取的连接
+        std::multimap<TimePoint, Task> timers;
+        std::map<int, Task> fd_watchers;
+        std::map<int, TimePoint> lingering; // 主动关闭后等待对端关闭的fd（复制得到）及其最迟关闭时间
+        // 从注入环读出的一批记录，按连接攒成连续的帧后一次写出
+        IngestOutput ingest_output;
+    };
+
     int port;
-    int server_socket;
     std::atomic<bool> running;
     std::unique_ptr<ThreadPool> thread_pool;
     size_t thread_pool_size;
@@ -94,11 +536,147 @@ private:
     std::function<void(int, const std::string &)> message_handler;
     std::function<void(int, const std::string &)> connection_handler;
     std::function<void(int)> disconnection_handler;
+    std::function<void(int, size_t)> resume_handler;
+
+    // 派发模式
+    DispatchMode dispatch_mode;
+    std::map<std::string, DispatchMode> route_dispatch_modes;
+    std::chrono::microseconds inline_time_budget;
+    std::atomic<uint64_t> inline_messages;
+    std::atomic<uint64_t> inline_budget_overruns;
+    std::atomic<uint64_t> inline_max_handler_us;
+    std::atomic<int64_t> last_overrun_report; // 上次打印超时告警的时间（秒），用于限制告警频率
+
+    // epoll线程
+    std::vector<std::unique_ptr<Reactor>> reactors;
+    size_t reactor_count;
+    std::vector<int> reactor_cpus;
+    bool incoming_cpu_steering;
+
+    // 过载控制
+    OverloadPolicy overload_policy;
+    std::atomic<size_t> paused_count;
+    std::atomic<uint64_t> shed_reads;
+    std::atomic<uint64_t> deferred_reads;
+    std::atomic<uint64_t> rejected_handshakes;
+
+    // 限速
+    double client_message_rate;
+    double client_byte_rate;
+    double ip_message_rate;
+    double ip_byte_rate;
+    std::atomic<size_t> throttled_count;
+    std::atomic<uint64_t> throttled_reads;
+    size_t max_message_size;
+    std::unordered_map<std::string, std::weak_ptr<RateLimiter>> ip_rate_limiters;
+    size_t ip_rate_limiters_swept; // 上次清理后的表大小，表翻倍时清理失效项
+    std::mutex ip_rate_limiters_mutex;
+
+    // 监听与accept
+    struct ListenAddress
+    {
+        int family;       // AF_INET / AF_INET6 / AF_UNIX
+        std::string host; // 绑定地址，AF_UNIX 时为socket文件路径
+        int port;
+    };
+    std::vector<ListenAddress> listen_addresses;
+    int listen_backlog;
+    int defer_accept_seconds;
+    std::atomic<uint64_t> accepted_connections;
+    std::atomic<uint64_t> accept_errors;
+    uint64_t baseline_listen_overflows;
+    uint64_t baseline_listen_drops;
+
+    // TLS
+    std::unique_ptr<TlsContext> tls_context;
+    bool ktls_enabled;
+
+    // 热升级
+    std::string upgrade_path;
+    int upgrade_fd;
+    bool handed_off;
+    std::thread upgrade_thread;
+    std::function<void()> upgrade_handler;
+    // 在 clients_mutex 内取得连接、释放锁后才写入的发送（sendToClients、sendFile 等）的数量；
+    // 交接时从客户端表移除连接后等它归零再 detach，否则这些写入会落在已交出的连接上被丢弃
+    std::atomic<int> unlocked_sends;
+
+    // 广播总线
+    std::string bus_directory;
+    std::unique_ptr<BroadcastBus> bus;
+
+    // 外部注入
+    std::string ingest_path;
+    size_t ingest_ring_bytes;
+    std::unique_ptr<IngestRing> ingest_ring;
+    int ingest_listen_fd;
+    std::atomic<int> ingest_channel; // 当前生产者的连接，-1 表示没有
+
+    // 流量录制
+    std::string capture_path;
+    size_t capture_max_bytes;
+    std::unique_ptr<TrafficCapture> capture;
+
+    // 会话恢复
+    int session_grace_seconds;
+    size_t session_bytes;
+    size_t session_total_bytes;
+    std::shared_ptr<SessionStore> sessions;
+
+    // NUMA 统计
+    std::atomic<uint64_t> local_dispatches;
+    std::atomic<uint64_t> cross_node_dispatches;
+    std::atomic<uint64_t> cross_node_accepts;
+
+    void eventLoop(Reactor &reactor);
+    bool postToReactor(int reactor_index, PostedTask &&posted);
+    void runPostedTasks(Reactor &reactor);
+    void runExpiredTimers(Reactor &reactor);
+    int nextTimerTimeout(Reactor &reactor, int timeout);
+    void advanceHandshake(Reactor &reactor, int client_socket);
+    DispatchMode routeDispatchMode(const std::string &path) const;
+    void dispatchRead(Reactor &reactor, int client_socket, uint32_t events);
+    void handleInline(Reactor &reactor, std::shared_ptr<WebSocketConnection> connection, int client_id);
+    void runInlineHandler(const std::shared_ptr<WebSocketConnection> &connection, int client_id, const std::string &message);
+    // 调用消息回调，回调抛出的异常在这里记录并吞掉，保证连接的读取权和任务计数照常释放
+    void invokeMessageHandler(int client_id, const std::string &message);
+    void cleanupSocket(Reactor &reactor, int sock_fd);
+    void lingerSocket(Reactor &reactor, int sock_fd);
+    void drainLingering(Reactor &reactor, int fd);
+    void closeLingering(Reactor &reactor, int fd);
+    // 在任意线程中关闭连接，并交给所属epoll线程清理
+    void closeConnection(const std::shared_ptr<WebSocketConnection> &connection);
+    void pauseReads(Reactor &reactor, int sock_fd);
+    void resumePausedReads(Reactor &reactor);
+    void shedHeaviestConnection(Reactor &reactor);
+    void applyRateLimits(WebSocketConnection &connection);
+    void redispatchRead(const std::shared_ptr<WebSocketConnection> &connection);
+    void throttleReads(Reactor &reactor, const std::shared_ptr<WebSocketConnection> &connection,
+                       std::chrono::microseconds delay);
 
-    std::shared_ptr<WebSocketConnection> acceptConnections();
-    void handleClient(std::shared_ptr<WebSocketConnection> connection, int client_id);
+    void acceptConnections(Reactor &reactor, int listen_fd);
+    void addConnection(Reactor &reactor, int client_socket, const struct sockaddr *client_addr);
     void removeClient(int client_id);
-    bool setupSocket();
+    bool setupSockets(std::vector<std::vector<int>> &listeners);
+    bool receiveHandoff(int channel, std::vector<std::vector<int>> &listeners, std::vector<HandoffEntry> &connections);
+    void adoptConnections(std::vector<HandoffEntry> &connections);
+    void watchUpgradeSocket();
+    void watchBroadcastBus();
+    void watchBusPeers();
+    void watchBusBacklog(int wait_fd);
+    void deliverFrame(const std::string &frame);
+    void watchIngestSocket();
+    void watchIngestProducer();
+    void drainIngest(Reactor &reactor);
+    void captureInbound(int client_id, const std::vector<std::string> &messages);
+    void expireSessions();
+    bool retainForSession(int client_id, const std::string &message);
+    // 在 clients_mutex 内调用，返回的引用全部释放时（包括投递到epoll线程的批次）才算写入结束
+    std::shared_ptr<void> beginUnlockedSend();
+    void handOff(int channel);
+    void runOnEachReactor(const std::function<void(Reactor &)> &fn);
+    int createListenSocket(const ListenAddress &address, bool reuse_port);
+    bool configureListenSocket(int listen_fd);
 };
 
 #endif
@@ -0,0 +1,360 @@
+#include "websocket_session.h"
+#include <cstring>
+#include <sys/random.h>
+
+// 服务器发出的帧不掩码；返回整帧长度，不完整时返回 0
+static size_t serverFrameLength(const uint8_t *data, size_t available)
+{
+    if (available < 2)
+        return 0;
+
+    uint64_t payload_length = data[1] & 0x7F;
+    size_t header_size = 2;
+    if (payload_length == 126)
+    {
+        if (available < 4)
+            return 0;
+        payload_length = (data[2] << 8) | data[3];
+        header_size = 4;
+    }
+    else if (payload_length == 127)
+    {
+        if (available < 10)
+            return 0;
+        payload_length = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            payload_length = (payload_length << 8) | data[2 + i];
+        }
+        header_size = 10;
+    }
+    if (available - header_size < payload_length)
+        return 0;
+    return header_size + static_cast<size_t>(payload_length);
+}
+
+// 128位随机令牌，十六进制表示
+static std::string generateToken()
+{
+    unsigned char random[16];
+    size_t filled = 0;
+    while (filled < sizeof(random))
+    {
+        ssize_t n = getrandom(random + filled, sizeof(random) - filled, 0);
+        if (n > 0)
+            filled += n;
+    }
+
+    static const char digits[] = "0123456789abcdef";
+    std::string token(sizeof(random) * 2, '0');
+    for (size_t i = 0; i < sizeof(random); i++)
+    {
+        token[i * 2] = digits[random[i] >> 4];
+        token[i * 2 + 1] = digits[random[i] & 0x0F];
+    }
+    return token;
+}
+
+// 每个保留的帧在帧内容之外的开销（字符串对象本身），计入会话和总量上限，大量极小的帧不会超出上限
+static const size_t frame_overhead = sizeof(std::string);
+
+ReplaySession::ReplaySession(const std::weak_ptr<SessionStore> &store, const std::string &token, int client_id,
+                             const std::string &path, size_t max_bytes)
+    : store(store), token(token), client_id(client_id), path(path), max_bytes(max_bytes),
+      first_seq(1), next_seq(1), bytes(0), owner(nullptr), attached(false), ended(false)
+{
+}
+
+long ReplaySession::appendLocked(const char *frame, size_t length)
+{
+    frames.emplace_back(frame, length);
+    next_seq++;
+    bytes += length + frame_overhead;
+    long delta = static_cast<long>(length + frame_overhead);
+    if (bytes > max_bytes)
+        delta += trimLocked(max_bytes);
+    return delta;
+}
+
+long ReplaySession::trimLocked(size_t target_bytes)
+{
+    long delta = 0;
+    while (bytes > target_bytes && !frames.empty())
+    {
+        bytes -= frames.front().size() + frame_overhead;
+        delta -= static_cast<long>(frames.front().size() + frame_overhead);
+        frames.pop_front();
+        first_seq++;
+    }
+    return delta;
+}
+
+void ReplaySession::account(long delta)
+{
+    std::shared_ptr<SessionStore> s = store.lock();
+    if (!s || delta == 0)
+        return;
+    s->retained_bytes += delta;
+    if (delta > 0 && s->retained_bytes > s->total_bytes)
+        s->enforceLimit(this);
+}
+
+void ReplaySession::retain(const void *connection, const char *data, size_t length)
+{
+    long delta = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ended || owner != connection)
+            return;
+
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+        while (length > 0)
+        {
+            size_t frame_length = serverFrameLength(p, length);
+            if (frame_length == 0)
+                break;
+            uint8_t opcode = p[0] & 0x0F;
+            if (opcode == 0x1 || opcode == 0x2)
+                delta += appendLocked(reinterpret_cast<const char *>(p), frame_length);
+            p += frame_length;
+            length -= frame_length;
+        }
+    }
+    account(delta);
+}
+
+void ReplaySession::skip(const void *connection)
+{
+    long delta;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ended || owner != connection)
+            return;
+        // 覆盖这一帧的恢复都会失败，之前的帧留着也无法重放
+        delta = -static_cast<long>(bytes);
+        std::deque<std::string>().swap(frames);
+        bytes = 0;
+        next_seq++;
+        first_seq = next_seq;
+    }
+    account(delta);
+}
+
+SessionStore::SessionStore(std::chrono::milliseconds grace_period, size_t session_bytes, size_t total_bytes)
+    : grace_period(grace_period), session_bytes(session_bytes), total_bytes(total_bytes), retained_bytes(0),
+      detached_count(0), resumed(0), replayed_frames(0), resume_failures(0), evicted(0)
+{
+}
+
+std::shared_ptr<ReplaySession> SessionStore::create(int client_id, const std::string &path, const void *owner)
+{
+    std::shared_ptr<ReplaySession> session =
+        std::make_shared<ReplaySession>(shared_from_this(), generateToken(), client_id, path, session_bytes);
+    session->owner = owner;
+    session->attached = true;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    by_token[session->token] = session;
+    by_client[client_id] = session;
+    return session;
+}
+
+std::shared_ptr<ReplaySession> SessionStore::resume(const std::string &token, uint64_t last_seq, const void *owner,
+                                                    std::vector<std::string> &replay)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = by_token.find(token);
+    if (it == by_token.end())
+    {
+        resume_failures++;
+        return nullptr;
+    }
+    std::shared_ptr<ReplaySession> session = it->second;
+
+    std::lock_guard<std::mutex> session_lock(session->mutex);
+    // 客户端声称收到的帧比发出的还多，或者错过的帧已被丢弃
+    if (last_seq >= session->next_seq || last_seq + 1 < session->first_seq)
+    {
+        resume_failures++;
+        return nullptr;
+    }
+    size_t first = static_cast<size_t>(last_seq + 1 - session->first_seq);
+    replay.assign(session->frames.begin() + first, session->frames.end());
+    if (!session->attached)
+    {
+        detached.erase(session->detached_position);
+        detached_count--;
+    }
+    // 旧连接可能还没发现自己已断开，由新连接接管
+    session->owner = owner;
+    session->attached = true;
+    resumed++;
+    replayed_frames += replay.size();
+    return session;
+}
+
+bool SessionStore::detach(int client_id, const void *owner)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = by_client.find(client_id);
+    if (it == by_client.end())
+        return false;
+    std::shared_ptr<ReplaySession> session = it->second;
+
+    std::lock_guard<std::mutex> session_lock(session->mutex);
+    if (session->owner != owner || !session->attached)
+        return false;
+    session->attached = false;
+    session->detached_at = std::chrono::steady_clock::now();
+    session->detached_position = detached.insert(detached.end(), session);
+    detached_count++;
+    return true;
+}
+
+bool SessionStore::end(int client_id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<ReplaySession> session = findSession(client_id);
+    if (!session)
+        return false;
+    removeLocked(session);
+    return true;
+}
+
+void SessionStore::removeLocked(const std::shared_ptr<ReplaySession> &session)
+{
+    long delta;
+    bool was_attached;
+    {
+        std::lock_guard<std::mutex> session_lock(session->mutex);
+        session->ended = true;
+        delta = -static_cast<long>(session->bytes);
+        std::deque<std::string>().swap(session->frames);
+        session->bytes = 0;
+        was_attached = session->attached;
+    }
+    retained_bytes += delta;
+    if (!was_attached)
+    {
+        detached.erase(session->detached_position);
+        detached_count--;
+    }
+    by_token.erase(session->token);
+    by_client.erase(session->client_id);
+}
+
+std::shared_ptr<ReplaySession> SessionStore::findSession(int client_id)
+{
+    auto it = by_client.find(client_id);
+    if (it == by_client.end())
+        return nullptr;
+    return it->second;
+}
+
+bool SessionStore::retain(int client_id, const std::string &frame)
+{
+    std::shared_ptr<ReplaySession> session;
+    long delta;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        session = findSession(client_id);
+        if (!session)
+            return false;
+        std::lock_guard<std::mutex> session_lock(session->mutex);
+        if (session->attached)
+            return false;
+        delta = session->appendLocked(frame.data(), frame.size());
+    }
+    session->account(delta);
+    return true;
+}
+
+void SessionStore::retainDetached(const std::string &frame, const char *topic, size_t topic_length)
+{
+    long delta = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const std::shared_ptr<ReplaySession> &session : detached)
+        {
+            if (topic && (session->path.size() != topic_length ||
+                          memcmp(session->path.data(), topic, topic_length) != 0))
+                continue;
+            std::lock_guard<std::mutex> session_lock(session->mutex);
+            delta += session->appendLocked(frame.data(), frame.size());
+        }
+    }
+    if (delta == 0)
+        return;
+    retained_bytes += delta;
+    if (delta > 0 && retained_bytes > total_bytes)
+        enforceLimit(nullptr);
+}
+
+void SessionStore::enforceLimit(ReplaySession *keep)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    while (retained_bytes > total_bytes)
+    {
+        // 断开最久的会话最不可能被恢复
+        auto it = detached.begin();
+        while (it != detached.end() && it->get() == keep)
+            ++it;
+        if (it == detached.end())
+            break;
+        std::shared_ptr<ReplaySession> victim = *it;
+        removeLocked(victim);
+        ended_ids.push_back(victim->client_id);
+        evicted++;
+    }
+    if (retained_bytes > total_bytes && keep)
+    {
+        long delta;
+        {
+            std::lock_guard<std::mutex> session_lock(keep->mutex);
+            size_t excess = retained_bytes - total_bytes;
+            delta = keep->trimLocked(keep->bytes > excess ? keep->bytes - excess : 0);
+        }
+        retained_bytes += delta;
+    }
+}
+
+std::vector<int> SessionStore::collectExpired()
+{
+    std::vector<int> expired;
+    TimePoint now = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    expired.swap(ended_ids);
+    while (!detached.empty() && now - detached.front()->detached_at >= grace_period)
+    {
+        std::shared_ptr<ReplaySession> session = detached.front();
+        expired.push_back(session->client_id);
+        removeLocked(session);
+    }
+    return expired;
+}
+
+void SessionStore::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    while (!by_client.empty())
+    {
+        std::shared_ptr<ReplaySession> session = by_client.begin()->second;
+        removeLocked(session);
+    }
+    ended_ids.clear();
+}
+
+SessionStore::Stats SessionStore::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats stats;
+    stats.sessions = by_client.size();
+    stats.detached = detached.size();
+    stats.retained_bytes = retained_bytes.load();
+    stats.resumed = resumed;
+    stats.replayed_frames = replayed_frames;
+    stats.resume_failures = resume_failures;
+    stats.evicted = evicted;
+    return stats;
+}
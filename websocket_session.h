@@ -0,0 +1,140 @@
+#ifndef WEBSOCKET_SESSION_H
+#define WEBSOCKET_SESSION_H
+
+#include <string>
+#include <deque>
+#include <list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+
+// 会话恢复：握手时给客户端一个会话令牌，之后发给它的数据帧（文本/二进制）按到达客户端的顺序从1开始编号，
+// 最近的一段帧保留在会话中。连接断开后会话继续保留一段宽限期，期间发给该客户端的消息也存入会话；
+// 客户端带着令牌和最后收到的序号重连时沿用原来的客户端ID，只重放它错过的帧。
+//
+// 序号就是客户端在该会话中收到的数据帧个数，帧内容不变，客户端只需计数。
+
+class SessionStore;
+
+class ReplaySession
+{
+public:
+    ReplaySession(const std::weak_ptr<SessionStore> &store, const std::string &token, int client_id,
+                  const std::string &path, size_t max_bytes);
+
+    const std::string &getToken() const { return token; }
+    int getClientId() const { return client_id; }
+    const std::string &getPath() const { return path; }
+
+    // 由连接在发送锁内调用：data 为一个或多个完整的服务器帧，给其中的数据帧编号并保留，控制帧跳过。
+    // owner 不是会话当前的持有者（已被重连的新连接接管）时忽略
+    void retain(const void *owner, const char *data, size_t length);
+    // 发出了一个内容无法保留的数据帧（sendFile）：占用一个序号。此前保留的帧都已无法完整重放，一并丢弃，
+    // 之后只能恢复到这一帧之后
+    void skip(const void *owner);
+
+private:
+    friend class SessionStore;
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    std::weak_ptr<SessionStore> store;
+    const std::string token;
+    const int client_id;
+    const std::string path;
+    const size_t max_bytes;
+
+    // 以下由 mutex 保护；锁顺序为 连接的send_mutex -> SessionStore::mutex -> mutex
+    std::mutex mutex;
+    std::deque<std::string> frames; // 序号从 first_seq 开始的帧
+    uint64_t first_seq;
+    uint64_t next_seq;              // 下一个数据帧的序号
+    size_t bytes;                   // frames 占用的字节数（每帧另计 frame_overhead）
+    const void *owner;              // 持有会话的连接；断开后仍保留，在途的发送照常存入
+    bool attached;
+    bool ended;
+
+    // 以下由 SessionStore::mutex 保护
+    TimePoint detached_at;
+    std::list<std::shared_ptr<ReplaySession>>::iterator detached_position;
+
+    // 调用方持有 mutex，返回保留字节数的变化
+    long appendLocked(const char *frame, size_t length);
+    long trimLocked(size_t target_bytes);
+    void account(long delta);
+};
+
+class SessionStore : public std::enable_shared_from_this<SessionStore>
+{
+public:
+    struct Stats
+    {
+        size_t sessions;          // 保留中的会话数
+        size_t detached;          // 其中连接已断开、等待恢复的会话数
+        size_t retained_bytes;    // 所有会话保留的帧占用的字节数（含每帧的管理开销）
+        uint64_t resumed;         // 成功恢复的次数
+        uint64_t replayed_frames; // 恢复时重放的帧数
+        uint64_t resume_failures; // 令牌未知、会话已过期或错过的帧已不在会话中的恢复请求数
+        uint64_t evicted;         // 因总内存上限被提前结束的会话数
+    };
+
+    // grace_period：断开后保留会话的时长；session_bytes：每个会话最多保留的帧字节数；
+    // total_bytes：所有会话合计的上限，超出时先结束断开最久的会话，仍不够时丢弃当前会话最旧的帧
+    SessionStore(std::chrono::milliseconds grace_period, size_t session_bytes, size_t total_bytes);
+
+    // 为新连接创建会话，owner 为持有它的连接
+    std::shared_ptr<ReplaySession> create(int client_id, const std::string &path, const void *owner);
+    // 恢复：令牌有效且 last_seq 之后的帧都还在会话中时，由 owner 接管会话，需要重放的帧放入 replay；
+    // 否则返回空，客户端应作为新连接处理
+    std::shared_ptr<ReplaySession> resume(const std::string &token, uint64_t last_seq, const void *owner,
+                                          std::vector<std::string> &replay);
+    // 连接断开：owner 仍持有会话时开始宽限期，返回 true；否则（已被接管或会话已结束）返回 false
+    bool detach(int client_id, const void *owner);
+    // 立即结束会话（客户端正常关闭、服务器主动断开），没有该会话时返回 false
+    bool end(int client_id);
+    // 客户端断开期间发给它的帧；没有等待恢复的会话时返回 false
+    bool retain(int client_id, const std::string &frame);
+    // 是否有断开中的会话，广播路径用它避免每条消息都加锁
+    bool hasDetached() const { return detached_count.load(std::memory_order_relaxed) > 0; }
+    // 发给所有断开中的会话；topic 非空时只发给握手路径相同的会话
+    void retainDetached(const std::string &frame, const char *topic = nullptr, size_t topic_length = 0);
+    // 取出宽限期已过、以及因内存上限被结束的会话的客户端ID
+    std::vector<int> collectExpired();
+    void clear();
+
+    Stats getStats() const;
+
+private:
+    friend class ReplaySession;
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    const std::chrono::milliseconds grace_period;
+    const size_t session_bytes;
+    const size_t total_bytes;
+    std::atomic<size_t> retained_bytes;
+    std::atomic<size_t> detached_count;
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<ReplaySession>> by_token;
+    std::unordered_map<int, std::shared_ptr<ReplaySession>> by_client;
+    std::list<std::shared_ptr<ReplaySession>> detached; // 按断开时间排序
+    std::vector<int> ended_ids;                         // 被逐出、等待 collectExpired 取走的客户端ID
+    uint64_t resumed;
+    uint64_t replayed_frames;
+    uint64_t resume_failures;
+    uint64_t evicted;
+
+    std::shared_ptr<ReplaySession> findSession(int client_id);
+    void removeLocked(const std::shared_ptr<ReplaySession> &session);
+    // 合计超出上限时逐出断开最久的会话（不含 keep），仍超出时裁剪 keep 自己
+    void enforceLimit(ReplaySession *keep);
+
+    SessionStore(const SessionStore &) = delete;
+    SessionStore &operator=(const SessionStore &) = delete;
+};
+
+#endif
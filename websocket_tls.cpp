@@ -0,0 +1,163 @@
+#include "websocket_tls.h"
+#include "websocket_log.h"
+#include <fstream>
+#include <vector>
+
+#ifndef WEBSOCKET_NO_TLS
+
+TlsContext::TlsContext()
+    : ctx(nullptr), ktls(false), full_handshakes(0), resumed_handshakes(0), failed_handshakes(0), ktls_connections(0)
+{
+    ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx)
+        return;
+
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+
+    // 非阻塞写入时允许部分写入，并允许重试时缓冲区地址变化
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    // 服务端会话缓存（TLS 1.2 会话ID）与会话票据（TLS 1.2/1.3）都开启
+    static const unsigned char session_id_context[] = "websocket_server";
+    SSL_CTX_set_session_id_context(ctx, session_id_context, sizeof(session_id_context) - 1);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, 100000);
+    SSL_CTX_set_num_tickets(ctx, 1);
+}
+
+TlsContext::~TlsContext()
+{
+    if (ctx)
+        SSL_CTX_free(ctx);
+}
+
+bool TlsContext::loadCertificate(const std::string &cert_file, const std::string &key_file)
+{
+    if (!ctx)
+        return false;
+
+    if (SSL_CTX_use_certificate_chain_file(ctx, cert_file.c_str()) != 1)
+    {
+        WEBSOCKET_LOG_ERROR("Failed to load TLS certificate " << cert_file);
+        return false;
+    }
+    if (SSL_CTX_use_PrivateKey_file(ctx, key_file.c_str(), SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx) != 1)
+    {
+        WEBSOCKET_LOG_ERROR("Failed to load TLS private key " << key_file);
+        return false;
+    }
+    return true;
+}
+
+bool TlsContext::loadTicketKeys(const std::string &key_file)
+{
+    std::ifstream file(key_file.c_str(), std::ios::binary);
+    std::vector<unsigned char> keys(80);
+    if (!ctx || !file.read(reinterpret_cast<char *>(keys.data()), keys.size()))
+    {
+        WEBSOCKET_LOG_ERROR("Failed to read 80-byte TLS ticket key file " << key_file);
+        return false;
+    }
+    return SSL_CTX_set_tlsext_ticket_keys(ctx, keys.data(), keys.size()) == 1;
+}
+
+void TlsContext::setKtls(bool enable)
+{
+    ktls = enable;
+    if (!ctx)
+        return;
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    if (enable)
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+    else
+        SSL_CTX_clear_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+}
+
+SSL *TlsContext::createSession(int socket_fd)
+{
+    if (!ctx)
+        return nullptr;
+
+    SSL *ssl = SSL_new(ctx);
+    if (!ssl)
+        return nullptr;
+
+    if (ktls)
+    {
+        SSL_set_fd(ssl, socket_fd);
+    }
+    else
+    {
+        BIO *rbio = BIO_new(BIO_s_mem());
+        BIO *wbio = BIO_new(BIO_s_mem());
+        // 内存BIO读空时返回“重试”而不是EOF
+        BIO_set_mem_eof_return(rbio, -1);
+        BIO_set_mem_eof_return(wbio, -1);
+        SSL_set_bio(ssl, rbio, wbio);
+    }
+    SSL_set_accept_state(ssl);
+    return ssl;
+}
+
+void TlsContext::recordHandshake(SSL *ssl)
+{
+    if (SSL_session_reused(ssl))
+        resumed_handshakes++;
+    else
+        full_handshakes++;
+
+    if (ktls && BIO_get_ktls_send(SSL_get_wbio(ssl)))
+        ktls_connections++;
+}
+
+#else
+
+TlsContext::TlsContext()
+    : ctx(nullptr), ktls(false), full_handshakes(0), resumed_handshakes(0), failed_handshakes(0), ktls_connections(0)
+{
+}
+
+TlsContext::~TlsContext()
+{
+}
+
+bool TlsContext::loadCertificate(const std::string &cert_file, const std::string &)
+{
+    WEBSOCKET_LOG_ERROR("Cannot load TLS certificate " << cert_file << ": built without TLS support");
+    return false;
+}
+
+bool TlsContext::loadTicketKeys(const std::string &key_file)
+{
+    WEBSOCKET_LOG_ERROR("Cannot load TLS ticket keys " << key_file << ": built without TLS support");
+    return false;
+}
+
+void TlsContext::setKtls(bool enable)
+{
+    ktls = enable;
+}
+
+SSL *TlsContext::createSession(int)
+{
+    return nullptr;
+}
+
+void TlsContext::recordHandshake(SSL *)
+{
+}
+
+#endif
+
+TlsContext::Stats TlsContext::getStats() const
+{
+    Stats stats;
+    stats.full_handshakes = full_handshakes;
+    stats.resumed_handshakes = resumed_handshakes;
+    stats.failed_handshakes = failed_handshakes;
+    stats.ktls_connections = ktls_connections;
+    return stats;
+}
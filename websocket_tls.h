@@ -0,0 +1,65 @@
+#ifndef WEBSOCKET_TLS_H
+#define WEBSOCKET_TLS_H
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#ifndef WEBSOCKET_NO_TLS
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#else
+// 不带TLS编译时只保留类型声明，TlsContext 的各个方法都是空实现
+typedef struct ssl_st SSL;
+typedef struct ssl_ctx_st SSL_CTX;
+#endif
+
+// 服务端TLS上下文，所有epoll线程共享同一个 SSL_CTX，
+// 因此会话缓存和会话票据密钥也是共享的，客户端重连时可以跳过完整握手
+class TlsContext
+{
+public:
+    struct Stats
+    {
+        uint64_t full_handshakes;    // 完整握手次数
+        uint64_t resumed_handshakes; // 通过会话票据/会话缓存恢复的握手次数
+        uint64_t failed_handshakes;  // 失败的握手次数
+        uint64_t ktls_connections;   // 记录加密已交给内核（kTLS）的连接数
+    };
+
+    TlsContext();
+    ~TlsContext();
+
+    // 加载证书链和私钥（PEM格式）
+    bool loadCertificate(const std::string &cert_file, const std::string &key_file);
+
+    // 从文件加载80字节的会话票据密钥，多个进程使用同一份密钥时可以互相恢复会话
+    bool loadTicketKeys(const std::string &key_file);
+
+    // 启用kTLS：握手完成后由内核负责记录加密，发送路径保持零拷贝
+    void setKtls(bool enable);
+    bool isKtlsEnabled() const { return ktls; }
+
+    // 为新连接创建SSL对象。kTLS模式下直接绑定socket（OpenSSL只在socket BIO上启用kTLS），
+    // 否则使用内存BIO，由epoll线程驱动读写
+    SSL *createSession(int socket_fd);
+
+    // 握手完成后记录统计
+    void recordHandshake(SSL *ssl);
+    void recordFailure() { failed_handshakes++; }
+
+    Stats getStats() const;
+
+private:
+    SSL_CTX *ctx;
+    bool ktls;
+
+    std::atomic<uint64_t> full_handshakes;
+    std::atomic<uint64_t> resumed_handshakes;
+    std::atomic<uint64_t> failed_handshakes;
+    std::atomic<uint64_t> ktls_connections;
+
+    TlsContext(const TlsContext &) = delete;
+    TlsContext &operator=(const TlsContext &) = delete;
+};
+
+#endif
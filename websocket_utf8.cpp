@@ -0,0 +1,451 @@
+#include "websocket_utf8.h"
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define WEBSOCKET_UTF8_X86 1
+#include <immintrin.h>
+#endif
+
+// 标量实现：8字节一组走ASCII快速路径，遇到多字节序列时逐字节解码
+static bool unmaskAndValidateScalar(const uint8_t *src, size_t length, const uint8_t *mask, uint8_t *dst)
+{
+    // 按起始相位预先展开的8字节掩码
+    uint64_t mask64[4];
+    for (int phase = 0; phase < 4; phase++)
+    {
+        uint8_t bytes[8];
+        for (int k = 0; k < 8; k++)
+            bytes[k] = mask[(phase + k) & 3];
+        memcpy(&mask64[phase], bytes, 8);
+    }
+
+    size_t i = 0;
+    while (i < length)
+    {
+        if (i + 8 <= length)
+        {
+            uint64_t word;
+            memcpy(&word, src + i, 8);
+            word ^= mask64[i & 3];
+            memcpy(dst + i, &word, 8);
+            if ((word & 0x8080808080808080ULL) == 0)
+            {
+                i += 8;
+                continue;
+            }
+        }
+
+        uint8_t lead = src[i] ^ mask[i & 3];
+        dst[i] = lead;
+        if (lead < 0x80)
+        {
+            i++;
+            continue;
+        }
+
+        size_t continuation;
+        uint32_t code_point, min_code_point;
+        if ((lead & 0xE0) == 0xC0)
+        {
+            continuation = 1;
+            code_point = lead & 0x1F;
+            min_code_point = 0x80;
+        }
+        else if ((lead & 0xF0) == 0xE0)
+        {
+            continuation = 2;
+            code_point = lead & 0x0F;
+            min_code_point = 0x800;
+        }
+        else if ((lead & 0xF8) == 0xF0)
+        {
+            continuation = 3;
+            code_point = lead & 0x07;
+            min_code_point = 0x10000;
+        }
+        else
+        {
+            return false;
+        }
+
+        if (i + continuation >= length)
+            return false;
+
+        for (size_t k = 1; k <= continuation; k++)
+        {
+            uint8_t byte = src[i + k] ^ mask[(i + k) & 3];
+            if ((byte & 0xC0) != 0x80)
+                return false;
+            dst[i + k] = byte;
+            code_point = (code_point << 6) | (byte & 0x3F);
+        }
+
+        // 过长编码、超出Unicode范围、UTF-16代理区
+        if (code_point < min_code_point || code_point > 0x10FFFF || (code_point >= 0xD800 && code_point <= 0xDFFF))
+            return false;
+
+        i += continuation + 1;
+    }
+    return true;
+}
+
+#ifdef WEBSOCKET_UTF8_X86
+
+// 向量实现采用 Keiser & Lemire 的查表算法（"Validating UTF-8 In Less Than One Instruction Per Byte"）：
+// 用前一个字节的高/低4位和当前字节的高4位查三张表，三者按位与不为零即为非法的两字节组合；
+// 再检查三、四字节序列要求的后续续字节，以及块末尾未完成的序列。
+namespace
+{
+    const uint8_t TOO_SHORT = 1 << 0;      // 11______ 0_______ 或 11______ 11______
+    const uint8_t TOO_LONG = 1 << 1;       // 0_______ 10______
+    const uint8_t OVERLONG_3 = 1 << 2;     // 11100000 100_____
+    const uint8_t TOO_LARGE = 1 << 3;      // 11110100 1001____ 等（> U+10FFFF）
+    const uint8_t SURROGATE = 1 << 4;      // 11101101 101_____
+    const uint8_t OVERLONG_2 = 1 << 5;     // 1100000_ 10______
+    const uint8_t TOO_LARGE_1000 = 1 << 6; // 11110101 1000____ 等
+    const uint8_t OVERLONG_4 = 1 << 6;     // 11110000 1000____
+    const uint8_t TWO_CONTS = 1 << 7;      // 10______ 10______
+    const uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+    // 前一个字节的高4位
+    const uint8_t byte_1_high_table[16] = {
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        TOO_SHORT | OVERLONG_2,
+        TOO_SHORT,
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4};
+
+    // 前一个字节的低4位
+    const uint8_t byte_1_low_table[16] = {
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+        CARRY | OVERLONG_2,
+        CARRY,
+        CARRY,
+        CARRY | TOO_LARGE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000};
+
+    // 当前字节的高4位
+    const uint8_t byte_2_high_table[16] = {
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT};
+
+    // 块末尾3个字节若是未完成序列的开头，会大于对应位置的阈值
+    const uint8_t incomplete_threshold[32] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xF0 - 1, 0xE0 - 1, 0xC0 - 1};
+}
+
+// ---- SSE4.2（每块16字节） ----
+
+struct Utf8StateSse
+{
+    __m128i error;
+    __m128i prev_input;
+    __m128i prev_incomplete;
+};
+
+__attribute__((target("sse4.2"))) static inline __m128i highNibbleSse(__m128i v)
+{
+    return _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F));
+}
+
+__attribute__((target("sse4.2"))) static inline void checkBlockSse(Utf8StateSse &state, __m128i input)
+{
+    if (_mm_movemask_epi8(input) == 0)
+    {
+        // 纯ASCII块：只需确认上一块没有以未完成的序列结尾
+        state.error = _mm_or_si128(state.error, state.prev_incomplete);
+        state.prev_incomplete = _mm_setzero_si128();
+        state.prev_input = input;
+        return;
+    }
+
+    __m128i prev1 = _mm_alignr_epi8(input, state.prev_input, 15);
+    __m128i byte_1_high = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(byte_1_high_table)), highNibbleSse(prev1));
+    __m128i byte_1_low = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(byte_1_low_table)), _mm_and_si128(prev1, _mm_set1_epi8(0x0F)));
+    __m128i byte_2_high = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(byte_2_high_table)), highNibbleSse(input));
+    __m128i special_cases = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+    // 三、四字节序列的第3、4个字节必须是续字节
+    __m128i prev2 = _mm_alignr_epi8(input, state.prev_input, 14);
+    __m128i prev3 = _mm_alignr_epi8(input, state.prev_input, 13);
+    __m128i is_third_byte = _mm_subs_epu8(prev2, _mm_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+    __m128i is_fourth_byte = _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+    __m128i must_be_continuation = _mm_and_si128(_mm_or_si128(is_third_byte, is_fourth_byte), _mm_set1_epi8(static_cast<char>(0x80)));
+
+    state.error = _mm_or_si128(state.error, _mm_xor_si128(must_be_continuation, special_cases));
+    state.prev_incomplete = _mm_subs_epu8(input, _mm_loadu_si128(reinterpret_cast<const __m128i *>(incomplete_threshold + 16)));
+    state.prev_input = input;
+}
+
+__attribute__((target("sse4.2"))) static bool unmaskAndValidateSse4(const uint8_t *src, size_t length, const uint8_t *mask, uint8_t *dst)
+{
+    uint32_t mask32;
+    memcpy(&mask32, mask, 4);
+    const __m128i mask_vec = _mm_set1_epi32(static_cast<int>(mask32));
+
+    Utf8StateSse state;
+    state.error = _mm_setzero_si128();
+    state.prev_input = _mm_setzero_si128();
+    state.prev_incomplete = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i input = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)), mask_vec);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), input);
+        checkBlockSse(state, input);
+    }
+
+    // 不足一块的尾部补零（ASCII），以块起点为相位（块长是4的倍数）
+    if (i < length)
+    {
+        uint8_t tail[16] = {0};
+        for (size_t k = 0; i + k < length; k++)
+            tail[k] = src[i + k] ^ mask[k & 3];
+        memcpy(dst + i, tail, length - i);
+        checkBlockSse(state, _mm_loadu_si128(reinterpret_cast<const __m128i *>(tail)));
+    }
+
+    __m128i error = _mm_or_si128(state.error, state.prev_incomplete);
+    return _mm_testz_si128(error, error) != 0;
+}
+
+// ---- AVX2（每块32字节） ----
+
+struct Utf8StateAvx2
+{
+    __m256i error;
+    __m256i prev_input;
+    __m256i prev_incomplete;
+};
+
+__attribute__((target("avx2"))) static inline __m256i loadTableAvx2(const uint8_t *table)
+{
+    return _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(table)));
+}
+
+__attribute__((target("avx2"))) static inline __m256i highNibbleAvx2(__m256i v)
+{
+    return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+
+__attribute__((target("avx2"))) static inline void checkBlockAvx2(Utf8StateAvx2 &state, __m256i input)
+{
+    if (_mm256_movemask_epi8(input) == 0)
+    {
+        state.error = _mm256_or_si256(state.error, state.prev_incomplete);
+        state.prev_incomplete = _mm256_setzero_si256();
+        state.prev_input = input;
+        return;
+    }
+
+    // 跨128位通道取前N个字节：低通道从上一块的高通道补齐
+    __m256i carried = _mm256_permute2x128_si256(state.prev_input, input, 0x21);
+    __m256i prev1 = _mm256_alignr_epi8(input, carried, 15);
+    __m256i byte_1_high = _mm256_shuffle_epi8(loadTableAvx2(byte_1_high_table), highNibbleAvx2(prev1));
+    __m256i byte_1_low = _mm256_shuffle_epi8(loadTableAvx2(byte_1_low_table), _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)));
+    __m256i byte_2_high = _mm256_shuffle_epi8(loadTableAvx2(byte_2_high_table), highNibbleAvx2(input));
+    __m256i special_cases = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    __m256i prev2 = _mm256_alignr_epi8(input, carried, 14);
+    __m256i prev3 = _mm256_alignr_epi8(input, carried, 13);
+    __m256i is_third_byte = _mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+    __m256i is_fourth_byte = _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+    __m256i must_be_continuation = _mm256_and_si256(_mm256_or_si256(is_third_byte, is_fourth_byte), _mm256_set1_epi8(static_cast<char>(0x80)));
+
+    state.error = _mm256_or_si256(state.error, _mm256_xor_si256(must_be_continuation, special_cases));
+    state.prev_incomplete = _mm256_subs_epu8(input, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(incomplete_threshold)));
+    state.prev_input = input;
+}
+
+__attribute__((target("avx2"))) static bool unmaskAndValidateAvx2(const uint8_t *src, size_t length, const uint8_t *mask, uint8_t *dst)
+{
+    uint32_t mask32;
+    memcpy(&mask32, mask, 4);
+    const __m256i mask_vec = _mm256_set1_epi32(static_cast<int>(mask32));
+
+    Utf8StateAvx2 state;
+    state.error = _mm256_setzero_si256();
+    state.prev_input = _mm256_setzero_si256();
+    state.prev_incomplete = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32)
+    {
+        __m256i input = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i)), mask_vec);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), input);
+        checkBlockAvx2(state, input);
+    }
+
+    if (i < length)
+    {
+        uint8_t tail[32] = {0};
+        for (size_t k = 0; i + k < length; k++)
+            tail[k] = src[i + k] ^ mask[k & 3];
+        memcpy(dst + i, tail, length - i);
+        checkBlockAvx2(state, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(tail)));
+    }
+
+    __m256i error = _mm256_or_si256(state.error, state.prev_incomplete);
+    return _mm256_testz_si256(error, error) != 0;
+}
+
+#endif
+
+Utf8Impl bestUtf8Impl()
+{
+#ifdef WEBSOCKET_UTF8_X86
+    static const Utf8Impl impl = __builtin_cpu_supports("avx2")     ? Utf8Impl::Avx2
+                                 : __builtin_cpu_supports("sse4.2") ? Utf8Impl::Sse4
+                                                                    : Utf8Impl::Scalar;
+    return impl;
+#else
+    return Utf8Impl::Scalar;
+#endif
+}
+
+const char *utf8ImplName(Utf8Impl impl)
+{
+    switch (impl)
+    {
+    case Utf8Impl::Avx2:
+        return "avx2";
+    case Utf8Impl::Sse4:
+        return "sse4";
+    default:
+        return "scalar";
+    }
+}
+
+bool unmaskAndValidateUtf8(const uint8_t *src, size_t length, const uint8_t *mask, uint8_t *dst)
+{
+    return unmaskAndValidateUtf8(bestUtf8Impl(), src, length, mask, dst);
+}
+
+bool unmaskAndValidateUtf8(Utf8Impl impl, const uint8_t *src, size_t length, const uint8_t *mask, uint8_t *dst)
+{
+#ifdef WEBSOCKET_UTF8_X86
+    // 不支持的实现退回标量版本
+    if (impl == Utf8Impl::Avx2 && __builtin_cpu_supports("avx2"))
+        return unmaskAndValidateAvx2(src, length, mask, dst);
+    if (impl == Utf8Impl::Sse4 && __builtin_cpu_supports("sse4.2"))
+        return unmaskAndValidateSse4(src, length, mask, dst);
+#else
+    (void)impl;
+#endif
+    return unmaskAndValidateScalar(src, length, mask, dst);
+}
+
+// 首字节对应的序列长度，不可能出现在合法UTF-8中的首字节返回 0
+static size_t sequenceLength(uint8_t lead)
+{
+    if (lead >= 0xC2 && lead <= 0xDF)
+        return 2;
+    if (lead >= 0xE0 && lead <= 0xEF)
+        return 3;
+    if (lead >= 0xF0 && lead <= 0xF4)
+        return 4;
+    return 0;
+}
+
+// 未完成的序列能否补全为合法字符：第二个字节的范围由首字节决定（排除过长编码、代理区和超出范围的码点）
+static bool validPrefix(const uint8_t *bytes, size_t length)
+{
+    if (length >= 2)
+    {
+        uint8_t low = 0x80, high = 0xBF;
+        if (bytes[0] == 0xE0)
+            low = 0xA0;
+        else if (bytes[0] == 0xED)
+            high = 0x9F;
+        else if (bytes[0] == 0xF0)
+            low = 0x90;
+        else if (bytes[0] == 0xF4)
+            high = 0x8F;
+        if (bytes[1] < low || bytes[1] > high)
+            return false;
+    }
+    return length < 3 || (bytes[2] & 0xC0) == 0x80;
+}
+
+bool Utf8StreamValidator::restore(const std::string &bytes)
+{
+    if (bytes.size() >= sizeof(pending))
+        return false;
+    memcpy(pending, bytes.data(), bytes.size());
+    pending_length = bytes.size();
+    if (pending_length == 0 || (sequenceLength(pending[0]) > pending_length && validPrefix(pending, pending_length)))
+        return true;
+    pending_length = 0;
+    return false;
+}
+
+bool Utf8StreamValidator::update(const uint8_t *src, size_t length, const uint8_t *mask, uint8_t *dst)
+{
+    static const uint8_t no_mask[4] = {0, 0, 0, 0};
+
+    // 先用分片开头的字节补全上一个分片留下的序列
+    size_t start = 0;
+    if (pending_length > 0)
+    {
+        size_t needed = sequenceLength(pending[0]) - pending_length;
+        for (; start < needed && start < length; start++)
+        {
+            dst[start] = src[start] ^ mask[start & 3];
+            pending[pending_length++] = dst[start];
+        }
+        if (start < needed)
+            return validPrefix(pending, pending_length);
+
+        uint8_t sequence[4];
+        if (!unmaskAndValidateScalar(pending, pending_length, no_mask, sequence))
+            return false;
+        pending_length = 0;
+    }
+
+    // 末尾最多3字节可能是未完成的序列：从后往前找到首字节，序列会越过分片末尾时留到下一个分片
+    size_t end = length;
+    for (size_t back = 1; back <= 3 && back <= length - start; back++)
+    {
+        uint8_t byte = src[length - back] ^ mask[(length - back) & 3];
+        if ((byte & 0xC0) == 0x80)
+            continue;
+        if (sequenceLength(byte) > back)
+            end = length - back;
+        break;
+    }
+
+    // 中间部分走整块校验，掩码按起始位置旋转
+    if (end > start)
+    {
+        uint8_t rotated[4];
+        for (int k = 0; k < 4; k++)
+            rotated[k] = mask[(start + k) & 3];
+        if (!unmaskAndValidateUtf8(src + start, end - start, rotated, dst + start))
+            return false;
+    }
+
+    for (size_t i = end; i < length; i++)
+    {
+        dst[i] = src[i] ^ mask[i & 3];
+        pending[pending_length++] = dst[i];
+    }
+    return pending_length == 0 || validPrefix(pending, pending_length);
+}
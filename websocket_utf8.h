@@ -0,0 +1,51 @@
+#ifndef WEBSOCKET_UTF8_H
+#define WEBSOCKET_UTF8_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 文本帧负载的去掩码与UTF-8校验（RFC 6455 要求文本帧必须是合法的UTF-8）
+//
+// 去掩码和校验在同一遍扫描中完成，负载只读一次。x86 上按CPU能力在运行时选择
+// AVX2 / SSE4.2 实现，其他平台使用标量实现。
+
+enum class Utf8Impl
+{
+    Scalar,
+    Sse4,
+    Avx2
+};
+
+// 当前CPU上可用的最快实现
+Utf8Impl bestUtf8Impl();
+const char *utf8ImplName(Utf8Impl impl);
+
+// 将 src 去掩码后写入 dst（两者可以是同一块内存），同时校验结果是否为合法UTF-8；
+// mask 为4字节掩码键，未掩码的帧传全零。返回 false 时 dst 的内容不完整
+bool unmaskAndValidateUtf8(const uint8_t *src, size_t length, const uint8_t *mask, uint8_t *dst);
+bool unmaskAndValidateUtf8(Utf8Impl impl, const uint8_t *src, size_t length, const uint8_t *mask, uint8_t *dst);
+
+// 分片文本消息的逐片校验：多字节序列可能跨越分片边界，分片末尾未完成的序列（最多3字节）
+// 只检查已有的前缀是否可能合法，剩余部分留到下一个分片。每条消息开始时 reset，
+// 最后一个分片之后 finish 检查消息没有停在序列中间
+class Utf8StreamValidator
+{
+public:
+    Utf8StreamValidator() : pending_length(0) {}
+
+    // 语义同 unmaskAndValidateUtf8，mask 的相位从 src[0] 开始
+    bool update(const uint8_t *src, size_t length, const uint8_t *mask, uint8_t *dst);
+    bool finish() const { return pending_length == 0; }
+    void reset() { pending_length = 0; }
+
+    // 热升级交接：取出未完成的序列，在新进程中原样恢复；恢复的不是合法的序列前缀时返回 false
+    std::string pendingBytes() const { return std::string(reinterpret_cast<const char *>(pending), pending_length); }
+    bool restore(const std::string &bytes);
+
+private:
+    uint8_t pending[4]; // 未完成的多字节序列（已去掩码）
+    size_t pending_length;
+};
+
+#endif